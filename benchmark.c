@@ -0,0 +1,313 @@
+// Jacob Bumbuna <developer@devbumbuna.com>
+// 2022
+// no copyright
+
+/**
+ * Benchmark driver.
+ *
+ * Runs every variant with the input file on stdin and its output discarded,
+ * keeps the best and median wall clock time of a few repetitions and
+ * reports throughput relative to the first variant. A variant is written as
+ * NAME=COMMAND where COMMAND is split on spaces. With --consumer the output
+ * goes through a pipe into that program instead, timed until both exit.
+ * --arguments appends every line of a file to each command as an argument.
+ *
+ * usage: benchmark --input FILE [--repeat N] [--json FILE] [--name NAME]
+ *                  [--consumer PATH] [--arguments FILE] NAME=COMMAND...
+*/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SUCCESS 0
+#define FAILURE 1
+#define MAX_VARIANTS 32
+#define MAX_REPEAT 64
+#define MAX_ARGUMENTS 32
+
+/* command line options */
+static const char *option_input = NULL;
+static int option_repeat = 3;
+static const char *option_json = NULL;
+static const char *option_name = "benchmark";
+static const char *option_consumer = NULL;
+static const char *option_arguments = NULL;
+
+/* a command being measured */
+typedef struct variant {
+    char *name;
+    char **argv;
+    double best;
+    double median;
+} variant_t;
+
+static variant_t variants[MAX_VARIANTS];
+static int variants_size;
+
+/* lines of the --arguments file */
+static char **extra_arguments;
+static int extra_arguments_size;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * split NAME=COMMAND into a variant.
+*/
+static int add_variant(char *specification) {
+    char *command = strchr(specification, '=');
+    if(command == NULL || variants_size == MAX_VARIANTS) {
+        fprintf(stderr, "benchmark: bad variant %s\n", specification);
+        return FAILURE;
+    }
+    variant_t *v = &variants[variants_size++];
+    *command++ = 0;
+    v->name = specification;
+    v->argv = malloc((MAX_ARGUMENTS + extra_arguments_size) * sizeof(char *));
+    if(v->argv == NULL) {
+        perror("malloc");
+        return FAILURE;
+    }
+    int argc = 0;
+    for(char *arg = strtok(command, " "); arg != NULL; arg = strtok(NULL, " ")) {
+        if(argc == MAX_ARGUMENTS-1) {
+            fprintf(stderr, "benchmark: too many arguments for %s\n", v->name);
+            return FAILURE;
+        }
+        v->argv[argc++] = arg;
+    }
+    if(argc == 0) {
+        return FAILURE;
+    }
+    for(int i = 0; i < extra_arguments_size; i++) {
+        v->argv[argc++] = extra_arguments[i];
+    }
+    v->argv[argc] = NULL;
+    return SUCCESS;
+}
+
+/**
+ * read the lines of the --arguments file.
+*/
+static int read_extra_arguments() {
+    FILE *f = fopen(option_arguments, "r");
+    if(f == NULL) {
+        perror("fopen");
+        return FAILURE;
+    }
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t n;
+    int capacity_arguments = 0;
+    while((n = getline(&line, &capacity, f)) > 0) {
+        if(line[n-1] == '\n') {
+            line[--n] = 0;
+        }
+        if(n == 0) {
+            continue;
+        }
+        if(extra_arguments_size == capacity_arguments) {
+            capacity_arguments = capacity_arguments ? capacity_arguments*2 : 64;
+            char **grown = realloc(extra_arguments, capacity_arguments * sizeof(char *));
+            if(grown == NULL) {
+                perror("realloc");
+                return FAILURE;
+            }
+            extra_arguments = grown;
+        }
+        extra_arguments[extra_arguments_size++] = strdup(line);
+    }
+    free(line);
+    fclose(f);
+    return SUCCESS;
+}
+
+static int parse_arguments(int argc, char **argv) {
+    /* options first, the variants take the extra arguments */
+    for(int i = 1; i < argc; i++) {
+        if(strncmp(argv[i], "--", 2)) {
+            continue;
+        }
+        if(i+1 >= argc) {
+            fprintf(stderr, "benchmark: missing value for %s\n", argv[i]);
+            return FAILURE;
+        }
+        const char *value = argv[++i];
+        if(!strcmp(argv[i-1], "--input")) {
+            option_input = value;
+        } else if(!strcmp(argv[i-1], "--repeat")) {
+            option_repeat = atoi(value);
+        } else if(!strcmp(argv[i-1], "--json")) {
+            option_json = value;
+        } else if(!strcmp(argv[i-1], "--name")) {
+            option_name = value;
+        } else if(!strcmp(argv[i-1], "--consumer")) {
+            option_consumer = value;
+        } else if(!strcmp(argv[i-1], "--arguments")) {
+            option_arguments = value;
+        } else {
+            fprintf(stderr, "benchmark: unknown option %s\n", argv[i-1]);
+            return FAILURE;
+        }
+    }
+    if(option_arguments != NULL && read_extra_arguments() != SUCCESS) {
+        return FAILURE;
+    }
+    for(int i = 1; i < argc; i++) {
+        if(!strncmp(argv[i], "--", 2)) {
+            i++;
+        } else if(add_variant(argv[i]) != SUCCESS) {
+            return FAILURE;
+        }
+    }
+    if(option_input == NULL || variants_size == 0 || option_repeat < 1 || option_repeat > MAX_REPEAT) {
+        fprintf(stderr, "usage: benchmark --input FILE [--repeat N] [--json FILE] [--name NAME]"
+            " [--consumer PATH] [--arguments FILE] NAME=COMMAND...\n");
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+/**
+ * start the consumer reading from the pipe, its output discarded.
+*/
+static pid_t start_consumer(int pipe_in, int null_fd) {
+    pid_t pid = fork();
+    if(pid == 0) {
+        dup2(pipe_in, STDIN_FILENO);
+        dup2(null_fd, STDOUT_FILENO);
+        execl(option_consumer, option_consumer, (char *)NULL);
+        _exit(127);
+    }
+    return pid;
+}
+
+/**
+ * run a variant once, returns the elapsed seconds or -1.
+*/
+static double run_variant(variant_t *v) {
+    int in = open(option_input, O_RDONLY|O_CLOEXEC);
+    int null_fd = open("/dev/null", O_WRONLY|O_CLOEXEC);
+    int out = null_fd;
+    int consumer_pipe[2] = {-1, -1};
+    pid_t consumer = 0;
+    if(in == -1 || null_fd == -1) {
+        perror("open");
+        return -1;
+    }
+    if(option_consumer != NULL) {
+        if(pipe2(consumer_pipe, O_CLOEXEC) == -1) {
+            perror("pipe");
+            return -1;
+        }
+        out = consumer_pipe[1];
+    }
+    double start = now();
+    if(option_consumer != NULL) {
+        consumer = start_consumer(consumer_pipe[0], null_fd);
+        close(consumer_pipe[0]);
+    }
+    pid_t pid = fork();
+    if(pid == 0) {
+        dup2(in, STDIN_FILENO);
+        dup2(out, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        execv(v->argv[0], v->argv);
+        _exit(127);
+    }
+    close(in);
+    close(null_fd);
+    if(option_consumer != NULL) {
+        close(consumer_pipe[1]);
+    }
+    int status, consumer_status;
+    if(pid == -1 || consumer == -1 || waitpid(pid, &status, 0) == -1 ||
+        (consumer > 0 && waitpid(consumer, &consumer_status, 0) == -1)) {
+        perror("benchmark");
+        return -1;
+    }
+    double elapsed = now() - start;
+    if(consumer > 0 && (!WIFEXITED(consumer_status) || WEXITSTATUS(consumer_status) != 0)) {
+        fprintf(stderr, "benchmark: consumer of %s failed\n", v->name);
+        return -1;
+    }
+    /* invalid lines make the calculator exit with 1 */
+    if(WIFSIGNALED(status) || WEXITSTATUS(status) > 1) {
+        fprintf(stderr, "benchmark: %s failed\n", v->name);
+        return -1;
+    }
+    return elapsed;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static long long count_lines() {
+    char chunk[1 << 16];
+    long long lines = 0;
+    int fd = open(option_input, O_RDONLY);
+    if(fd == -1) {
+        perror("open");
+        return -1;
+    }
+    ssize_t n;
+    while((n = read(fd, chunk, sizeof(chunk))) > 0) {
+        for(char *p = chunk; (p = memchr(p, '\n', chunk+n-p)) != NULL; p++) {
+            lines++;
+        }
+    }
+    close(fd);
+    return lines;
+}
+
+int main(int argc, char **argv) {
+    if(parse_arguments(argc, argv) != SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    long long lines = count_lines();
+    if(lines <= 0) {
+        return EXIT_FAILURE;
+    }
+    double times[MAX_REPEAT];
+    for(int i = 0; i < variants_size; i++) {
+        for(int r = 0; r < option_repeat; r++) {
+            if((times[r] = run_variant(&variants[i])) < 0) {
+                return EXIT_FAILURE;
+            }
+        }
+        qsort(times, option_repeat, sizeof(double), compare_doubles);
+        variants[i].best = times[0];
+        variants[i].median = times[option_repeat/2];
+    }
+    FILE *json = NULL;
+    if(option_json != NULL && (json = fopen(option_json, "a")) == NULL) {
+        perror("fopen");
+        return EXIT_FAILURE;
+    }
+    printf("%s: %lld lines, best of %d\n", option_name, lines, option_repeat);
+    printf("%-16s %12s %12s %14s %8s\n", "variant", "best s", "median s", "lines/s", "speedup");
+    for(int i = 0; i < variants_size; i++) {
+        variant_t *v = &variants[i];
+        double speedup = variants[0].best / v->best;
+        printf("%-16s %12.3f %12.3f %14.0f %7.2fx\n", v->name, v->best, v->median, lines / v->best, speedup);
+        if(json != NULL) {
+            fprintf(json, "{\"benchmark\": \"%s\", \"variant\": \"%s\", \"lines\": %lld, \"best_seconds\": %.4f,"
+                " \"median_seconds\": %.4f, \"lines_per_second\": %.0f, \"speedup\": %.3f}\n",
+                option_name, v->name, lines, v->best, v->median, lines / v->best, speedup);
+        }
+    }
+    if(json != NULL) {
+        fclose(json);
+    }
+    return EXIT_SUCCESS;
+}
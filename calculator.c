@@ -2,12 +2,34 @@
 // 2022
 // no copyright
 
-#include <ctype.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <linux/io_uring.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <termios.h>
 #include <unistd.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
 
 /**
  * All functions return an integer indicating an error status
@@ -17,624 +39,7519 @@
 
 #define SUCCESS 0
 #define FAILURE 1
-#define MAX_LINE_SIZE 1024
+/* initial size of the line buffer, it grows for longer lines */
+#define LINE_BUFFER_SIZE 1024
+/* default for --memory-budget */
+#define DEFAULT_MEMORY_BUDGET ((size_t)256 << 20)
+
+/**
+ * bytes any single line buffer or explicit stack may grow to. Nesting depth
+ * and line length are limited only by it.
+*/
+size_t memory_budget = DEFAULT_MEMORY_BUDGET;
 
 /* default to stdin */
 int source_file_fd = STDIN_FILENO;
 /* buffer for last line read */
-char source_file_line[MAX_LINE_SIZE];
+char *source_file_line = NULL;
+int source_file_line_capacity = 0;
 /* length in bytes of last line read */
-int source_file_line_occupied_size = MAX_LINE_SIZE;
-int source_file_line_position = MAX_LINE_SIZE;
+int source_file_line_occupied_size = 0;
+int source_file_line_position = 0;
 /* eof flag */
 int source_file_eof_read = 0;
 /* line number of last line read */
 int source_file_line_number = 0;
+/* the last line read was longer than the memory budget and dropped */
+int source_file_line_dropped = 0;
+
+/* where the current thread writes results and error reports */
+_Thread_local FILE *result_stream;
+_Thread_local FILE *diagnostic_stream;
 
 /**
- * open file at file_path for reading.
- * if file_path is NULL use stdin instead.
+ * Error reporting.
+ *
+ * Every error goes through report_error. Normally it prints the coloured
+ * message to diagnostic_stream. With --diagnostics=FILE (batch mode) it only
+ * records the line, the column and the kind of the error; the records are
+ * written to FILE as line:column:kind, prefixed with the path of the file
+ * when there are several, and counted per kind, so input with
+ * many malformed lines is not slowed down to terminal speed.
 */
-int open_source_file(const char *file_path) {
-    if(!file_path) {
-        if(source_file_fd != STDIN_FILENO) {
-            close(source_file_fd);
-        }
-        source_file_fd = STDIN_FILENO;
-    } else {
-        source_file_fd = open(file_path, O_RDONLY);
-        int file_not_opened = source_file_fd == -1;
-        if(file_not_opened) {
-            perror("open");
-            return FAILURE;
-        }
-    }
-    return SUCCESS;
-}
+enum error_kind {
+    error_unexpected_character,
+    error_syntax,
+    error_division_by_zero,
+    error_stack_underflow,
+    error_memory_budget,
+    error_overflow,
+    error_kinds
+};
+
+static const char *error_kind_name[] = {
+    "unexpected-character", "syntax", "division-by-zero",
+    "stack-underflow", "memory-budget", "overflow"
+};
+
+/* an error recorded in batch mode, column is 0 if it is not at a character */
+typedef struct diagnostic {
+    long long line;
+    int column;
+    enum error_kind kind;
+} diagnostic_t;
+
+typedef struct diagnostic_log {
+    diagnostic_t *records;
+    int size;
+    int capacity;
+} diagnostic_log_t;
+
+/* batch mode when set */
+FILE *diagnostics_file = NULL;
+#define DIAGNOSTICS_BUFFER_SIZE (1 << 16)
+/* errors written to diagnostics_file per kind */
+long long diagnostics_count[error_kinds];
+/* records of the main thread */
+diagnostic_log_t main_diagnostic_log;
+/* file the records are about when there are several, NULL otherwise */
+const char *diagnostics_source = NULL;
+
+/* where the current thread records errors and the line they are on */
+_Thread_local diagnostic_log_t *diagnostic_log;
+_Thread_local long long diagnostic_line;
+/* set while errors are dropped, by the speculative parallel front end */
+_Thread_local int diagnostics_muted;
+/* kind of the last error reported on this thread, muted or not */
+_Thread_local enum error_kind diagnostic_last_kind;
 
 /**
- * get a line from the opened source file.
+ * report an error of kind at column of the current line, format is the
+ * message printed outside batch mode.
 */
-int read_line() {
-    static char c_buffer;
-    static int show_prompt = 0;
-    static int first_run = 1;
-    int line_is_all_whitespaces = 1;
-    if(first_run) {
-        first_run = 0;
-        /**
-         * if opened source file is a terminal then show a prompt
-        */
-        if(isatty(source_file_fd)) {
-            show_prompt = 1;
-        }
+void report_error(enum error_kind kind, int column, const char *format, ...) {
+    diagnostic_last_kind = kind;
+    if(diagnostics_muted) {
+        return;
     }
-    source_file_line_occupied_size = 0;
-    if(show_prompt) {
-        printf("> ");
-        fflush(stdout);
+    if(diagnostics_file == NULL) {
+        va_list arguments;
+        va_start(arguments, format);
+        vfprintf(diagnostic_stream, format, arguments);
+        va_end(arguments);
+        return;
     }
-    while(source_file_line_occupied_size < MAX_LINE_SIZE) {
-        int c = read(source_file_fd, &c_buffer, 1);
-        if(c == -1) {
-            //error
-            perror("read");
-            return FAILURE;
-        }
-        source_file_line[source_file_line_occupied_size++] = c_buffer;
-        if(c == 0) {
-            //eof
-            source_file_line[0] = -1;
-            source_file_eof_read = 1;
-            return SUCCESS;
-        } else if(c_buffer == '\n') {
-            source_file_line_number++;
-            if(source_file_line_occupied_size == 1 || line_is_all_whitespaces) {
-                //ignore blank and empty lines
-                source_file_line_occupied_size = 0;
-                /* reshow prompt */
-                if(show_prompt) {
-                    printf("> ");
-                    fflush(stdout);
-                }
-                continue;
-            }
-            return SUCCESS;
-        }
-        if(line_is_all_whitespaces == 1 && !isspace(c_buffer)) {
-            line_is_all_whitespaces = 0;
+    diagnostic_log_t *log = diagnostic_log;
+    if(log->size == log->capacity) {
+        int capacity = log->capacity ? log->capacity*2 : 64;
+        diagnostic_t *records = realloc(log->records, capacity * sizeof(diagnostic_t));
+        if(records == NULL) {
+            /* the error still makes the exit status non-zero */
+            return;
         }
+        log->records = records;
+        log->capacity = capacity;
     }
-    //line too long
-    return FAILURE;
+    log->records[log->size++] = (diagnostic_t){diagnostic_line, column, kind};
 }
 
-typedef enum token_type {
-    token_number,
-    token_plus,
-    token_minus,
-    token_times,
-    token_divide,
-    token_bracket_open,
-    token_bracket_close,
-    token_end_of_expression,
-    token_end_of_file
-} token_type_e;
+void report_memory_budget_exceeded() {
+    report_error(error_memory_budget, 0, "\033[1;31mMemoryError: Expression exceeds the memory budget.\033[0m\n");
+}
 
-/* token structure, singly-linked list node*/
-typedef struct token {
-    /* token's type */
-    enum token_type type;
-    /* token's lexeme */
-    char *lexeme;
-    /* chain linker */
-    struct token *next;
-} token_t;
+/**
+ * write the records of log to the diagnostics file, their line numbers
+ * counted from line_base, and empty it. Only the main thread writes.
+*/
+void diagnostics_flush(diagnostic_log_t *log, long long line_base) {
+    for(int i = 0; i < log->size; i++) {
+        diagnostic_t *d = &log->records[i];
+        if(diagnostics_source != NULL) {
+            fprintf(diagnostics_file, "%s:", diagnostics_source);
+        }
+        fprintf(diagnostics_file, "%lld:%d:%s\n", line_base + d->line, d->column, error_kind_name[d->kind]);
+        diagnostics_count[d->kind]++;
+    }
+    log->size = 0;
+}
 
-/* list structure */
-typedef struct token_list {
-    token_t *head;
-    token_t *tail;
-} token_list_t;
+void diagnostics_report() {
+    fprintf(stderr, "--- diagnostics ---\n");
+    for(int kind = 0; kind < error_kinds; kind++) {
+        fprintf(stderr, "%-20s %lld\n", error_kind_name[kind], diagnostics_count[kind]);
+    }
+}
 
-/* allocate memory space for new list*/
-#define token_list_new() \
-    calloc(1, sizeof(token_list_t))
+/**
+ * Compressed input.
+ *
+ * A source compressed with gzip or zstd is recognised by its magic bytes
+ * and decompressed by a thread of its own into a pipe that is read in its
+ * place, so decompression overlaps with evaluation. The magic bytes are
+ * read with pread, input that can't seek (a pipe, a terminal) is never
+ * taken for compressed. gzip needs zlib and zstd needs libzstd to be found
+ * when the calculator is configured.
+*/
+#define DECOMPRESS_BLOCK_SIZE (1 << 16)
+#define DECOMPRESS_PIPE_SIZE (1 << 20)
 
-/* add member to end of list */
-#define token_list_append(list, member) \
-do {\
-    if(list->head == NULL) {\
-        list->head = list->tail = member;\
-    } else {\
-        list->tail->next = member;\
-        list->tail = member;\
-    }\
-} while(0);
+enum compression {
+    compression_none,
+    compression_gzip,
+    compression_zstd
+};
 
-/* de-allocate memory used by list and its members */
-#define token_list_free(list) \
-do {\
-    token_t *t = list->head;\
-    while(t != NULL) {\
-        list->head = t->next;\
-        free(t);\
-        t = list->head;\
-    }\
-    free(list);\
-} while(0);
+typedef struct decompressor {
+    const char *path;
+    enum compression compression;
+    int input_fd;
+    int output_fd;
+} decompressor_t;
 
-#define token_new() \
-    calloc(1, sizeof(token_t))
+/* a decompressor stopped at an error, its source was cut short */
+int decompression_failed;
 
 /**
- * extract tokens from a line read from the source file and 
- * add them to list.
+ * write size bytes of data to the pipe fd.
+ * returns FAILURE if the reader closed it.
 */
-int tokenize_source_line_and_add_to_list(token_list_t *list) {
-    char *current_character;
-    int current_token_type;
-    token_t *current_token;
-    int lexeme_length = 1;
-    for(int i = 0; i < source_file_line_occupied_size; i++) {
-        current_character = &source_file_line[i];
-        if(isspace(*current_character)) {
-            /* skip whitespaces but not newline */
-            if(*current_character != '\n') {
+int decompressor_write(int fd, const char *data, size_t size) {
+    while(size > 0) {
+        ssize_t n = write(fd, data, size);
+        if(n == -1) {
+            if(errno == EINTR) {
                 continue;
             }
+            return FAILURE;
         }
-        switch(*current_character) {
-            case EOF : {
-                current_token_type = token_end_of_file;
-                break;
-            }
-            case '+': {
-                current_token_type = token_plus;
-                break;
-            }
-            case '-': {
-                current_token_type = token_minus;
-                break;
-            }
-            case '*': {
-                current_token_type = token_times;
-                break;
-            }
-            case '/': {
-                current_token_type = token_divide;
-                break;
-            }
-            case '(': {
-                current_token_type = token_bracket_open;
+        data += n;
+        size -= n;
+    }
+    return SUCCESS;
+}
+
+#ifdef HAVE_ZLIB
+/**
+ * decompress gzip, every member of it, from the input to the output of d.
+ * returns what went wrong or NULL.
+*/
+const char *decompress_gzip(decompressor_t *d, char *input, char *output) {
+    z_stream z = {0};
+    const char *error = NULL;
+    int status = Z_OK;
+    int output_full = 0;
+    if(inflateInit2(&z, 15 + 16) != Z_OK) {
+        return "out of memory";
+    }
+    for(;;) {
+        /* a full output buffer may leave output to flush without input */
+        if(z.avail_in == 0 && !output_full) {
+            ssize_t n = read(d->input_fd, input, DECOMPRESS_BLOCK_SIZE);
+            if(n == -1) {
+                error = strerror(errno);
                 break;
             }
-            case ')': {
-                current_token_type = token_bracket_close;
+            if(n == 0) {
+                if(status != Z_STREAM_END) {
+                    error = "truncated gzip data";
+                }
                 break;
             }
-            case '\n': {
-                current_token_type = token_end_of_expression;
+            z.next_in = (Bytef *)input;
+            z.avail_in = n;
+        }
+        if(status == Z_STREAM_END) {
+            /* another member follows */
+            inflateReset(&z);
+        }
+        z.next_out = (Bytef *)output;
+        z.avail_out = DECOMPRESS_BLOCK_SIZE;
+        status = inflate(&z, Z_NO_FLUSH);
+        if(status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) {
+            error = z.msg ? z.msg : "corrupt gzip data";
+            break;
+        }
+        output_full = status != Z_STREAM_END && z.avail_out == 0;
+        if(decompressor_write(d->output_fd, output, DECOMPRESS_BLOCK_SIZE-z.avail_out) != SUCCESS) {
+            break;
+        }
+    }
+    inflateEnd(&z);
+    return error;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+/**
+ * decompress zstd, every frame of it, from the input to the output of d.
+ * returns what went wrong or NULL.
+*/
+const char *decompress_zstd(decompressor_t *d, char *input, char *output) {
+    ZSTD_DStream *stream = ZSTD_createDStream();
+    ZSTD_inBuffer in = {input, 0, 0};
+    const char *error = NULL;
+    /* nonzero while a frame is not completely decoded */
+    size_t frame_left = 0;
+    int output_full = 0;
+    if(stream == NULL) {
+        return "out of memory";
+    }
+    for(;;) {
+        if(in.pos == in.size && !output_full) {
+            ssize_t n = read(d->input_fd, input, DECOMPRESS_BLOCK_SIZE);
+            if(n == -1) {
+                error = strerror(errno);
                 break;
             }
-            default  : {
-                if(!isdigit(*current_character)) {
-                    /* report error */
-                    fprintf(stderr, "Unexpected character.\n");
-                    int snippet_start;
-                    int snippet_end;
-                    if(i > 5) {
-                        snippet_start = i-5;
-                    } else {
-                        snippet_start = 0;
-                    }
-                    if((i+5) < source_file_line_occupied_size-1) {
-                        snippet_end = i+5;
-                    } else {
-                        snippet_end = source_file_line_occupied_size-1;
-                    }
-                    fputc('\t', stderr);
-                    for(int j = snippet_start; j < i; j++) {
-                        fputc(source_file_line[j], stderr);
-                    }
-                    fprintf(stderr, "\033[1;31m%c\033[0m", *current_character);
-                    for(int j = i+1; j < snippet_end; j++) {
-                        fputc(source_file_line[j], stderr);
-                    }
-                    fputc('\n', stderr);
-                    fputc('\t', stderr);
-                    for(int j = snippet_start; j <= snippet_end; j++) {
-                        if(j != i) {
-                            fputc('~', stderr);
-                        } else {
-                            fputc('^', stderr);
-                        }
-                    }
-                    fputc('\n', stderr);
-                    fflush(stderr);
-                    return FAILURE;
+            if(n == 0) {
+                if(frame_left != 0) {
+                    error = "truncated zstd data";
                 }
-                while(isdigit(source_file_line[++i])) {
-                    lexeme_length++;
-                }
-                i--;
-                current_token_type = token_number;
+                break;
             }
-        } //switch
-        current_token = token_new();
-        /* lexemes are neccessary only for numbers */
-        if(current_token_type == token_number) {
-            current_token->lexeme = strndup(current_character, lexeme_length);
+            in.size = n;
+            in.pos = 0;
+        }
+        ZSTD_outBuffer out = {output, DECOMPRESS_BLOCK_SIZE, 0};
+        size_t consumed = in.pos;
+        size_t hint = ZSTD_decompressStream(stream, &out, &in);
+        if(ZSTD_isError(hint)) {
+            error = ZSTD_getErrorName(hint);
+            break;
+        }
+        /* a call that did nothing says nothing about the frame */
+        if(in.pos != consumed || out.pos > 0) {
+            frame_left = hint;
+        }
+        output_full = out.pos == out.size;
+        if(decompressor_write(d->output_fd, output, out.pos) != SUCCESS) {
+            break;
+        }
+    }
+    ZSTD_freeDStream(stream);
+    return error;
+}
+#endif
+
+void *decompressor_main(void *argument) {
+    decompressor_t *d = argument;
+    const char *error = "out of memory";
+    sigset_t signals;
+    /* a reader that stops early makes write fail with EPIPE instead */
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    char *buffers = malloc(2*DECOMPRESS_BLOCK_SIZE);
+    if(buffers != NULL) {
+        switch(d->compression) {
+#ifdef HAVE_ZLIB
+        case compression_gzip:
+            error = decompress_gzip(d, buffers, buffers+DECOMPRESS_BLOCK_SIZE);
+            break;
+#endif
+#ifdef HAVE_ZSTD
+        case compression_zstd:
+            error = decompress_zstd(d, buffers, buffers+DECOMPRESS_BLOCK_SIZE);
+            break;
+#endif
+        default:
+            break;
+        }
+    }
+    if(error != NULL) {
+        fprintf(stderr, "%s: %s\n", d->path, error);
+        __atomic_store_n(&decompression_failed, 1, __ATOMIC_RELAXED);
+    }
+    free(buffers);
+    close(d->input_fd);
+    close(d->output_fd);
+    free(d);
+    return NULL;
+}
+
+/**
+ * copy up to size bytes from the start of fd into buffer, leaving them to be
+ * read. a pipe has no offset to pread at, so tee duplicates the front of it
+ * into a pipe of our own to read from instead. returns the bytes copied, or
+ * -1 when fd can be neither.
+*/
+ssize_t source_peek(int fd, void *buffer, size_t size) {
+    ssize_t n = pread(fd, buffer, size, 0);
+    if(n != -1 || errno != ESPIPE) {
+        return n;
+    }
+    int pipe_fds[2];
+    if(pipe(pipe_fds) == -1) {
+        return -1;
+    }
+    n = tee(fd, pipe_fds[1], size, 0);
+    if(n > 0) {
+        n = read(pipe_fds[0], buffer, n);
+    }
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+    return n;
+}
+
+/**
+ * the fd to read the source at path, opened as fd, from.
+ * that is fd itself unless the source is compressed, then fd is handed to
+ * a decompressor and the read end of its pipe is returned.
+ * returns -1 with errno set, and fd closed, if it can't be decompressed.
+*/
+int source_decompress(int fd, const char *path) {
+    static const unsigned char gzip_magic[] = {0x1f, 0x8b}, zstd_magic[] = {0x28, 0xb5, 0x2f, 0xfd};
+    unsigned char magic[4];
+    enum compression compression = compression_none;
+    ssize_t n = source_peek(fd, magic, sizeof(magic));
+    if(n >= (ssize_t)sizeof(gzip_magic) && !memcmp(magic, gzip_magic, sizeof(gzip_magic))) {
+        compression = compression_gzip;
+    } else if(n >= (ssize_t)sizeof(zstd_magic) && !memcmp(magic, zstd_magic, sizeof(zstd_magic))) {
+        compression = compression_zstd;
+    }
+    if(compression == compression_none) {
+        return fd;
+    }
+#ifndef HAVE_ZLIB
+    if(compression == compression_gzip) {
+        close(fd);
+        errno = ENOTSUP;
+        return -1;
+    }
+#endif
+#ifndef HAVE_ZSTD
+    if(compression == compression_zstd) {
+        close(fd);
+        errno = ENOTSUP;
+        return -1;
+    }
+#endif
+    int pipe_fds[2];
+    decompressor_t *d = malloc(sizeof(decompressor_t));
+    if(d == NULL || pipe(pipe_fds) == -1) {
+        int error = d == NULL ? ENOMEM : errno;
+        free(d);
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    /* fewer, larger handoffs between the two threads */
+    fcntl(pipe_fds[1], F_SETPIPE_SZ, DECOMPRESS_PIPE_SIZE);
+    *d = (decompressor_t){path, compression, fd, pipe_fds[1]};
+    pthread_t thread;
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+    int error = pthread_create(&thread, &attributes, decompressor_main, d);
+    pthread_attr_destroy(&attributes);
+    if(error != 0) {
+        free(d);
+        close(fd);
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        errno = error;
+        return -1;
+    }
+    return pipe_fds[0];
+}
+
+/**
+ * open the source at path, "-" for stdin, to be read decompressed.
+ * returns -1 with errno set if it can't be read, a directory included.
+*/
+int source_open(const char *path) {
+    int fd = strcmp(path, "-") ? open(path, O_RDONLY) : STDIN_FILENO;
+    struct stat st;
+    if(fd != -1 && fstat(fd, &st) == 0 && S_ISDIR(st.st_mode)) {
+        close(fd);
+        errno = EISDIR;
+        return -1;
+    }
+    return fd == -1 ? -1 : source_decompress(fd, path);
+}
+
+/**
+ * open file at file_path for reading.
+ * if file_path is NULL or "-" use stdin instead.
+ * compressed files are read decompressed.
+*/
+int open_source_file(const char *file_path) {
+    if(!file_path || !strcmp(file_path, "-")) {
+        if(source_file_fd != STDIN_FILENO) {
+            close(source_file_fd);
+        }
+        source_file_fd = source_decompress(STDIN_FILENO, "-");
+        if(source_file_fd == -1) {
+            perror("stdin");
+            return FAILURE;
+        }
+    } else {
+        source_file_fd = source_open(file_path);
+        if(source_file_fd == -1) {
+            perror(file_path);
+            return FAILURE;
         }
-        current_token->type = current_token_type;
-        token_list_append(list, current_token);
     }
     return SUCCESS;
 }
 
-enum ast_type {
-    ast_add,
-    ast_sub,
-    ast_div,
-    ast_mul,
-    ast_num
+/**
+ * SIMD kernels.
+ *
+ * The byte scanning loops of the input system and the tokenizer have a
+ * scalar version and, on x86, SSE2, AVX2 and AVX-512 versions. The best
+ * level the CPU supports is selected once at startup and the kernels are
+ * called through function pointers. --cpu=LEVEL forces a level.
+*/
+enum cpu_level {
+    cpu_scalar,
+    cpu_sse2,
+    cpu_avx2,
+    cpu_avx512,
+    cpu_levels
 };
 
-/* structure of an ast node */
-typedef struct ast {
-    enum ast_type type;
-    union {
-        /* used by internal node (operators)*/
-        struct ast *children[2];
-        /* used leaf nodes (operands)*/
-        int value;
-    };
-} ast_t;
+static const char *cpu_level_name[] = {"scalar", "sse2", "avx2", "avx512"};
 
-/* allocate memory space for a new ast node */
-#define ast_new() \
-    (calloc(1, sizeof(ast_t)))
-/* convert string to integer */
-#define str_to_int(str) \
-    strtol(str, 0, 10)
+/* exit status when the forced level can not run here */
+#define EXIT_UNSUPPORTED 77
+
+/* find the first newline in [begin, end), NULL if there is none */
+const char *find_newline_scalar(const char *begin, const char *end) {
+    return memchr(begin, '\n', end-begin);
+}
+
+/* number of decimal digits at the start of [begin, end) */
+int count_digits_scalar(const char *begin, const char *end) {
+    const char *p = begin;
+    while(p < end && *p >= '0' && *p <= '9') {
+        p++;
+    }
+    return p-begin;
+}
+
+/**
+ * a bracket or operator, the characters of the structural index, as a bit
+ * per byte from STRUCTURAL_FIRST. The vector kernels find them as '(' to
+ * '/' without ',' and '.'; the lexer tables check both against tokens.def.
+*/
+#define STRUCTURAL_FIRST '('
+#define STRUCTURAL_MASK 0xAF
+#define is_structural(c) \
+    ((unsigned)((c) - STRUCTURAL_FIRST) < 8 && (STRUCTURAL_MASK >> ((c) - STRUCTURAL_FIRST) & 1))
+
+/**
+ * offsets from begin of the brackets and operators in [begin, end).
+ * returns how many were found or -1 if there is a character the tokenizer
+ * rejects. offsets must have room for end-begin entries.
+*/
+int index_structure_scalar(const char *begin, const char *end, int *offsets) {
+    int n = 0;
+    for(const char *p = begin; p < end; p++) {
+        char c = *p;
+        if(is_structural(c)) {
+            offsets[n++] = p-begin;
+        } else if(!(c >= '0' && c <= '9') && c != ' ' && !(c >= '\t' && c <= '\r')) {
+            return -1;
+        }
+    }
+    return n;
+}
+
+/**
+ * index the tail of a block with the scalar kernel, offsets[0..n) are taken.
+*/
+int index_structure_tail(const char *begin, const char *p, const char *end, int *offsets, int n) {
+    int tail = index_structure_scalar(p, end, &offsets[n]);
+    if(tail == -1) {
+        return -1;
+    }
+    for(int i = n; i < n+tail; i++) {
+        offsets[i] += p-begin;
+    }
+    return n+tail;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define CALCULATOR_X86_KERNELS
+#include <immintrin.h>
+
+__attribute__((target("sse2")))
+const char *find_newline_sse2(const char *begin, const char *end) {
+    const __m128i newline = _mm_set1_epi8('\n');
+    const char *p = begin;
+    for(; end-p >= 16; p += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)p);
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+        if(mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return find_newline_scalar(p, end);
+}
+
+__attribute__((target("sse2")))
+int count_digits_sse2(const char *begin, const char *end) {
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i nine = _mm_set1_epi8(9);
+    const char *p = begin;
+    for(; end-p >= 16; p += 16) {
+        /* a byte is a digit when byte-'0' <= 9 unsigned */
+        __m128i value = _mm_sub_epi8(_mm_loadu_si128((const __m128i *)p), zero);
+        __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(value, nine), value);
+        unsigned mask = ~_mm_movemask_epi8(is_digit) & 0xFFFF;
+        if(mask) {
+            return p - begin + __builtin_ctz(mask);
+        }
+    }
+    return p - begin + count_digits_scalar(p, end);
+}
+
+__attribute__((target("avx2")))
+const char *find_newline_avx2(const char *begin, const char *end) {
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const char *p = begin;
+    for(; end-p >= 32; p += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i *)p);
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline));
+        if(mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return find_newline_sse2(p, end);
+}
+
+__attribute__((target("avx2")))
+int count_digits_avx2(const char *begin, const char *end) {
+    const __m256i zero = _mm256_set1_epi8('0');
+    const __m256i nine = _mm256_set1_epi8(9);
+    const char *p = begin;
+    for(; end-p >= 32; p += 32) {
+        __m256i value = _mm256_sub_epi8(_mm256_loadu_si256((const __m256i *)p), zero);
+        __m256i is_digit = _mm256_cmpeq_epi8(_mm256_min_epu8(value, nine), value);
+        unsigned mask = ~(unsigned)_mm256_movemask_epi8(is_digit);
+        if(mask) {
+            return p - begin + __builtin_ctz(mask);
+        }
+    }
+    return p - begin + count_digits_sse2(p, end);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+const char *find_newline_avx512(const char *begin, const char *end) {
+    const __m512i newline = _mm512_set1_epi8('\n');
+    const char *p = begin;
+    for(; end-p >= 64; p += 64) {
+        __mmask64 mask = _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(p), newline);
+        if(mask) {
+            return p + __builtin_ctzll(mask);
+        }
+    }
+    return find_newline_avx2(p, end);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+int count_digits_avx512(const char *begin, const char *end) {
+    const __m512i zero = _mm512_set1_epi8('0');
+    const __m512i nine = _mm512_set1_epi8(9);
+    const char *p = begin;
+    for(; end-p >= 64; p += 64) {
+        __m512i value = _mm512_sub_epi8(_mm512_loadu_si512(p), zero);
+        __mmask64 mask = ~_mm512_cmple_epu8_mask(value, nine);
+        if(mask) {
+            return p - begin + __builtin_ctzll(mask);
+        }
+    }
+    return p - begin + count_digits_avx2(p, end);
+}
+
+__attribute__((target("sse2")))
+int index_structure_sse2(const char *begin, const char *end, int *offsets) {
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i four = _mm_set1_epi8(4);
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i bracket = _mm_set1_epi8('(');
+    const __m128i seven = _mm_set1_epi8(7);
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i dot = _mm_set1_epi8('.');
+    const char *p = begin;
+    int n = 0;
+    for(; end-p >= 16; p += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)p);
+        __m128i digit = _mm_sub_epi8(block, zero);
+        __m128i control = _mm_sub_epi8(block, tab);
+        /* '(' to '/' is the six structural characters plus ',' and '.' */
+        __m128i symbol = _mm_sub_epi8(block, bracket);
+        __m128i is_symbol = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi8(block, comma), _mm_cmpeq_epi8(block, dot)),
+            _mm_cmpeq_epi8(_mm_min_epu8(symbol, seven), symbol));
+        __m128i is_other = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(digit, nine), digit),
+            _mm_cmpeq_epi8(_mm_min_epu8(control, four), control)), _mm_cmpeq_epi8(block, space));
+        unsigned structural = _mm_movemask_epi8(is_symbol);
+        if((structural | _mm_movemask_epi8(is_other)) != 0xFFFF) {
+            return -1;
+        }
+        for(; structural; structural &= structural-1) {
+            offsets[n++] = p - begin + __builtin_ctz(structural);
+        }
+    }
+    return index_structure_tail(begin, p, end, offsets, n);
+}
+
+__attribute__((target("avx2")))
+int index_structure_avx2(const char *begin, const char *end, int *offsets) {
+    const __m256i zero = _mm256_set1_epi8('0');
+    const __m256i nine = _mm256_set1_epi8(9);
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i four = _mm256_set1_epi8(4);
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i bracket = _mm256_set1_epi8('(');
+    const __m256i seven = _mm256_set1_epi8(7);
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i dot = _mm256_set1_epi8('.');
+    const char *p = begin;
+    int n = 0;
+    for(; end-p >= 32; p += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i *)p);
+        __m256i digit = _mm256_sub_epi8(block, zero);
+        __m256i control = _mm256_sub_epi8(block, tab);
+        __m256i symbol = _mm256_sub_epi8(block, bracket);
+        __m256i is_symbol = _mm256_andnot_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, comma), _mm256_cmpeq_epi8(block, dot)),
+            _mm256_cmpeq_epi8(_mm256_min_epu8(symbol, seven), symbol));
+        __m256i is_other = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(digit, nine), digit),
+            _mm256_cmpeq_epi8(_mm256_min_epu8(control, four), control)), _mm256_cmpeq_epi8(block, space));
+        unsigned structural = _mm256_movemask_epi8(is_symbol);
+        if((structural | (unsigned)_mm256_movemask_epi8(is_other)) != 0xFFFFFFFFu) {
+            return -1;
+        }
+        for(; structural; structural &= structural-1) {
+            offsets[n++] = p - begin + __builtin_ctz(structural);
+        }
+    }
+    return index_structure_tail(begin, p, end, offsets, n);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+int index_structure_avx512(const char *begin, const char *end, int *offsets) {
+    const __m512i zero = _mm512_set1_epi8('0');
+    const __m512i nine = _mm512_set1_epi8(9);
+    const __m512i tab = _mm512_set1_epi8('\t');
+    const __m512i four = _mm512_set1_epi8(4);
+    const __m512i space = _mm512_set1_epi8(' ');
+    const __m512i bracket = _mm512_set1_epi8('(');
+    const __m512i seven = _mm512_set1_epi8(7);
+    const __m512i comma = _mm512_set1_epi8(',');
+    const __m512i dot = _mm512_set1_epi8('.');
+    const char *p = begin;
+    int n = 0;
+    for(; end-p >= 64; p += 64) {
+        __m512i block = _mm512_loadu_si512(p);
+        __mmask64 structural = _mm512_cmple_epu8_mask(_mm512_sub_epi8(block, bracket), seven) &
+            ~(_mm512_cmpeq_epi8_mask(block, comma) | _mm512_cmpeq_epi8_mask(block, dot));
+        __mmask64 other = _mm512_cmple_epu8_mask(_mm512_sub_epi8(block, zero), nine) |
+            _mm512_cmple_epu8_mask(_mm512_sub_epi8(block, tab), four) | _mm512_cmpeq_epi8_mask(block, space);
+        if(~(structural | other)) {
+            return -1;
+        }
+        for(; structural; structural &= structural-1) {
+            offsets[n++] = p - begin + __builtin_ctzll(structural);
+        }
+    }
+    return index_structure_tail(begin, p, end, offsets, n);
+}
+#endif
+
+/* the selected kernels */
+const char *(*kernel_find_newline)(const char *begin, const char *end) = find_newline_scalar;
+int (*kernel_count_digits)(const char *begin, const char *end) = count_digits_scalar;
+int (*kernel_index_structure)(const char *begin, const char *end, int *offsets) = index_structure_scalar;
+enum cpu_level kernel_level = cpu_scalar;
+
+/**
+ * whether kernels of level are compiled in and the CPU can run them.
+*/
+int cpu_level_supported(enum cpu_level level) {
+#ifdef CALCULATOR_X86_KERNELS
+    __builtin_cpu_init();
+    switch(level) {
+        case cpu_scalar: return 1;
+        case cpu_sse2: return __builtin_cpu_supports("sse2");
+        case cpu_avx2: return __builtin_cpu_supports("avx2");
+        case cpu_avx512: return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+        default: return 0;
+    }
+#else
+    return level == cpu_scalar;
+#endif
+}
+
+/**
+ * point the kernels at the versions of level, -1 picks the best supported.
+*/
+int cpu_select_kernels(int level) {
+    if(level == -1) {
+        level = cpu_levels-1;
+        while(!cpu_level_supported(level)) {
+            level--;
+        }
+    } else if(!cpu_level_supported(level)) {
+        return FAILURE;
+    }
+    kernel_level = level;
+    switch(level) {
+#ifdef CALCULATOR_X86_KERNELS
+        case cpu_sse2: {
+            kernel_find_newline = find_newline_sse2;
+            kernel_count_digits = count_digits_sse2;
+            kernel_index_structure = index_structure_sse2;
+            break;
+        }
+        case cpu_avx2: {
+            kernel_find_newline = find_newline_avx2;
+            kernel_count_digits = count_digits_avx2;
+            kernel_index_structure = index_structure_avx2;
+            break;
+        }
+        case cpu_avx512: {
+            kernel_find_newline = find_newline_avx512;
+            kernel_count_digits = count_digits_avx512;
+            kernel_index_structure = index_structure_avx512;
+            break;
+        }
+#endif
+        default: {
+            kernel_find_newline = find_newline_scalar;
+            kernel_count_digits = count_digits_scalar;
+            kernel_index_structure = index_structure_scalar;
+        }
+    }
+    return SUCCESS;
+}
+
+/**
+ * Lexer tables.
+ *
+ * The token types, the class of every byte and the lexer's transition
+ * table are generated from the token specification in tokens.def. Bytes
+ * are classified by table lookup alone so the result does not depend on
+ * the C locale.
+*/
+typedef enum token_type {
+    token_number,
+#define TOKEN_CHARACTER(character, type, lexeme) type,
+#include "tokens.def"
+} token_type_e;
+
+/* character classes, every single character token has its own */
+enum character_class {
+    class_invalid,
+    class_space,
+    class_digit,
+    class_point,
+#define TOKEN_CHARACTER(character, type, lexeme) class_##type,
+#include "tokens.def"
+    character_classes
+};
+
+/* class of every byte, unlisted bytes are invalid */
+static const unsigned char lexer_class[256] = {
+#define TOKEN_CHARACTER(character, type, lexeme) [(unsigned char)(character)] = class_##type,
+#define CHARACTER_RANGE(first, last, class) [(unsigned char)(first) ... (unsigned char)(last)] = class,
+#include "tokens.def"
+};
+
+/*
+ * the index kernels are written for the characters above: every single
+ * character token but the newline and EOF, which lines are split at, must
+ * be one they find and the bytes they skip the digits and whitespace.
+*/
+enum {
+    tokens_structural_mask = 0
+#define TOKEN_CHARACTER(character, type, lexeme) \
+    | ((unsigned)((character) - STRUCTURAL_FIRST) < 8 ? 1 << (((character) - STRUCTURAL_FIRST) & 7) : 0)
+#include "tokens.def"
+    ,
+    tokens_not_structural = 0
+#define TOKEN_CHARACTER(character, type, lexeme) \
+    + ((character) != '\n' && (character) != EOF && (unsigned)((character) - STRUCTURAL_FIRST) >= 8)
+#include "tokens.def"
+    ,
+    ranges_not_skipped = 0
+#define CHARACTER_RANGE(first, last, class) \
+    + ((class) == class_digit ? (first) != '0' || (last) != '9' : \
+        (class) == class_space && !(((first) >= '\t' && (last) <= '\r') || ((first) == ' ' && (last) == ' ')))
+#include "tokens.def"
+};
+_Static_assert(tokens_structural_mask == STRUCTURAL_MASK && tokens_not_structural == 0,
+    "the index kernels do not find the tokens of tokens.def");
+_Static_assert(ranges_not_skipped == 0, "the index kernels reject digits or whitespace of tokens.def");
+
+/* token type of the single character token classes */
+static const unsigned char lexer_token_type[character_classes] = {
+#define TOKEN_CHARACTER(character, type, lexeme) [class_##type] = type,
+#include "tokens.def"
+};
+
+/* lexeme error messages print for a token type, numbers keep their own */
+static const char *const token_type_lexeme[] = {
+#define TOKEN_CHARACTER(character, type, lexeme) [type] = lexeme,
+#include "tokens.def"
+};
+
+enum lexer_state {
+    lexer_start,
+    lexer_number,
+    /* digits after the decimal point, only with --decimal */
+    lexer_fraction,
+    lexer_states
+};
+
+/**
+ * a transition is the next state and what to do before entering it:
+ * emit the number that just ended, emit the character's token or reject
+ * the character.
+*/
+#define LEXER_STATE_MASK 0x0f
+#define LEXER_EMIT_NUMBER 0x10
+#define LEXER_EMIT_TOKEN 0x20
+#define LEXER_REJECT 0x40
+
+static const unsigned char lexer_transition[lexer_states][character_classes] = {
+    [lexer_start] = {
+        [class_invalid] = LEXER_REJECT,
+        [class_space] = lexer_start,
+        [class_digit] = lexer_number,
+        [class_point] = LEXER_REJECT,
+#define TOKEN_CHARACTER(character, type, lexeme) [class_##type] = lexer_start | LEXER_EMIT_TOKEN,
+#include "tokens.def"
+    },
+    /* anything but a digit ends the number */
+    [lexer_number] = {
+        [class_invalid] = LEXER_REJECT,
+        [class_space] = lexer_start | LEXER_EMIT_NUMBER,
+        [class_digit] = lexer_number,
+        [class_point] = LEXER_REJECT,
+#define TOKEN_CHARACTER(character, type, lexeme) [class_##type] = lexer_start | LEXER_EMIT_NUMBER | LEXER_EMIT_TOKEN,
+#include "tokens.def"
+    }
+};
+
+/* the same with a decimal point allowed once in a number, after a digit */
+static const unsigned char lexer_transition_decimal[lexer_states][character_classes] = {
+    [lexer_start] = {
+        [class_invalid] = LEXER_REJECT,
+        [class_space] = lexer_start,
+        [class_digit] = lexer_number,
+        [class_point] = LEXER_REJECT,
+#define TOKEN_CHARACTER(character, type, lexeme) [class_##type] = lexer_start | LEXER_EMIT_TOKEN,
+#include "tokens.def"
+    },
+    [lexer_number] = {
+        [class_invalid] = LEXER_REJECT,
+        [class_space] = lexer_start | LEXER_EMIT_NUMBER,
+        [class_digit] = lexer_number,
+        [class_point] = lexer_fraction,
+#define TOKEN_CHARACTER(character, type, lexeme) [class_##type] = lexer_start | LEXER_EMIT_NUMBER | LEXER_EMIT_TOKEN,
+#include "tokens.def"
+    },
+    [lexer_fraction] = {
+        [class_invalid] = LEXER_REJECT,
+        [class_space] = lexer_start | LEXER_EMIT_NUMBER,
+        [class_digit] = lexer_fraction,
+        [class_point] = LEXER_REJECT,
+#define TOKEN_CHARACTER(character, type, lexeme) [class_##type] = lexer_start | LEXER_EMIT_NUMBER | LEXER_EMIT_TOKEN,
+#include "tokens.def"
+    }
+};
+
+/* transition table in use, selected once at startup */
+static const unsigned char (*lexer_table)[character_classes] = lexer_transition;
+
+/* whitespace including the newline */
+#define is_whitespace(c) \
+    (lexer_class[(unsigned char)(c)] == class_space || (c) == '\n')
+
+/* the source file is read in blocks of this size */
+#define SOURCE_BUFFER_SIZE (1 << 16)
+char source_buffer[SOURCE_BUFFER_SIZE];
+/* bytes in source_buffer and how many of them were consumed */
+int source_buffer_size = 0;
+int source_buffer_position = 0;
+
+int line_is_all_whitespaces(const char *line, int size) {
+    for(int i = 0; i < size; i++) {
+        if(!is_whitespace(line[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * make room for size bytes in the line buffer, within the memory budget.
+*/
+int line_buffer_reserve(size_t size) {
+    if(size <= (size_t)source_file_line_capacity) {
+        return SUCCESS;
+    }
+    size_t capacity = source_file_line_capacity ? source_file_line_capacity : LINE_BUFFER_SIZE;
+    while(capacity < size) {
+        capacity *= 2;
+    }
+    if(capacity > memory_budget) {
+        capacity = memory_budget;
+    }
+    if(size > capacity || capacity > INT_MAX) {
+        //line too long
+        return FAILURE;
+    }
+    char *line = realloc(source_file_line, capacity);
+    if(line == NULL) {
+        perror("realloc");
+        return FAILURE;
+    }
+    source_file_line = line;
+    source_file_line_capacity = capacity;
+    return SUCCESS;
+}
+
+/**
+ * get a line from the opened source file.
+*/
+int read_line() {
+    static int show_prompt = 0;
+    static int first_run = 1;
+    if(first_run) {
+        first_run = 0;
+        /**
+         * if opened source file is a terminal then show a prompt
+        */
+        if(isatty(source_file_fd)) {
+            show_prompt = 1;
+        }
+    }
+    source_file_line_occupied_size = 0;
+    source_file_line_dropped = 0;
+    if(show_prompt) {
+        printf("> ");
+        fflush(stdout);
+    }
+    for(;;) {
+        if(source_buffer_position == source_buffer_size) {
+            ssize_t n = read(source_file_fd, source_buffer, SOURCE_BUFFER_SIZE);
+            if(n == -1) {
+                //error
+                perror("read");
+                return FAILURE;
+            }
+            if(n == 0) {
+                //eof
+                source_file_eof_read = 1;
+                if(source_file_line_dropped) {
+                    source_file_line_number++;
+                    return SUCCESS;
+                }
+                if(line_buffer_reserve(source_file_line_occupied_size+1) == FAILURE) {
+                    return FAILURE;
+                }
+                if(!line_is_all_whitespaces(source_file_line, source_file_line_occupied_size)) {
+                    /* last line has no newline, terminate it */
+                    source_file_line[source_file_line_occupied_size++] = '\n';
+                    source_file_line_number++;
+                    return SUCCESS;
+                }
+                source_file_line[0] = -1;
+                source_file_line_occupied_size = 1;
+                return SUCCESS;
+            }
+            source_buffer_size = n;
+            source_buffer_position = 0;
+        }
+        const char *start = &source_buffer[source_buffer_position];
+        const char *end = &source_buffer[source_buffer_size];
+        const char *newline = kernel_find_newline(start, end);
+        int size = (newline ? newline+1 : end) - start;
+        if(!source_file_line_dropped &&
+            line_buffer_reserve((size_t)source_file_line_occupied_size + size) == FAILURE) {
+            /* line too long, the rest of it is read and thrown away */
+            source_file_line_dropped = 1;
+            source_file_line_occupied_size = 0;
+        }
+        if(!source_file_line_dropped) {
+            memcpy(&source_file_line[source_file_line_occupied_size], start, size);
+            source_file_line_occupied_size += size;
+        }
+        source_buffer_position += size;
+        if(newline) {
+            source_file_line_number++;
+            if(source_file_line_dropped) {
+                return SUCCESS;
+            }
+            if(line_is_all_whitespaces(source_file_line, source_file_line_occupied_size)) {
+                //ignore blank and empty lines
+                source_file_line_occupied_size = 0;
+                /* reshow prompt */
+                if(show_prompt) {
+                    printf("> ");
+                    fflush(stdout);
+                }
+                continue;
+            }
+            return SUCCESS;
+        }
+    }
+}
+
+/* token structure, singly-linked list node*/
+typedef struct token {
+    /* token's type */
+    enum token_type type;
+    /* token's lexeme */
+    char *lexeme;
+    /* column of its first character in the line, from 1 */
+    int column;
+    /* chain linker */
+    struct token *next;
+} token_t;
+
+/* list structure */
+typedef struct token_list {
+    token_t *head;
+    token_t *tail;
+} token_list_t;
+
+/* tokens made on this thread, for --slow-lines */
+_Thread_local long long lexer_tokens;
+
+/* bytes of the tokens and tree nodes of the line being evaluated */
+_Thread_local size_t line_memory;
+/* the count the threads of the parallel front end share instead, if set */
+_Thread_local size_t *line_memory_shared;
+
+/* heap taken by an allocation of size bytes, with malloc's header and alignment */
+#define heap_footprint(size) \
+    ((size) < 24 ? (size_t)32 : ((size_t)(size) + 8 + 15) & ~(size_t)15)
+
+/**
+ * charge size bytes to the line, FAILURE once it holds more than the
+ * memory budget.
+*/
+static inline int line_memory_charge(size_t size) {
+    size_t total = line_memory_shared != NULL ?
+        __atomic_add_fetch(line_memory_shared, size, __ATOMIC_RELAXED) : (line_memory += size);
+    return total > memory_budget ? FAILURE : SUCCESS;
+}
+
+/* allocate memory space for new list*/
+#define token_list_new() \
+    calloc(1, sizeof(token_list_t))
+
+/* add member to end of list */
+#define token_list_append(list, member) \
+do {\
+    if(list->head == NULL) {\
+        list->head = list->tail = member;\
+    } else {\
+        list->tail->next = member;\
+        list->tail = member;\
+    }\
+} while(0);
+
+/* de-allocate memory used by list and its members */
+#define token_list_free(list) \
+do {\
+    token_t *t = list->head;\
+    while(t != NULL) {\
+        list->head = t->next;\
+        free(t->lexeme);\
+        free(t);\
+        t = list->head;\
+    }\
+    free(list);\
+} while(0);
+
+#define token_new() \
+    calloc(1, sizeof(token_t))
+
+/**
+ * report the character at position i of line that no token starts with.
+ * kept out of the lexer's loop, it runs at most once per line.
+*/
+__attribute__((cold, noinline))
+void report_unexpected_character(const char *line, int line_size, int i) {
+    report_error(error_unexpected_character, i+1, "Unexpected character.\n");
+    if(diagnostics_file != NULL || diagnostics_muted) {
+        return;
+    }
+    int snippet_start;
+    int snippet_end;
+    if(i > 5) {
+        snippet_start = i-5;
+    } else {
+        snippet_start = 0;
+    }
+    if((i+5) < line_size-1) {
+        snippet_end = i+5;
+    } else {
+        snippet_end = line_size-1;
+    }
+    fputc('\t', diagnostic_stream);
+    for(int j = snippet_start; j < i; j++) {
+        fputc(line[j], diagnostic_stream);
+    }
+    fprintf(diagnostic_stream, "\033[1;31m%c\033[0m", line[i]);
+    for(int j = i+1; j < snippet_end; j++) {
+        fputc(line[j], diagnostic_stream);
+    }
+    fputc('\n', diagnostic_stream);
+    fputc('\t', diagnostic_stream);
+    for(int j = snippet_start; j <= snippet_end; j++) {
+        if(j != i) {
+            fputc('~', diagnostic_stream);
+        } else {
+            fputc('^', diagnostic_stream);
+        }
+    }
+    fputc('\n', diagnostic_stream);
+    fflush(diagnostic_stream);
+}
+
+/**
+ * extract tokens from a line read from the source file and 
+ * add them to list.
+ * line holds line_size bytes, the last one a newline or EOF.
+ * the lexer is the DFA of lexer_table, one table lookup per byte.
+ * digit runs are skipped with the count_digits kernel once they start.
+*/
+int tokenize_source_line_and_add_to_list(const char *line, int line_size, token_list_t *list) {
+    token_t *current_token;
+    int state = lexer_start;
+    /* where the number being read starts */
+    int number_start = 0;
+    for(int i = 0; i < line_size; i++) {
+        int class = lexer_class[(unsigned char)line[i]];
+        int transition = lexer_table[state][class];
+        if(transition & LEXER_EMIT_NUMBER) {
+            if(line_memory_charge(heap_footprint(sizeof(token_t)) + heap_footprint(i-number_start + 1)) == FAILURE) {
+                report_memory_budget_exceeded();
+                return FAILURE;
+            }
+            current_token = token_new();
+            current_token->type = token_number;
+            current_token->lexeme = strndup(&line[number_start], i-number_start);
+            current_token->column = number_start+1;
+            token_list_append(list, current_token);
+            lexer_tokens++;
+        }
+        if(transition & LEXER_REJECT) {
+            report_unexpected_character(line, line_size, i);
+            return FAILURE;
+        }
+        if(transition & LEXER_EMIT_TOKEN) {
+            if(line_memory_charge(heap_footprint(sizeof(token_t))) == FAILURE) {
+                report_memory_budget_exceeded();
+                return FAILURE;
+            }
+            /* lexemes are neccessary only for numbers */
+            current_token = token_new();
+            current_token->type = lexer_token_type[class];
+            current_token->column = i+1;
+            token_list_append(list, current_token);
+            lexer_tokens++;
+        } else if((transition & LEXER_STATE_MASK) != state && (transition & LEXER_STATE_MASK) != lexer_start) {
+            if(state == lexer_start) {
+                number_start = i;
+            }
+            /* the rest of the digit run needs no transitions */
+            i += kernel_count_digits(&line[i+1], &line[line_size]);
+        }
+        state = transition & LEXER_STATE_MASK;
+    }
+    if(state != lexer_start) {
+        /* only the parallel front end hands over segments ending in a digit */
+        if(line_memory_charge(heap_footprint(sizeof(token_t)) + heap_footprint(line_size-number_start + 1)) == FAILURE) {
+            report_memory_budget_exceeded();
+            return FAILURE;
+        }
+        current_token = token_new();
+        current_token->type = token_number;
+        current_token->lexeme = strndup(&line[number_start], line_size-number_start);
+        current_token->column = number_start+1;
+        token_list_append(list, current_token);
+        lexer_tokens++;
+    }
+    return SUCCESS;
+}
+
+/**
+ * a number: an int, a fixed point number with --decimal or a tagged value
+ * with --dynamic (see Decimal mode and Dynamic numbers).
+*/
+typedef long long value_t;
+
+/* what values hold, chosen once at startup */
+enum number_mode {
+    numbers_int,
+    numbers_decimal,
+    numbers_dynamic
+};
+
+enum number_mode number_mode = numbers_int;
+
+enum ast_type {
+    ast_add,
+    ast_sub,
+    ast_div,
+    ast_mul,
+    ast_num
+};
+
+/* structure of an ast node */
+typedef struct ast {
+    enum ast_type type;
+    union {
+        /* used by internal node (operators)*/
+        struct ast *children[2];
+        /* used leaf nodes (operands)*/
+        value_t value;
+    };
+} ast_t;
+
+/* allocate memory space for a new ast node */
+#define ast_new() \
+    (calloc(1, sizeof(ast_t)))
+
+/**
+ * de-allocate memory used by the tree rooted at node.
+ * left subtrees are rotated up so no recursion or extra memory is needed.
+*/
+void ast_free(ast_t *node) {
+    while(node != NULL) {
+        ast_t *left = node->type != ast_num ? node->children[0] : NULL;
+        if(left != NULL && left->type != ast_num) {
+            node->children[0] = left->children[1];
+            left->children[1] = node;
+            node = left;
+        } else {
+            ast_t *right = node->type != ast_num ? node->children[1] : NULL;
+            free(left);
+            free(node);
+            node = right;
+        }
+    }
+}
+/**
+ * Flat ast.
+ *
+ * The same tree stored in post-order in one array: the operands of an
+ * operator are the subtrees right before it, so no child pointers are needed
+ * and evaluation is a linear scan. The array is reused from line to line.
+*/
+typedef struct ast_flat_node {
+    /* an enum ast_type, a byte keeps the node at 8 bytes */
+    unsigned char type;
+    /* set on a leaf whose value doesn't fit in an int, the next node holds
+     * its high half */
+    unsigned char wide;
+    /* used by leaf nodes, operators keep the kernel of the type pass here */
+    int value;
+} ast_flat_node_t;
+
+_Static_assert(sizeof(ast_flat_node_t) == 8, "flat ast nodes are no longer 8 bytes");
+
+typedef struct ast_flat {
+    ast_flat_node_t *nodes;
+    int size;
+    int capacity;
+} ast_flat_t;
+
+/**
+ * add a node after the ones already in flat, within the memory budget. a
+ * value that doesn't fit in an int takes two nodes.
+*/
+int ast_flat_append(ast_flat_t *flat, enum ast_type type, value_t value) {
+    int wide = value != (int)value;
+    if(flat->size + wide >= flat->capacity) {
+        size_t capacity = flat->capacity ? (size_t)flat->capacity*2 : 256;
+        if(capacity > memory_budget / sizeof(ast_flat_node_t)) {
+            capacity = memory_budget / sizeof(ast_flat_node_t);
+        }
+        if(capacity <= (size_t)flat->size + wide || capacity > INT_MAX) {
+            /* over budget */
+            return FAILURE;
+        }
+        ast_flat_node_t *nodes = realloc(flat->nodes, capacity*sizeof(ast_flat_node_t));
+        if(nodes == NULL) {
+            perror("realloc");
+            return FAILURE;
+        }
+        flat->nodes = nodes;
+        flat->capacity = capacity;
+    }
+    ast_flat_node_t *node = &flat->nodes[flat->size];
+    node->type = type;
+    node->wide = wide;
+    node->value = (int)(unsigned)value;
+    if(wide) {
+        node[1].type = ast_num;
+        node[1].wide = 0;
+        node[1].value = (int)(unsigned)((unsigned long long)value >> 32);
+    }
+    flat->size += 1 + wide;
+    return SUCCESS;
+}
+
+/* the value of a leaf, put back together when it is wide */
+static inline value_t ast_flat_leaf(const ast_flat_node_t *node) {
+    if(!node->wide) {
+        return node->value;
+    }
+    return (value_t)((unsigned long long)(unsigned)node[1].value << 32 | (unsigned)node->value);
+}
+
+/* de-allocate the node array of flat */
+void ast_flat_release(ast_flat_t *flat) {
+    free(flat->nodes);
+    flat->nodes = NULL;
+    flat->size = flat->capacity = 0;
+}
+
+/**
+ * Explicit stacks.
+ *
+ * The parser and the execution engine keep pending work on heap stacks
+ * instead of the C stack so deeply nested input can not overflow it. A
+ * stack grows up to the memory budget and is reused from line to line.
+*/
+typedef struct stack_item {
+    union {
+        ast_t *node;
+        /* on the value stack */
+        value_t value;
+    };
+    int tag;
+} stack_item_t;
+
+typedef struct heap_stack {
+    stack_item_t *items;
+    size_t size;
+    size_t capacity;
+} heap_stack_t;
+
+/**
+ * make room for at least one more item, FAILURE past the memory budget.
+*/
+int heap_stack_grow(heap_stack_t *stack) {
+    size_t capacity = stack->capacity ? stack->capacity*2 : 64;
+    if(capacity > memory_budget / sizeof(stack_item_t)) {
+        capacity = memory_budget / sizeof(stack_item_t);
+    }
+    if(capacity <= stack->size) {
+        /* over budget */
+        return FAILURE;
+    }
+    stack_item_t *items = realloc(stack->items, capacity*sizeof(stack_item_t));
+    if(items == NULL) {
+        perror("realloc");
+        return FAILURE;
+    }
+    stack->items = items;
+    stack->capacity = capacity;
+    return SUCCESS;
+}
+
+int heap_stack_push(heap_stack_t *stack, ast_t *node, int tag) {
+    if(stack->size == stack->capacity && heap_stack_grow(stack) == FAILURE) {
+        return FAILURE;
+    }
+    stack->items[stack->size].node = node;
+    stack->items[stack->size].tag = tag;
+    stack->size++;
+    return SUCCESS;
+}
+
+#define heap_stack_pop(stack) \
+    ((stack)->items[--(stack)->size])
+
+#define heap_stack_top(stack) \
+    ((stack)->items[(stack)->size-1])
+
+#define heap_stack_is_empty(stack) \
+    ((stack)->size == 0)
+
+void heap_stack_release(heap_stack_t *stack) {
+    free(stack->items);
+    stack->items = NULL;
+    stack->size = stack->capacity = 0;
+}
+
+void report_division_by_zero() {
+    report_error(error_division_by_zero, 0, "\033[1;31mRuntimeError: Division by Zero\033[0m.\n");
+}
+
+void report_decimal_overflow() {
+    report_error(error_overflow, 0, "\033[1;31mRuntimeError: Decimal Overflow\033[0m.\n");
+}
+
+/* convert string to integer */
+#define str_to_int(str) \
+    strtol(str, 0, 10)
+
+/**
+ * Decimal mode.
+ *
+ * With --decimal=SCALE numbers are fixed point: a value holds the number
+ * times 10^SCALE in 64 bits, so 12.5 at a scale of 2 is 1250. Literals may
+ * have a fractional part. Products and quotients are worked out in 128
+ * bits and rescaled with the --rounding mode, and results are printed from
+ * the integer with exactly SCALE decimals, no floating point anywhere.
+ * Unlike ints the values never wrap: a literal or a result that does not
+ * fit 64 bits is an overflow error, as amounts of money must not turn
+ * negative.
+*/
+#define DECIMAL_MAX_SCALE 18
+
+enum rounding {
+    rounding_half_even,
+    rounding_half_up,
+    rounding_down,
+    rounding_floor,
+    rounding_ceiling,
+    roundings
+};
+
+static const char *const rounding_name[] = {
+    [rounding_half_even] = "half-even",
+    [rounding_half_up] = "half-up",
+    [rounding_down] = "down",
+    [rounding_floor] = "floor",
+    [rounding_ceiling] = "ceiling"
+};
+
+/* digits after the decimal point */
+int decimal_scale = 0;
+/* 10^decimal_scale, the value of 1 */
+value_t decimal_unit = 1;
+enum rounding decimal_rounding = rounding_half_even;
+
+/**
+ * numerator / denominator rounded to an integer with decimal_rounding into
+ * result, FAILURE if it does not fit a value.
+*/
+int decimal_divide(__int128 numerator, __int128 denominator, value_t *result) {
+    __int128 quotient = numerator / denominator;
+    __int128 remainder = numerator % denominator;
+    if(remainder != 0) {
+        int negative = (numerator < 0) != (denominator < 0);
+        int away_from_zero;
+        switch(decimal_rounding) {
+            case rounding_down:
+                away_from_zero = 0;
+                break;
+            case rounding_floor:
+                away_from_zero = negative;
+                break;
+            case rounding_ceiling:
+                away_from_zero = !negative;
+                break;
+            default: {
+                /* compare the remainder to half the denominator */
+                unsigned __int128 twice = (unsigned __int128)(remainder < 0 ? -remainder : remainder) * 2;
+                unsigned __int128 magnitude = denominator < 0 ? -denominator : denominator;
+                away_from_zero = twice > magnitude || (twice == magnitude &&
+                    (decimal_rounding == rounding_half_up || (quotient & 1)));
+                break;
+            }
+        }
+        if(away_from_zero) {
+            quotient += negative ? -1 : 1;
+        }
+    }
+    if(quotient > LLONG_MAX || quotient < LLONG_MIN) {
+        return FAILURE;
+    }
+    *result = (value_t)quotient;
+    return SUCCESS;
+}
+
+/**
+ * value of a literal into value, digits past the scale are rounded off.
+ * FAILURE if it does not fit.
+*/
+int decimal_parse(const char *lexeme, value_t *value) {
+    /* stops growing once too large, before 128 bits could wrap */
+    unsigned __int128 magnitude = 0;
+    int digits = -1;
+    /* first digit past the scale, times 10, plus 1 if any after it isn't 0 */
+    int rest = 0;
+    for(const char *p = lexeme; *p; p++) {
+        if(*p == '.') {
+            digits = 0;
+        } else if(digits < decimal_scale) {
+            magnitude = magnitude > LLONG_MAX ? magnitude : magnitude*10 + (*p-'0');
+            digits += digits >= 0;
+        } else if(digits == decimal_scale) {
+            rest = (*p-'0') * 10;
+            digits++;
+        } else if(*p != '0') {
+            rest |= 1;
+        }
+    }
+    for(digits = digits < 0 ? 0 : digits; digits < decimal_scale; digits++) {
+        magnitude = magnitude > LLONG_MAX ? magnitude : magnitude*10;
+    }
+    if(magnitude > LLONG_MAX) {
+        return FAILURE;
+    }
+    /* rounded like the quotient (magnitude*100 + rest) / 100 */
+    return decimal_divide((__int128)magnitude * 100 + rest, 100, value);
+}
+
+/**
+ * apply operator to left and right, the result replaces left.
+*/
+int decimal_operation(enum ast_type operator, value_t *left, value_t right) {
+    int overflow = 0;
+    switch(operator) {
+        case ast_add:
+            overflow = __builtin_add_overflow(*left, right, left);
+            break;
+        case ast_sub:
+            overflow = __builtin_sub_overflow(*left, right, left);
+            break;
+        case ast_mul:
+            /* both below 2^63, the product fits 128 bits */
+            overflow = decimal_divide((__int128)*left * right, decimal_unit, left) == FAILURE;
+            break;
+        case ast_div:
+            if(right == 0) {
+                report_division_by_zero();
+                return FAILURE;
+            }
+            overflow = decimal_divide((__int128)*left * decimal_unit, right, left) == FAILURE;
+            break;
+        default:
+            break;
+    }
+    if(overflow) {
+        report_decimal_overflow();
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+/**
+ * print value to stream with decimal_scale decimals.
+*/
+void decimal_print(FILE *stream, value_t value) {
+    unsigned long long magnitude = value < 0 ? 0ull - (unsigned long long)value : (unsigned long long)value;
+    unsigned long long unit = decimal_unit;
+    if(decimal_scale == 0) {
+        fprintf(stream, "\033[1;32m%s%llu\033[0m.\n", value < 0 ? "-" : "", magnitude);
+    } else {
+        fprintf(stream, "\033[1;32m%s%llu.%0*llu\033[0m.\n", value < 0 ? "-" : "",
+            magnitude / unit, decimal_scale, magnitude % unit);
+    }
+}
+
+/**
+ * Dynamic numbers.
+ *
+ * With --dynamic ints never wrap: a result too large for 64 bits becomes a
+ * big integer of any size. Literals with a decimal point are doubles, and
+ * so is a quotient of ints that isn't exact or anything a double takes
+ * part in.
+ *
+ * Values are NaN-boxed into the 64 bits of a value_t. A double is its own
+ * bits, NaNs made canonical, and everything else hides in the negative
+ * quiet NaNs the canonical NaN never uses: the top 16 bits are a tag and
+ * the low 48 bits a payload, a signed int for small ints and a pointer for
+ * big ones. Small ints and doubles never touch the heap and two small ints
+ * are told apart from anything else with one branch. Big integers live
+ * until the end of the line.
+*/
+#define TAG_SHIFT 48
+#define PAYLOAD_MASK ((1ull << TAG_SHIFT) - 1)
+#define TAGGED_INT (0xfff9ull << TAG_SHIFT)
+#define TAGGED_BIG (0xfffaull << TAG_SHIFT)
+#define SMALL_INT_MIN (-(1ll << (TAG_SHIFT-1)))
+#define SMALL_INT_MAX ((1ll << (TAG_SHIFT-1)) - 1)
+#define CANONICAL_NAN 0x7ff8000000000000ull
+
+#define value_is_int(v) \
+    (((unsigned long long)(v) >> TAG_SHIFT) == TAGGED_INT >> TAG_SHIFT)
+#define value_is_big(v) \
+    (((unsigned long long)(v) >> TAG_SHIFT) == TAGGED_BIG >> TAG_SHIFT)
+#define value_is_double(v) \
+    (((unsigned long long)(v) >> TAG_SHIFT) < TAGGED_INT >> TAG_SHIFT)
+#define box_int(i) \
+    ((value_t)(TAGGED_INT | ((unsigned long long)(i) & PAYLOAD_MASK)))
+/* the payload shifted up and back down again to extend its sign */
+#define unbox_int(v) \
+    ((long long)((unsigned long long)(v) << (64-TAG_SHIFT)) >> (64-TAG_SHIFT))
+#define box_big(b) \
+    ((value_t)(TAGGED_BIG | (unsigned long long)(uintptr_t)(b)))
+#define unbox_big(v) \
+    ((big_t *)(uintptr_t)((unsigned long long)(v) & PAYLOAD_MASK))
+
+value_t box_double(double d) {
+    unsigned long long bits = CANONICAL_NAN;
+    if(d == d) {
+        memcpy(&bits, &d, sizeof(bits));
+    }
+    return (value_t)bits;
+}
+
+double unbox_double(value_t v) {
+    double d;
+    memcpy(&d, &v, sizeof(d));
+    return d;
+}
+
+/* a big integer, sign and magnitude in base 2^32 limbs */
+typedef struct big {
+    /* allocated before it by the same thread */
+    struct big *next;
+    int negative;
+    /* limbs, the most significant one isn't 0 */
+    int size;
+    unsigned limbs[];
+} big_t;
+
+/* big integers allocated by this thread since the last big_release() */
+static _Thread_local big_t *big_allocated;
+
+/**
+ * allocate a big integer of size limbs, NULL past the memory budget.
+*/
+big_t *big_new(int size) {
+    if((size_t)size * sizeof(unsigned) > memory_budget) {
+        return NULL;
+    }
+    big_t *b = malloc(sizeof(big_t) + size * sizeof(unsigned));
+    if(b != NULL) {
+        b->next = big_allocated;
+        big_allocated = b;
+        b->negative = 0;
+        b->size = size;
+    }
+    return b;
+}
+
+/* free all big integers of this thread */
+void big_release() {
+    while(big_allocated != NULL) {
+        big_t *next = big_allocated->next;
+        free(big_allocated);
+        big_allocated = next;
+    }
+}
+
+void big_trim(big_t *b) {
+    while(b->size > 0 && b->limbs[b->size-1] == 0) {
+        b->size--;
+    }
+}
+
+big_t *big_from_int(long long i) {
+    big_t *b = big_new(2);
+    if(b != NULL) {
+        unsigned long long magnitude = i < 0 ? 0ull - (unsigned long long)i : (unsigned long long)i;
+        b->negative = i < 0;
+        b->limbs[0] = (unsigned)magnitude;
+        b->limbs[1] = (unsigned)(magnitude >> 32);
+        big_trim(b);
+    }
+    return b;
+}
+
+/**
+ * b as a value, a small int if it fits.
+*/
+value_t big_value(big_t *b) {
+    big_trim(b);
+    if(b->size <= 2) {
+        unsigned long long magnitude = b->size > 0 ? b->limbs[0] : 0;
+        if(b->size == 2) {
+            magnitude |= (unsigned long long)b->limbs[1] << 32;
+        }
+        if(magnitude <= (unsigned long long)SMALL_INT_MAX + b->negative) {
+            return box_int(b->negative ? (long long)(0ull - magnitude) : (long long)magnitude);
+        }
+    }
+    return box_big(b);
+}
+
+/* number of significant bits of |b| */
+int big_bit_length(big_t *b) {
+    return b->size == 0 ? 0 : b->size * 32 - __builtin_clz(b->limbs[b->size-1]);
+}
+
+/**
+ * the 64 bits of |b| from bit low up, with bit 0 set when any bit below low
+ * is. converting that to a double rounds like converting all of |b| would.
+*/
+unsigned long long big_top_bits(big_t *b, int low) {
+    unsigned long long bits = 0;
+    for(int i = 0; i < 64; i += 32) {
+        int limb = (low + i) / 32, shift = (low + i) % 32;
+        unsigned long long word = limb < b->size ? b->limbs[limb] : 0;
+        if(shift != 0 && limb+1 < b->size) {
+            word |= (unsigned long long)b->limbs[limb+1] << 32;
+        }
+        bits |= (unsigned long long)(unsigned)(word >> shift) << i;
+    }
+    int sticky = 0;
+    for(int i = 0; i < low / 32 && !sticky; i++) {
+        sticky = b->limbs[i] != 0;
+    }
+    if(low % 32 != 0 && low / 32 < b->size) {
+        sticky |= (b->limbs[low / 32] & ((1u << low % 32) - 1)) != 0;
+    }
+    return bits | (unsigned long long)sticky;
+}
+
+/**
+ * b rounded once to the nearest double.
+*/
+double big_to_double(big_t *b) {
+    int low = big_bit_length(b) - 64;
+    if(low < 0) {
+        low = 0;
+    }
+    double d = ldexp((double)big_top_bits(b, low), low);
+    return b->negative ? -d : d;
+}
+
+/**
+ * |b| * 2^bits, NULL past the memory budget.
+*/
+big_t *big_shift_left(big_t *b, int bits) {
+    big_t *r = big_new(b->size + bits / 32 + 1);
+    if(r == NULL) {
+        return NULL;
+    }
+    memset(r->limbs, 0, r->size * sizeof(unsigned));
+    for(int i = 0; i < b->size; i++) {
+        unsigned long long t = (unsigned long long)b->limbs[i] << bits % 32;
+        r->limbs[i + bits / 32] |= (unsigned)t;
+        r->limbs[i + bits / 32 + 1] |= (unsigned)(t >> 32);
+    }
+    big_trim(r);
+    return r;
+}
+
+/* compare the magnitudes of a and b */
+int big_compare_magnitude(big_t *a, big_t *b) {
+    if(a->size != b->size) {
+        return a->size < b->size ? -1 : 1;
+    }
+    for(int i = a->size-1; i >= 0; i--) {
+        if(a->limbs[i] != b->limbs[i]) {
+            return a->limbs[i] < b->limbs[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * a + b, or a - b when subtract is set. NULL past the memory budget.
+*/
+big_t *big_add(big_t *a, big_t *b, int subtract) {
+    int b_negative = b->negative ^ subtract;
+    int same_sign = a->negative == b_negative;
+    int negative = a->negative;
+    if(!same_sign && big_compare_magnitude(a, b) < 0) {
+        /* |b| - |a|, the sign is b's */
+        big_t *t = a;
+        a = b;
+        b = t;
+        negative = b_negative;
+    }
+    big_t *r = big_new((a->size > b->size ? a->size : b->size) + 1);
+    if(r == NULL) {
+        return NULL;
+    }
+    r->negative = negative;
+    long long carry = 0;
+    for(int i = 0; i < r->size; i++) {
+        long long x = i < a->size ? a->limbs[i] : 0;
+        long long y = i < b->size ? b->limbs[i] : 0;
+        long long t = same_sign ? x + y + carry : x - y + carry;
+        r->limbs[i] = (unsigned)t;
+        carry = t >> 32;
+    }
+    big_trim(r);
+    return r;
+}
+
+big_t *big_multiply(big_t *a, big_t *b) {
+    big_t *r = big_new(a->size + b->size);
+    if(r == NULL) {
+        return NULL;
+    }
+    memset(r->limbs, 0, r->size * sizeof(unsigned));
+    r->negative = a->negative != b->negative;
+    for(int i = 0; i < a->size; i++) {
+        unsigned long long carry = 0;
+        for(int j = 0; j < b->size; j++) {
+            unsigned long long t = (unsigned long long)a->limbs[i] * b->limbs[j] + r->limbs[i+j] + carry;
+            r->limbs[i+j] = (unsigned)t;
+            carry = t >> 32;
+        }
+        r->limbs[i+b->size] = (unsigned)carry;
+    }
+    big_trim(r);
+    return r;
+}
+
+/**
+ * quotient and remainder of a / b, b not 0, truncated towards zero.
+ * long division of Knuth's algorithm D. returns FAILURE past the memory
+ * budget.
+*/
+int big_divide(big_t *a, big_t *b, big_t **quotient, big_t **remainder) {
+    int n = b->size, m = a->size - b->size;
+    if(m < 0) {
+        *quotient = big_from_int(0);
+        *remainder = a;
+        return *quotient == NULL ? FAILURE : SUCCESS;
+    }
+    big_t *q = big_new(m+1), *u = big_new(a->size+1), *v = big_new(n);
+    if(q == NULL || u == NULL || v == NULL) {
+        return FAILURE;
+    }
+    /* shift both so the divisor's top limb has its top bit set */
+    int s = __builtin_clz(b->limbs[n-1]);
+    for(int i = n-1; i > 0; i--) {
+        v->limbs[i] = (unsigned)(((unsigned long long)b->limbs[i] << s) | ((unsigned long long)b->limbs[i-1] >> (32-s)));
+    }
+    v->limbs[0] = b->limbs[0] << s;
+    u->limbs[a->size] = (unsigned)((unsigned long long)a->limbs[a->size-1] >> (32-s));
+    for(int i = a->size-1; i > 0; i--) {
+        u->limbs[i] = (unsigned)(((unsigned long long)a->limbs[i] << s) | ((unsigned long long)a->limbs[i-1] >> (32-s)));
+    }
+    u->limbs[0] = a->limbs[0] << s;
+    for(int j = m; j >= 0; j--) {
+        /* estimate the quotient limb from the top two limbs, at most 2 too high */
+        unsigned long long top = ((unsigned long long)u->limbs[j+n] << 32) | u->limbs[j+n-1];
+        unsigned long long qhat = top / v->limbs[n-1];
+        unsigned long long rhat = top % v->limbs[n-1];
+        while(qhat >> 32 || (n > 1 && qhat * v->limbs[n-2] > ((rhat << 32) | u->limbs[j+n-2]))) {
+            qhat--;
+            rhat += v->limbs[n-1];
+            if(rhat >> 32) {
+                break;
+            }
+        }
+        /* subtract qhat times the divisor */
+        long long borrow = 0, t;
+        for(int i = 0; i < n; i++) {
+            unsigned long long p = qhat * v->limbs[i];
+            t = u->limbs[i+j] - borrow - (long long)(p & 0xffffffffull);
+            u->limbs[i+j] = (unsigned)t;
+            borrow = (long long)(p >> 32) - (t >> 32);
+        }
+        t = u->limbs[j+n] - borrow;
+        u->limbs[j+n] = (unsigned)t;
+        if(t < 0) {
+            /* one too many, add the divisor back */
+            qhat--;
+            unsigned long long carry = 0;
+            for(int i = 0; i < n; i++) {
+                unsigned long long sum = (unsigned long long)u->limbs[i+j] + v->limbs[i] + carry;
+                u->limbs[i+j] = (unsigned)sum;
+                carry = sum >> 32;
+            }
+            u->limbs[j+n] += (unsigned)carry;
+        }
+        q->limbs[j] = (unsigned)qhat;
+    }
+    /* shift the remainder back */
+    for(int i = 0; i < n; i++) {
+        u->limbs[i] = (unsigned)(((unsigned long long)u->limbs[i] >> s) | ((unsigned long long)u->limbs[i+1] << (32-s)));
+    }
+    u->size = n;
+    q->negative = a->negative != b->negative;
+    u->negative = a->negative;
+    big_trim(q);
+    big_trim(u);
+    *quotient = q;
+    *remainder = u;
+    return SUCCESS;
+}
+
+/**
+ * a / b, b not 0, rounded once to the nearest double. one of the operands is
+ * shifted so the quotient has 63 or 64 bits, and a nonzero remainder joins it
+ * as a sticky bit. returns FAILURE past the memory budget.
+*/
+int big_ratio_to_double(big_t *a, big_t *b, double *result) {
+    int shift = 63 - (big_bit_length(a) - big_bit_length(b));
+    big_t *scaled_a = shift > 0 ? big_shift_left(a, shift) : a;
+    big_t *scaled_b = shift < 0 ? big_shift_left(b, -shift) : b;
+    big_t *q, *r;
+    if(scaled_a == NULL || scaled_b == NULL || big_divide(scaled_a, scaled_b, &q, &r) == FAILURE) {
+        return FAILURE;
+    }
+    double d = ldexp((double)(big_top_bits(q, 0) | (r->size != 0)), -shift);
+    *result = a->negative != b->negative ? -d : d;
+    return SUCCESS;
+}
+
+/**
+ * the value of a literal, a double if it has a decimal point.
+ * returns FAILURE past the memory budget.
+*/
+int dynamic_parse(const char *lexeme, value_t *value) {
+    /* 14 digits always fit a small int */
+    long long small = 0;
+    const char *p = lexeme;
+    while(*p >= '0' && *p <= '9' && p - lexeme < 14) {
+        small = small*10 + (*p++ - '0');
+    }
+    if(*p == '\0') {
+        *value = box_int(small);
+        return SUCCESS;
+    }
+    if(strchr(p, '.') != NULL) {
+        *value = box_double(strtod(lexeme, NULL));
+        return SUCCESS;
+    }
+    size_t digits = strlen(lexeme);
+    big_t *b;
+    if(digits <= 18) {
+        /* below 10^18, within 64 bits */
+        long long i = strtoll(lexeme, NULL, 10);
+        if(i <= SMALL_INT_MAX) {
+            *value = box_int(i);
+            return SUCCESS;
+        }
+        b = big_from_int(i);
+        if(b == NULL) {
+            report_memory_budget_exceeded();
+            return FAILURE;
+        }
+        *value = big_value(b);
+        return SUCCESS;
+    }
+    /* 9 digits at a time, 10^9 fits in a limb */
+    b = big_new(digits / 9 + 1);
+    if(b == NULL) {
+        report_memory_budget_exceeded();
+        return FAILURE;
+    }
+    b->size = 0;
+    for(size_t i = 0; i < digits; ) {
+        unsigned chunk = 0, scale = 1;
+        for(size_t end = i + 9; i < digits && i < end; i++) {
+            chunk = chunk*10 + (lexeme[i]-'0');
+            scale *= 10;
+        }
+        unsigned long long carry = chunk;
+        for(int j = 0; j < b->size; j++) {
+            unsigned long long t = (unsigned long long)b->limbs[j] * scale + carry;
+            b->limbs[j] = (unsigned)t;
+            carry = t >> 32;
+        }
+        if(carry != 0) {
+            b->limbs[b->size++] = (unsigned)carry;
+        }
+    }
+    *value = big_value(b);
+    return SUCCESS;
+}
+
+/* v as a big integer, v an int */
+big_t *dynamic_to_big(value_t v) {
+    return value_is_big(v) ? unbox_big(v) : big_from_int(unbox_int(v));
+}
+
+double dynamic_to_double(value_t v) {
+    if(value_is_double(v)) {
+        return unbox_double(v);
+    }
+    return value_is_big(v) ? big_to_double(unbox_big(v)) : (double)unbox_int(v);
+}
+
+/**
+ * apply operator to left and right when they aren't both small ints or
+ * the result isn't one.
+*/
+int dynamic_operation_generic(enum ast_type operator, value_t *left, value_t right) {
+    if(value_is_double(*left) || value_is_double(right)) {
+        double x = dynamic_to_double(*left), y = dynamic_to_double(right);
+        switch(operator) {
+            case ast_add: x += y; break;
+            case ast_sub: x -= y; break;
+            case ast_mul: x *= y; break;
+            case ast_div:
+                if(y == 0) {
+                    report_division_by_zero();
+                    return FAILURE;
+                }
+                x /= y;
+                break;
+            default: break;
+        }
+        *left = box_double(x);
+        return SUCCESS;
+    }
+    if(operator == ast_div && value_is_int(right) && unbox_int(right) == 0) {
+        report_division_by_zero();
+        return FAILURE;
+    }
+    big_t *a = dynamic_to_big(*left), *b = dynamic_to_big(right), *r = NULL;
+    if(a != NULL && b != NULL) {
+        switch(operator) {
+            case ast_add: r = big_add(a, b, 0); break;
+            case ast_sub: r = big_add(a, b, 1); break;
+            case ast_mul: r = big_multiply(a, b); break;
+            case ast_div: {
+                big_t *remainder;
+                if(big_divide(a, b, &r, &remainder) == FAILURE) {
+                    r = NULL;
+                } else if(remainder->size != 0) {
+                    /* not exact */
+                    double d;
+                    if(big_ratio_to_double(a, b, &d) == FAILURE) {
+                        r = NULL;
+                        break;
+                    }
+                    *left = box_double(d);
+                    return SUCCESS;
+                }
+                break;
+            }
+            default: break;
+        }
+    }
+    if(r == NULL) {
+        report_memory_budget_exceeded();
+        return FAILURE;
+    }
+    *left = big_value(r);
+    return SUCCESS;
+}
+
+/**
+ * apply operator to left and right, the result replaces left.
+*/
+static inline int dynamic_operation(enum ast_type operator, value_t *left, value_t right) {
+    /* both small ints: the tag bits cancel out */
+    if(((((unsigned long long)*left ^ TAGGED_INT) | ((unsigned long long)right ^ TAGGED_INT)) >> TAG_SHIFT) == 0) {
+        long long x = unbox_int(*left), y = unbox_int(right), r = 0;
+        /* products of small ints fit in 96 bits, not always 64 */
+        int exact = 1;
+        switch(operator) {
+            case ast_add: r = x + y; break;
+            case ast_sub: r = x - y; break;
+            case ast_mul: exact = !__builtin_mul_overflow(x, y, &r); break;
+            case ast_div:
+                exact = y != 0 && x % y == 0;
+                r = exact ? x / y : 0;
+                break;
+            default: break;
+        }
+        if(exact && r >= SMALL_INT_MIN && r <= SMALL_INT_MAX) {
+            *left = box_int(r);
+            return SUCCESS;
+        }
+    }
+    return dynamic_operation_generic(operator, left, right);
+}
+
+/**
+ * print value to stream, doubles with a decimal point or exponent.
+*/
+void dynamic_print(FILE *stream, value_t value) {
+    if(value_is_int(value)) {
+        fprintf(stream, "\033[1;32m%lld\033[0m.\n", unbox_int(value));
+    } else if(value_is_double(value)) {
+        char text[32];
+        double d = unbox_double(value);
+        /* the fewest digits, from 15, that read back the same */
+        for(int digits = 15; digits <= 17; digits++) {
+            snprintf(text, sizeof(text), "%.*g", digits, d);
+            if(strtod(text, NULL) == d) {
+                break;
+            }
+        }
+        if(strpbrk(text, ".en") == NULL) {
+            strcat(text, ".0");
+        }
+        fprintf(stream, "\033[1;32m%s\033[0m.\n", text);
+    } else {
+        /* base 10^9 digits from the least significant, by short division */
+        big_t *b = unbox_big(value);
+        unsigned *limbs = malloc(b->size * sizeof(unsigned));
+        unsigned *chunks = malloc((b->size * 10 / 9 + 2) * sizeof(unsigned));
+        if(limbs == NULL || chunks == NULL) {
+            free(limbs);
+            free(chunks);
+            report_memory_budget_exceeded();
+            return;
+        }
+        memcpy(limbs, b->limbs, b->size * sizeof(unsigned));
+        int size = b->size, n = 0;
+        /* at least one chunk, a zero magnitude prints as 0 */
+        do {
+            unsigned long long rest = 0;
+            for(int i = size-1; i >= 0; i--) {
+                unsigned long long t = (rest << 32) | limbs[i];
+                limbs[i] = (unsigned)(t / 1000000000u);
+                rest = t % 1000000000u;
+            }
+            chunks[n++] = (unsigned)rest;
+            while(size > 0 && limbs[size-1] == 0) {
+                size--;
+            }
+        } while(size > 0);
+        fprintf(stream, "\033[1;32m%s%u", b->negative ? "-" : "", chunks[n-1]);
+        for(int i = n-2; i >= 0; i--) {
+            fprintf(stream, "%09u", chunks[i]);
+        }
+        fprintf(stream, "\033[0m.\n");
+        free(limbs);
+        free(chunks);
+    }
+}
+
+/**
+ * token stream populated by the tokenizer stage.
+ * 
+*/
+static _Thread_local token_list_t *parser_token_stream = NULL;
+/**
+ * pointer to the token that will be returned when
+ * the parser requests a new one. 
+*/
+static _Thread_local token_t *parser_next_token = NULL;
+/**
+ * The last token to have been requested by the parser.
+*/
+static _Thread_local token_t *parser_active_token = NULL;
+
+/**
+ * when set the parser emits nodes into this flat ast instead of
+ * allocating a tree.
+*/
+static _Thread_local ast_flat_t *parser_flat_ast = NULL;
+
+/* operators and open brackets waiting for their right side */
+static _Thread_local heap_stack_t parser_operators;
+/* subtrees parsed so far, unused for flat asts */
+static _Thread_local heap_stack_t parser_operands;
+/* tag of an open bracket on parser_operators */
+#define BRACKET_MARKER -1
+
+/* binding strength of the binary operators, higher binds tighter */
+static const int operator_precedence[] = {
+    [ast_add] = 1,
+    [ast_sub] = 2,
+    [ast_mul] = 3,
+    [ast_div] = 4
+};
+
+/**
+ * operator of a token, -1 if it isn't one.
+*/
+int token_operator(enum token_type type) {
+    switch(type) {
+        case token_plus: return ast_add;
+        case token_minus: return ast_sub;
+        case token_times: return ast_mul;
+        case token_divide: return ast_div;
+        default: return -1;
+    }
+}
+
+/**
+ * combine the two topmost operands with operator.
+*/
+int parser_reduce(enum ast_type operator) {
+    if(parser_flat_ast != NULL) {
+        /* operands are already in place, the operator follows them */
+        return ast_flat_append(parser_flat_ast, operator, 0);
+    }
+    ast_t *new_ast;
+    if(line_memory_charge(heap_footprint(sizeof(ast_t))) == FAILURE || (new_ast = ast_new()) == NULL) {
+        return FAILURE;
+    }
+    new_ast->type = operator;
+    new_ast->children[1] = heap_stack_pop(&parser_operands).node;
+    new_ast->children[0] = heap_stack_pop(&parser_operands).node;
+    /* two operands were just popped, there is room */
+    return heap_stack_push(&parser_operands, new_ast, 0);
+}
+
+int parser_make_number(value_t value) {
+    if(parser_flat_ast != NULL) {
+        return ast_flat_append(parser_flat_ast, ast_num, value);
+    }
+    ast_t *number;
+    if(line_memory_charge(heap_footprint(sizeof(ast_t))) == FAILURE || (number = ast_new()) == NULL) {
+        return FAILURE;
+    }
+    number->type = ast_num;
+    number->value = value;
+    if(heap_stack_push(&parser_operands, number, 0) == FAILURE) {
+        free(number);
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+char *get_token_lexeme(token_t *token) {
+    if(token->type == token_number) {
+        return token->lexeme;
+    }
+    return (char *)token_type_lexeme[token->type];
+}
+
+/**
+ * set the stream of tokens to use. 
+*/
+int parser_register_token_stream(token_list_t *stream) {
+    parser_token_stream = stream;
+    if(stream != NULL) {
+        parser_next_token = stream->head;
+    }
+    return SUCCESS;
+}
+
+/**
+ * Get a token from the registered stream.
+ * 
+ * Parser routines don't have to know how to access the stream.
+*/
+token_t *parser_get_next_token() {
+    if(parser_next_token != NULL) {
+        parser_active_token = parser_next_token;
+        parser_next_token = parser_next_token->next;
+    }
+    return parser_active_token;
+}
+
+/* compare a token's type to x */
+#define token_type_is(x) \
+    (parser_active_token->type == x)
+
+/**
+ * Grammar's EBNF
+ * 
+ *  0. calculator           ->  arithmetic EOF
+ *  1. arithmetic           ->  expression EOX
+ *  2. expression           ->  add_expression
+ *  3.                      |   EPSILON                       
+ *  4. add_expression       ->  sub_expression add_expression_p
+ *  5. add_expression_p     ->  ADD  sub_expression add_expression_p
+ *  6.                      |   EPSILON
+ *  7. sub_expression       ->  mul_expression sub_expression_p
+ *  8. sub_expression_p     ->  SUB  mul_expression sub_expression_p
+ *  9.                      |   EPSILON
+ * 10. mul_expression       ->  div_expression mul_expression_p
+ * 11. mul_expression_p     ->  MUL  div_expression mul_expression_p
+ * 12.                      |   EPSILON
+ * 13. div_expression       ->  unit_expression div_expression_p
+ * 14. add_expression_p     ->  DIV  unit_expression div_expression_p
+ * 15.                      |   EPSILON
+ * 16. unit_expression      ->  NUMBER
+ * 17.                      |   OPENBRACKET add_expression CLOSEBRACKET
+*/
+
+int parser_parse_expression(ast_t **tree);
+
+/**
+ * production 0
+*/
+int parse_token_stream_into_ast(token_list_t *stream, ast_t **tree) {
+    int r = SUCCESS;
+    parser_register_token_stream(stream);
+    parser_get_next_token();
+    /* no processing on eof */
+    if(!token_type_is(token_end_of_file)) {
+        r = parser_parse_expression(tree);
+    }
+    return r;
+}
+
+/**
+ * production 0, emitting a flat ast.
+*/
+int parse_token_stream_into_flat_ast(token_list_t *stream, ast_flat_t *flat) {
+    ast_t *unused = NULL;
+    flat->size = 0;
+    parser_flat_ast = flat;
+    int r = parse_token_stream_into_ast(stream, &unused);
+    parser_flat_ast = NULL;
+    return r;
+}
+
+/**
+ * Productions 1 to 17.
+ *
+ * Operator precedence parsing with explicit stacks rather than a recursive
+ * routine per production, so nesting depth is bounded by the memory budget
+ * and not the C stack. An operator is reduced once one that binds no
+ * tighter follows it, giving the left associative trees of productions 4
+ * to 15. Errors are reported at the same tokens as by recursive descent.
+*/
+int parser_parse_expression(ast_t **tree) {
+    int r = SUCCESS;
+    int expect_operand = 1;
+    parser_operators.size = 0;
+    parser_operands.size = 0;
+    for(;;) {
+        if(expect_operand) {
+            /* production 16 & 17 */
+            if(token_type_is(token_bracket_open)) {
+                r = heap_stack_push(&parser_operators, NULL, BRACKET_MARKER);
+            } else if(token_type_is(token_number)) {
+                if(number_mode == numbers_decimal) {
+                    value_t value;
+                    if(decimal_parse(parser_active_token->lexeme, &value) == FAILURE) {
+                        report_error(error_overflow, parser_active_token->column,
+                            "\033[1;31mOverflowError: %s does not fit --decimal=%d.\033[0m\n",
+                            parser_active_token->lexeme, decimal_scale);
+                        r = FAILURE;
+                        break;
+                    }
+                    r = parser_make_number(value);
+                } else if(number_mode == numbers_dynamic) {
+                    value_t value;
+                    r = dynamic_parse(parser_active_token->lexeme, &value);
+                    if(r == SUCCESS) {
+                        r = parser_make_number(value);
+                    }
+                } else {
+                    r = parser_make_number((int)str_to_int(parser_active_token->lexeme));
+                }
+                expect_operand = 0;
+            } else {
+                report_error(error_syntax, parser_active_token->column,
+                    "\033[1;31mSyntaxError: Expected an integer or '(' near %c.\033[0m\n",
+                    get_token_lexeme(parser_active_token)[0]);
+                r = FAILURE;
+                break;
+            }
+            if(r == FAILURE) {
+                report_memory_budget_exceeded();
+                break;
+            }
+            parser_get_next_token();
+            continue;
+        }
+        int operator = token_operator(parser_active_token->type);
+        /* reduce what binds at least as tight, or all up to the innermost bracket */
+        while(r == SUCCESS && !heap_stack_is_empty(&parser_operators)) {
+            int pending = heap_stack_top(&parser_operators).tag;
+            if(pending == BRACKET_MARKER ||
+                (operator != -1 && operator_precedence[pending] < operator_precedence[operator])) {
+                break;
+            }
+            r = parser_reduce(heap_stack_pop(&parser_operators).tag);
+        }
+        if(r == SUCCESS && operator != -1) {
+            r = heap_stack_push(&parser_operators, NULL, operator);
+            expect_operand = 1;
+        }
+        if(r == FAILURE) {
+            report_memory_budget_exceeded();
+            break;
+        }
+        if(operator != -1) {
+            parser_get_next_token();
+            continue;
+        }
+        if(heap_stack_is_empty(&parser_operators)) {
+            /* productions 1, 2 & 3 */
+            if(!token_type_is(token_end_of_expression) && !token_type_is(token_end_of_file)) {
+                report_error(error_syntax, parser_active_token->column,
+                    "\033[1;31mSyntaxError: Expected end of expression near %c.\033[0m\n",
+                    get_token_lexeme(parser_active_token)[0]);
+                r = FAILURE;
+            }
+            break;
+        }
+        if(!token_type_is(token_bracket_close)) {
+            /* bracket opened above does not have a matching closing bracket */
+            report_error(error_syntax, parser_active_token->column,
+                "\033[1;31mSyntaxError: Expected closing ) before end of expression.\033[0m\n");
+            r = FAILURE;
+            break;
+        }
+        /* the open bracket it closes */
+        (void)heap_stack_pop(&parser_operators);
+        parser_get_next_token();
+    }
+    if(r == SUCCESS && parser_flat_ast == NULL) {
+        *tree = heap_stack_pop(&parser_operands).node;
+    }
+    /* subtrees of a failed parse */
+    while(!heap_stack_is_empty(&parser_operands)) {
+        ast_free(heap_stack_pop(&parser_operands).node);
+    }
+    parser_get_next_token();
+    return r;
+}
+
+/** stack creation and manipulation procedures */
+/* the stack of values, as deep as the memory budget allows */
+_Thread_local heap_stack_t callstack;
+
+/* push without a check, after callstack_reserve or popping */
+#define callstack_push(x) \
+    (callstack.items[callstack.size++].value = x)
+
+#define callstack_pop() \
+    (callstack.items[--callstack.size].value)
+
+/* room for one more value, FAILURE past the memory budget */
+#define callstack_reserve() \
+    (callstack.size < callstack.capacity ? SUCCESS : heap_stack_grow(&callstack))
+
+#define callstack_is_empty() \
+    (callstack.size == 0)
+
+#define callstack_clear() \
+    (callstack.size = 0)
+
+/**
+ * apply operator to left and right in the current number mode, leaving the
+ * result in left.
+*/
+static inline int value_operation(enum ast_type operator, value_t *left, value_t right) {
+    if(number_mode != numbers_int) {
+        return number_mode == numbers_dynamic ?
+            dynamic_operation(operator, left, right) :
+            decimal_operation(operator, left, right);
+    }
+    value_t left_operand = *left, right_operand = right;
+    /* ints, in range of int */
+    switch(operator) {
+        /* arithmetic wraps around, done unsigned to avoid signed overflow */
+        case ast_add: {
+            left_operand = (int)((unsigned)left_operand + (unsigned)right_operand);
+            break;
+        }
+        case ast_sub: {
+            left_operand = (int)((unsigned)left_operand - (unsigned)right_operand);
+            break;
+        }
+        case ast_mul: {
+            left_operand = (int)((unsigned)left_operand * (unsigned)right_operand);
+            break;
+        }
+        case ast_div: {
+            if(right_operand == 0) {
+                report_division_by_zero();
+                return FAILURE;
+            }
+            if(right_operand == -1) {
+                /* INT_MIN / -1 traps, negate with wrap around instead */
+                left_operand = (int)(0u - (unsigned)left_operand);
+            } else {
+                left_operand /= right_operand;
+            }
+            break;
+        }
+    }
+    *left = left_operand;
+    return SUCCESS;
+}
+
+/**
+ * perform an operation on the two topmost stack elements and
+ * push the result back to the stack.
+*/
+int execution_engine_do_operation(enum ast_type operator) {
+    value_t right_operand = callstack_pop();
+    value_t left_operand = callstack_pop();
+    if(value_operation(operator, &left_operand, right_operand) == FAILURE) {
+        return FAILURE;
+    }
+    callstack_push(left_operand);
+    return SUCCESS;
+}
+
+/* nodes whose operands or operation are still to be processed */
+_Thread_local heap_stack_t engine_pending;
+/* nodes executed on this thread, for --stats=hw */
+_Thread_local long long engine_nodes;
+/* tag of a node whose operands have been pushed */
+#define OPERANDS_PUSHED 1
+
+/**
+ * Do a depth first traversal of the AST tree rooted at node. 
+ *
+ * The traversal keeps its own stack so it doesn't recurse on deep trees.
+*/
+int execution_engine_process_ast_node(ast_t *node) {
+    engine_pending.size = 0;
+    if(heap_stack_push(&engine_pending, node, 0) == FAILURE) {
+        report_memory_budget_exceeded();
+        return FAILURE;
+    }
+    while(!heap_stack_is_empty(&engine_pending)) {
+        stack_item_t pending = heap_stack_pop(&engine_pending);
+        node = pending.node;
+        if(node == NULL) {
+            continue;
+        }
+        if(node->type == ast_num || pending.tag == OPERANDS_PUSHED) {
+            engine_nodes++;
+        }
+        if(node->type == ast_num) {
+            if(callstack_reserve() == FAILURE) {
+                report_memory_budget_exceeded();
+                return FAILURE;
+            }
+            callstack_push(node->value);
+        } else if(pending.tag == OPERANDS_PUSHED) {
+            if(execution_engine_do_operation(node->type) == FAILURE) {
+                return FAILURE;
+            }
+        } else {
+            /* the left operand is popped, and evaluated, first */
+            if(heap_stack_push(&engine_pending, node, OPERANDS_PUSHED) == FAILURE ||
+                heap_stack_push(&engine_pending, node->children[1], 0) == FAILURE ||
+                heap_stack_push(&engine_pending, node->children[0], 0) == FAILURE) {
+                report_memory_budget_exceeded();
+                return FAILURE;
+            }
+        }
+    }
+    return SUCCESS;
+}
+
+/**
+ * Result summary.
+ *
+ * --summary describes the results of a run on stderr at exit: their count,
+ * extremes and mean, quantiles from a KLL sketch, a histogram and the most
+ * frequent results, all in memory that does not grow with the input.
+ *
+ * The KLL sketch keeps compactors of levels 0 to levels-1, those of level
+ * h holding items of weight 2^h. The top one may hold SUMMARY_KLL_K items
+ * and each below two thirds of the one above it. A level over its capacity
+ * is sorted and every other item, from a random first one, moves up a
+ * level. 99% of ranks are then within 2.7/SUMMARY_KLL_K, 1.35%, of the
+ * results, also after merging sketches with their own random choices. The
+ * histogram counts results by sign and power of two, the bucket of |x| in
+ * [2^(e-1), 2^e) for e from -SUMMARY_EXPONENTS to SUMMARY_EXPONENTS, those
+ * beyond in the outermost. The most frequent results come from the
+ * Space-Saving algorithm: SUMMARY_COUNTERS counters, a result without one
+ * taking over the smallest and its count, which is then its most possible
+ * overcount. Every thread summarises the results it prints and merges into
+ * one summary when it releases its buffers; all three are mergeable
+ * without losing their bounds. Results are summarised as doubles, decimals
+ * by their value and big integers rounded.
+*/
+#define SUMMARY_KLL_K 200
+#define SUMMARY_KLL_LEVELS 48
+#define SUMMARY_EXPONENTS 64
+#define SUMMARY_BUCKETS (4*SUMMARY_EXPONENTS + 3)
+#define SUMMARY_COUNTERS 64
+/* most frequent results printed */
+#define SUMMARY_TOP 10
+
+typedef struct kll {
+    double *items[SUMMARY_KLL_LEVELS];
+    int size[SUMMARY_KLL_LEVELS];
+    int capacity[SUMMARY_KLL_LEVELS];
+    int levels;
+    /* state of the xorshift generator choosing the items that move up */
+    unsigned long long random;
+} kll_t;
+
+typedef struct summary_counter {
+    value_t key;
+    long long count;
+    /* count may be this much over */
+    long long error;
+} summary_counter_t;
+
+typedef struct summary {
+    long long results;
+    long long nans;
+    double sum;
+    double min;
+    double max;
+    kll_t kll;
+    /* zero in the middle, negatives below it and positives above */
+    long long buckets[SUMMARY_BUCKETS];
+    summary_counter_t counters[SUMMARY_COUNTERS];
+    int counters_size;
+} summary_t;
+
+int option_summary = 0;
+/* summaries merged from the threads that evaluated */
+summary_t summary_merged;
+pthread_mutex_t summary_mutex = PTHREAD_MUTEX_INITIALIZER;
+static _Thread_local summary_t summary_thread;
+
+/**
+ * items level of a sketch of levels levels may hold, at least 2.
+*/
+int kll_level_capacity(int level, int levels) {
+    double capacity = SUMMARY_KLL_K;
+    for(int i = level; i < levels-1 && capacity > 2; i++) {
+        capacity *= 2.0 / 3;
+    }
+    return capacity > 2 ? (int)capacity : 2;
+}
+
+int kll_compare(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+int kll_push(kll_t *kll, int level, double x) {
+    if(kll->size[level] == kll->capacity[level]) {
+        int capacity = kll->capacity[level] ? 2*kll->capacity[level] : 8;
+        double *items = realloc(kll->items[level], capacity * sizeof(double));
+        if(items == NULL) {
+            return FAILURE;
+        }
+        kll->items[level] = items;
+        kll->capacity[level] = capacity;
+    }
+    kll->items[level][kll->size[level]++] = x;
+    return SUCCESS;
+}
+
+/**
+ * move every other item of the levels over their capacity up a level,
+ * from the bottom so what moves up is compacted in turn.
+*/
+void kll_compress(kll_t *kll) {
+    for(int level = 0; level < kll->levels; level++) {
+        int size = kll->size[level];
+        if(size < kll_level_capacity(level, kll->levels)) {
+            continue;
+        }
+        if(level+1 == kll->levels) {
+            if(kll->levels == SUMMARY_KLL_LEVELS) {
+                /* 2^47 results of weight: keep the top level as it is */
+                continue;
+            }
+            kll->levels++;
+        }
+        double *items = kll->items[level];
+        qsort(items, size, sizeof(double), kll_compare);
+        kll->random ^= kll->random << 13;
+        kll->random ^= kll->random >> 7;
+        kll->random ^= kll->random << 17;
+        int first = kll->random & 1;
+        for(int i = first; i < (size & ~1); i += 2) {
+            if(kll_push(kll, level+1, items[i]) != SUCCESS) {
+                return;
+            }
+        }
+        /* an odd item out stays at its weight */
+        if(size & 1) {
+            items[0] = items[size-1];
+        }
+        kll->size[level] = size & 1;
+    }
+}
+
+/* sketches started, each draws its own random sequence */
+unsigned long long kll_sketches;
+
+/**
+ * start an empty sketch. sketches that are merged must not move up the
+ * same items of their levels, or their errors add up instead of cancelling.
+*/
+void kll_start(kll_t *kll) {
+    unsigned long long n = __atomic_add_fetch(&kll_sketches, 1, __ATOMIC_RELAXED);
+    kll->levels = 1;
+    /* an odd multiple of an odd constant, never 0 */
+    kll->random = 0x9e3779b97f4a7c15ull * (2*n - 1);
+}
+
+void kll_add(kll_t *kll, double x) {
+    if(kll->levels == 0) {
+        kll_start(kll);
+    }
+    if(kll_push(kll, 0, x) == SUCCESS && kll->size[0] >= kll_level_capacity(0, kll->levels)) {
+        kll_compress(kll);
+    }
+}
+
+void kll_merge(kll_t *into, kll_t *from) {
+    if(into->levels == 0) {
+        kll_start(into);
+    }
+    for(int level = 0; level < from->levels; level++) {
+        for(int i = 0; i < from->size[level]; i++) {
+            kll_push(into, level, from->items[level][i]);
+        }
+    }
+    if(from->levels > into->levels) {
+        into->levels = from->levels;
+    }
+    kll_compress(into);
+}
+
+void kll_release(kll_t *kll) {
+    for(int level = 0; level < SUMMARY_KLL_LEVELS; level++) {
+        free(kll->items[level]);
+    }
+    memset(kll, 0, sizeof(kll_t));
+}
+
+typedef struct kll_weighted {
+    double x;
+    long long weight;
+} kll_weighted_t;
+
+int kll_weighted_compare(const void *a, const void *b) {
+    return kll_compare(&((const kll_weighted_t *)a)->x, &((const kll_weighted_t *)b)->x);
+}
+
+/**
+ * the results of the sketch sorted with their weights in items, their
+ * number is returned, -1 if out of memory.
+*/
+int kll_sorted(kll_t *kll, kll_weighted_t **items) {
+    int n = 0;
+    for(int level = 0; level < kll->levels; level++) {
+        n += kll->size[level];
+    }
+    if((*items = malloc((n > 0 ? n : 1) * sizeof(kll_weighted_t))) == NULL) {
+        return -1;
+    }
+    n = 0;
+    for(int level = 0; level < kll->levels; level++) {
+        for(int i = 0; i < kll->size[level]; i++) {
+            (*items)[n++] = (kll_weighted_t){kll->items[level][i], 1ll << level};
+        }
+    }
+    qsort(*items, n, sizeof(kll_weighted_t), kll_weighted_compare);
+    return n;
+}
+
+/**
+ * bucket of x, without libm: the exponent comes from the bits.
+*/
+int summary_bucket(double x) {
+    unsigned long long bits;
+    memcpy(&bits, &x, sizeof(bits));
+    if(x == 0) {
+        return 2*SUMMARY_EXPONENTS + 1;
+    }
+    int exponent = (int)((bits >> 52) & 0x7ff) - 1022;
+    if(exponent < -SUMMARY_EXPONENTS) {
+        exponent = -SUMMARY_EXPONENTS;
+    } else if(exponent > SUMMARY_EXPONENTS) {
+        exponent = SUMMARY_EXPONENTS;
+    }
+    int offset = exponent + SUMMARY_EXPONENTS;
+    return x > 0 ? 2*SUMMARY_EXPONENTS + 2 + offset : 2*SUMMARY_EXPONENTS - offset;
+}
+
+/**
+ * count key with Space-Saving.
+*/
+void summary_count(summary_t *summary, value_t key) {
+    summary_counter_t *counters = summary->counters;
+    int smallest = 0;
+    for(int i = 0; i < summary->counters_size; i++) {
+        if(counters[i].key == key) {
+            counters[i].count++;
+            return;
+        }
+        if(counters[i].count < counters[smallest].count) {
+            smallest = i;
+        }
+    }
+    if(summary->counters_size < SUMMARY_COUNTERS) {
+        counters[summary->counters_size++] = (summary_counter_t){key, 1, 0};
+    } else {
+        counters[smallest] = (summary_counter_t){key, counters[smallest].count + 1, counters[smallest].count};
+    }
+}
+
+/**
+ * add a result to the summary of this thread.
+*/
+void summary_add(value_t value) {
+    summary_t *summary = &summary_thread;
+    double x;
+    value_t key = value;
+    if(number_mode == numbers_decimal) {
+        x = (double)value / decimal_unit;
+    } else if(number_mode == numbers_dynamic) {
+        x = dynamic_to_double(value);
+        if(value_is_big(value)) {
+            /* the big integer goes with the line */
+            key = box_double(x);
+        }
+    } else {
+        /* ints print as int */
+        x = (int)value;
+        key = (int)value;
+    }
+    if(x != x) {
+        summary->nans++;
+        return;
+    }
+    if(summary->results == 0 || x < summary->min) {
+        summary->min = x;
+    }
+    if(summary->results == 0 || x > summary->max) {
+        summary->max = x;
+    }
+    summary->results++;
+    summary->sum += x;
+    summary->buckets[summary_bucket(x)]++;
+    kll_add(&summary->kll, x);
+    summary_count(summary, key);
+}
+
+/* the count of a full Space-Saving summary's smallest counter, 0 if not full */
+long long summary_counters_floor(summary_t *summary) {
+    long long floor = summary->counters_size == SUMMARY_COUNTERS ? summary->counters[0].count : 0;
+    for(int i = 1; floor > 0 && i < summary->counters_size; i++) {
+        if(summary->counters[i].count < floor) {
+            floor = summary->counters[i].count;
+        }
+    }
+    return floor;
+}
+
+int summary_counter_compare(const void *a, const void *b) {
+    const summary_counter_t *x = a, *y = b;
+    return x->count < y->count ? 1 : x->count > y->count ? -1 : 0;
+}
+
+/**
+ * merge the Space-Saving counters of from into those of into: a key
+ * missing from a full summary may have had up to its smallest count.
+*/
+void summary_counters_merge(summary_t *into, summary_t *from) {
+    summary_counter_t merged[2*SUMMARY_COUNTERS];
+    long long into_floor = summary_counters_floor(into);
+    long long from_floor = summary_counters_floor(from);
+    int n = 0;
+    for(int i = 0; i < into->counters_size; i++) {
+        summary_counter_t counter = into->counters[i];
+        int j;
+        for(j = 0; j < from->counters_size && from->counters[j].key != counter.key; j++);
+        if(j < from->counters_size) {
+            counter.count += from->counters[j].count;
+            counter.error += from->counters[j].error;
+        } else {
+            counter.count += from_floor;
+            counter.error += from_floor;
+        }
+        merged[n++] = counter;
+    }
+    for(int j = 0; j < from->counters_size; j++) {
+        int i;
+        for(i = 0; i < into->counters_size && into->counters[i].key != from->counters[j].key; i++);
+        if(i == into->counters_size) {
+            summary_counter_t counter = from->counters[j];
+            counter.count += into_floor;
+            counter.error += into_floor;
+            merged[n++] = counter;
+        }
+    }
+    qsort(merged, n, sizeof(summary_counter_t), summary_counter_compare);
+    into->counters_size = n < SUMMARY_COUNTERS ? n : SUMMARY_COUNTERS;
+    memcpy(into->counters, merged, into->counters_size * sizeof(summary_counter_t));
+}
+
+/**
+ * merge the summary of this thread into the merged one.
+*/
+void summary_release() {
+    summary_t *summary = &summary_thread;
+    pthread_mutex_lock(&summary_mutex);
+    if(summary->results > 0) {
+        if(summary_merged.results == 0 || summary->min < summary_merged.min) {
+            summary_merged.min = summary->min;
+        }
+        if(summary_merged.results == 0 || summary->max > summary_merged.max) {
+            summary_merged.max = summary->max;
+        }
+        summary_merged.results += summary->results;
+        summary_merged.sum += summary->sum;
+        for(int i = 0; i < SUMMARY_BUCKETS; i++) {
+            summary_merged.buckets[i] += summary->buckets[i];
+        }
+        kll_merge(&summary_merged.kll, &summary->kll);
+        summary_counters_merge(&summary_merged, summary);
+    }
+    summary_merged.nans += summary->nans;
+    pthread_mutex_unlock(&summary_mutex);
+    kll_release(&summary->kll);
+    memset(summary, 0, sizeof(summary_t));
+}
+
+/**
+ * write key as it is printed to text, without colours.
+*/
+void summary_format_key(char *text, size_t size, value_t key) {
+    if(number_mode == numbers_decimal) {
+        unsigned long long magnitude = key < 0 ? 0ull - (unsigned long long)key : (unsigned long long)key;
+        unsigned long long unit = decimal_unit;
+        if(decimal_scale == 0) {
+            snprintf(text, size, "%s%llu", key < 0 ? "-" : "", magnitude);
+        } else {
+            snprintf(text, size, "%s%llu.%0*llu", key < 0 ? "-" : "", magnitude / unit, decimal_scale,
+                magnitude % unit);
+        }
+    } else if(number_mode == numbers_dynamic && !value_is_int(key)) {
+        snprintf(text, size, "%.17g", unbox_double(key));
+    } else if(number_mode == numbers_dynamic) {
+        snprintf(text, size, "%lld", unbox_int(key));
+    } else {
+        snprintf(text, size, "%lld", key);
+    }
+}
+
+/**
+ * print the merged summary on stderr.
+*/
+void summary_report() {
+    static const double quantiles[] = {0.01, 0.05, 0.25, 0.5, 0.75, 0.95, 0.99};
+    summary_t *summary = &summary_merged;
+    fprintf(stderr, "--- summary ---\n");
+    fprintf(stderr, "results        %lld\n", summary->results);
+    if(summary->nans > 0) {
+        fprintf(stderr, "nan            %lld\n", summary->nans);
+    }
+    if(summary->results == 0) {
+        return;
+    }
+    fprintf(stderr, "min            %.15g\n", summary->min);
+    fprintf(stderr, "mean           %.15g\n", summary->sum / summary->results);
+    fprintf(stderr, "max            %.15g\n", summary->max);
+    kll_weighted_t *items;
+    int n = kll_sorted(&summary->kll, &items);
+    long long total = 0;
+    for(int i = 0; i < n; i++) {
+        total += items[i].weight;
+    }
+    for(size_t q = 0, i = 0; n > 0 && q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+        long long rank = 0;
+        for(i = 0; i < (size_t)n-1; i++) {
+            rank += items[i].weight;
+            if(rank >= quantiles[q] * total) {
+                break;
+            }
+        }
+        /* room for any %g, not only the quantiles listed */
+        char name[16];
+        snprintf(name, sizeof(name), "p%g", quantiles[q] * 100);
+        fprintf(stderr, "%-14s %.15g\n", name, items[i].x);
+    }
+    free(items);
+    fprintf(stderr, "--- histogram ---\n");
+    for(int i = 0; i < SUMMARY_BUCKETS; i++) {
+        long long count = summary->buckets[i];
+        if(count == 0) {
+            continue;
+        }
+        char range[64];
+        int exponent = i > 2*SUMMARY_EXPONENTS+1 ? i - 3*SUMMARY_EXPONENTS - 2 : 2*SUMMARY_EXPONENTS - i - SUMMARY_EXPONENTS;
+        /* 2^exponent without libm */
+        double high = 1;
+        for(int e = 0; e < exponent; e++) {
+            high *= 2;
+        }
+        for(int e = 0; e > exponent; e--) {
+            high /= 2;
+        }
+        if(i == 2*SUMMARY_EXPONENTS+1) {
+            snprintf(range, sizeof(range), "0");
+        } else if(i > 2*SUMMARY_EXPONENTS+1) {
+            snprintf(range, sizeof(range), exponent == SUMMARY_EXPONENTS ? "[%.15g, inf]" : "[%.15g, %.15g)",
+                exponent == -SUMMARY_EXPONENTS ? 0 : high/2, high);
+        } else {
+            snprintf(range, sizeof(range), exponent == SUMMARY_EXPONENTS ? "[-inf, -%.15g]" : "(-%.15g, -%.15g]",
+                exponent == SUMMARY_EXPONENTS ? high/2 : high, exponent == -SUMMARY_EXPONENTS ? 0 : high/2);
+        }
+        fprintf(stderr, "%-32s %12lld %6.1f%%\n", range, count, 100.0 * count / summary->results);
+    }
+    fprintf(stderr, "--- top results ---\n");
+    fprintf(stderr, "%-32s %12s %12s\n", "result", "count", "overcount");
+    qsort(summary->counters, summary->counters_size, sizeof(summary_counter_t), summary_counter_compare);
+    for(int i = 0; i < summary->counters_size && i < SUMMARY_TOP; i++) {
+        char key[64];
+        summary_format_key(key, sizeof(key), summary->counters[i].key);
+        fprintf(stderr, "%-32s %12lld %12lld\n", key, summary->counters[i].count, summary->counters[i].error);
+    }
+    kll_release(&summary->kll);
+}
+
+/**
+ * print value to stream as a result.
+*/
+void print_value(FILE *stream, value_t value) {
+    if(number_mode == numbers_decimal) {
+        decimal_print(stream, value);
+    } else if(number_mode == numbers_dynamic) {
+        dynamic_print(stream, value);
+    } else {
+        fprintf(stream, "\033[1;32m%d\033[0m.\n", (int)value);
+    }
+}
+
+/**
+ * Running aggregates.
+ *
+ * --scan=sum|min|max prints for every line the sum, least or greatest of
+ * the results up to and including it instead of its own result. A line
+ * that fails leaves the aggregate as it was and is flagged with a leading
+ * "! ". Sums are kept exact in 128 bits: ints print them wrapped like the
+ * numbers they add and decimals as an overflow once they leave 64 bits.
+ * Min and max compare results as they print, so every aggregate is
+ * associative and the workers scan in two passes. Evaluating a chunk records its results and reduces them to a
+ * partial aggregate. The aggregate before a chunk is that of the chunk
+ * before it combined with its partial, published in chunk order as soon as
+ * each chunk's evaluation is done; a worker takes it as the carry of its
+ * chunk, publishes the carry with its own partial, and prints its lines
+ * from the carry. The output is the same to the bit as evaluating in order.
+ * Big integers and doubles would need their own arithmetic, --dynamic is
+ * not supported.
+*/
+enum scan {
+    scan_none,
+    scan_sum,
+    scan_min,
+    scan_max
+};
+
+static const char *const scan_name[] = {
+    [scan_sum] = "sum",
+    [scan_min] = "min",
+    [scan_max] = "max"
+};
+
+typedef struct scan_entry {
+    value_t value;
+    /* the line failed, value is not a result */
+    int failed;
+} scan_entry_t;
+
+typedef struct scan_chunk {
+    /* the lines of a chunk with a result or an error, in order */
+    scan_entry_t *entries;
+    size_t size;
+    size_t capacity;
+    /* aggregate of the chunk's results, if it had any */
+    __int128 partial;
+    int has_partial;
+} scan_chunk_t;
+
+enum scan option_scan = scan_none;
+/*
+ * aggregate of the results so far: those of the main thread, or those of
+ * the chunks before chunk scan_published.
+*/
+__int128 scan_total;
+int scan_has_total;
+long long scan_published = 0;
+pthread_mutex_t scan_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t scan_changed = PTHREAD_COND_INITIALIZER;
+/* where a worker records the lines of its chunk, NULL on the main thread */
+_Thread_local scan_chunk_t *scan_chunk;
+
+void scan_combine(__int128 *total, int *has_total, __int128 value) {
+    if(!*has_total) {
+        *total = value;
+        *has_total = 1;
+    } else if(option_scan == scan_sum) {
+        *total += value;
+    } else if(option_scan == scan_min ? value < *total : value > *total) {
+        *total = value;
+    }
+}
+
+/**
+ * print the aggregate of a line, flagged if it failed.
+*/
+void scan_print(FILE *stream, __int128 total, int has_total, int failed) {
+    if(failed) {
+        fputs("! ", stream);
+    }
+    if(has_total && number_mode == numbers_decimal && (total > LLONG_MAX || total < LLONG_MIN)) {
+        /* a running balance is never wrapped */
+        fprintf(stream, "\033[1;31moverflow\033[0m.\n");
+    } else if(has_total) {
+        print_value(stream, (value_t)total);
+    } else {
+        /* min and max of no results yet */
+        fprintf(stream, "\033[1;32mnone\033[0m.\n");
+    }
+}
+
+/**
+ * account for the result of a line, or its failure: printed at once on
+ * the main thread, recorded in the chunk on a worker.
+*/
+void scan_add(value_t value, int failed) {
+    if(number_mode == numbers_int) {
+        /* ints are added and compared as they print */
+        value = (int)value;
+    }
+    scan_chunk_t *chunk = scan_chunk;
+    if(chunk == NULL) {
+        if(!failed) {
+            scan_combine(&scan_total, &scan_has_total, value);
+        }
+        scan_print(result_stream, scan_total, scan_has_total, failed);
+        return;
+    }
+    if(chunk->size == chunk->capacity) {
+        size_t capacity = chunk->capacity ? 2*chunk->capacity : 1024;
+        scan_entry_t *entries = realloc(chunk->entries, capacity * sizeof(scan_entry_t));
+        if(entries == NULL) {
+            report_memory_budget_exceeded();
+            return;
+        }
+        chunk->entries = entries;
+        chunk->capacity = capacity;
+    }
+    chunk->entries[chunk->size++] = (scan_entry_t){value, failed};
+    if(!failed) {
+        scan_combine(&chunk->partial, &chunk->has_partial, value);
+    }
+}
+
+/**
+ * second pass over chunk number index: wait for the aggregate before it,
+ * publish it with the chunk's partial and print the chunk's lines to stream.
+*/
+void scan_chunk_finish(scan_chunk_t *chunk, long long index, FILE *stream) {
+    pthread_mutex_lock(&scan_mutex);
+    while(scan_published != index) {
+        pthread_cond_wait(&scan_changed, &scan_mutex);
+    }
+    __int128 carry = scan_total;
+    int has_carry = scan_has_total;
+    if(chunk->has_partial) {
+        scan_combine(&scan_total, &scan_has_total, chunk->partial);
+    }
+    scan_published++;
+    pthread_cond_broadcast(&scan_changed);
+    pthread_mutex_unlock(&scan_mutex);
+    for(size_t i = 0; i < chunk->size; i++) {
+        if(!chunk->entries[i].failed) {
+            scan_combine(&carry, &has_carry, chunk->entries[i].value);
+        }
+        scan_print(stream, carry, has_carry, chunk->entries[i].failed);
+    }
+    chunk->size = 0;
+    chunk->has_partial = 0;
+}
+
+/* value of the last line evaluated on this thread, if it had one */
+_Thread_local value_t engine_result;
+_Thread_local int engine_has_result;
+
+void print_result(value_t value) {
+    if(option_scan) {
+        scan_add(value, 0);
+    } else {
+        print_value(result_stream, value);
+    }
+    if(option_summary) {
+        summary_add(value);
+    }
+}
+
+/**
+ * print the result left on top of the callstack.
+*/
+int execution_engine_report_result() {
+    if(callstack_is_empty()) {
+        /* Things have gone really wrong !!!*/
+        report_error(error_stack_underflow, 0, "\033[1;31mRuntimeError: StackUnderflow\033[0m.\n");
+        return FAILURE;
+    }
+    engine_result = callstack_pop();
+    engine_has_result = 1;
+    print_result(engine_result);
+    return SUCCESS;
+}
+
+/**
+ * Begin the execution of AST tree.
+ * 
+ * When the xecution is done there should be a single element at the top
+ * of the callstack which is the result of calculations.
+*/
+int execution_engine(ast_t *tree) {
+    int status = SUCCESS;
+    if(tree != NULL) {
+        status = execution_engine_process_ast_node(tree);
+        if(status == SUCCESS) {
+            status = execution_engine_report_result();
+        }
+    }
+    callstack_clear();
+    return status;
+}
+
+/**
+ * Type pass.
+ *
+ * With --dynamic every operation checks the tags of its operands, and the
+ * result for overflow, although the types of most expressions can be
+ * known before they run. After parsing, a pass over the flat ast works out
+ * bottom-up what each node yields: a small int within a known range, a
+ * double, or unknown (a big integer, or a quotient of ints that may be
+ * either). Operators whose operands are known get a kernel that checks
+ * nothing: ints whose result range fits a small int, and doubles, each
+ * operand converted the way its type says. The others keep the generic
+ * dispatch of execution_engine_do_operation.
+*/
+#define KERNEL_GENERIC 0
+#define KERNEL_INT 1
+#define KERNEL_DOUBLE 2
+/* with KERNEL_DOUBLE, the operand is a small int to convert */
+#define KERNEL_LEFT_INT 4
+#define KERNEL_RIGHT_INT 8
+
+enum static_type {
+    static_unknown,
+    static_int,
+    static_double
+};
+
+typedef struct node_type {
+    enum static_type type;
+    /* range of a static_int */
+    long long low;
+    long long high;
+} node_type_t;
+
+/* types of the operands not consumed yet, a stack as deep as the ast */
+static _Thread_local node_type_t *type_stack;
+static _Thread_local size_t type_stack_capacity;
+
+/* pick kernels, select the generic dispatch everywhere */
+int option_typed_dispatch = 1;
+
+/**
+ * the type operator yields for operands of types left and right, and the
+ * kernel for it.
+*/
+node_type_t type_of_operation(enum ast_type operator, node_type_t left, node_type_t right, int *kernel) {
+    node_type_t result = {static_unknown, 0, 0};
+    *kernel = KERNEL_GENERIC;
+    if(left.type == static_double || right.type == static_double) {
+        /* a double makes the result a double, whatever the other is */
+        result.type = static_double;
+        if(left.type != static_unknown && right.type != static_unknown) {
+            *kernel = KERNEL_DOUBLE | (left.type == static_int ? KERNEL_LEFT_INT : 0) |
+                (right.type == static_int ? KERNEL_RIGHT_INT : 0);
+        }
+    } else if(left.type == static_int && right.type == static_int && operator != ast_div) {
+        __int128 low, high;
+        if(operator == ast_mul) {
+            __int128 products[] = {
+                (__int128)left.low * right.low, (__int128)left.low * right.high,
+                (__int128)left.high * right.low, (__int128)left.high * right.high
+            };
+            low = high = products[0];
+            for(int i = 1; i < 4; i++) {
+                low = products[i] < low ? products[i] : low;
+                high = products[i] > high ? products[i] : high;
+            }
+        } else if(operator == ast_add) {
+            low = (__int128)left.low + right.low;
+            high = (__int128)left.high + right.high;
+        } else {
+            low = (__int128)left.low - right.high;
+            high = (__int128)left.high - right.low;
+        }
+        if(low >= SMALL_INT_MIN && high <= SMALL_INT_MAX) {
+            result = (node_type_t){static_int, (long long)low, (long long)high};
+            *kernel = KERNEL_INT;
+        }
+    }
+    return result;
+}
+
+/**
+ * infer the types of flat and store the kernel of every operator.
+*/
+int type_pass(ast_flat_t *flat) {
+    if(!option_typed_dispatch) {
+        return SUCCESS;
+    }
+    if((size_t)flat->size > type_stack_capacity) {
+        size_t capacity = flat->capacity;
+        node_type_t *resized = capacity * sizeof(node_type_t) <= memory_budget ?
+            realloc(type_stack, capacity * sizeof(node_type_t)) : NULL;
+        if(resized == NULL) {
+            report_memory_budget_exceeded();
+            return FAILURE;
+        }
+        type_stack = resized;
+        type_stack_capacity = capacity;
+    }
+    size_t size = 0;
+    for(int i = 0; i < flat->size; i++) {
+        ast_flat_node_t *node = &flat->nodes[i];
+        if(node->type == ast_num) {
+            value_t value = ast_flat_leaf(node);
+            node_type_t *type = &type_stack[size++];
+            type->type = value_is_int(value) ? static_int :
+                value_is_double(value) ? static_double : static_unknown;
+            type->low = type->high = type->type == static_int ? unbox_int(value) : 0;
+            i += node->wide;
+        } else {
+            int kernel;
+            size--;
+            type_stack[size-1] = type_of_operation(node->type, type_stack[size-1], type_stack[size], &kernel);
+            node->value = kernel;
+        }
+    }
+    return SUCCESS;
+}
+
+/**
+ * perform operator on the two topmost stack elements with a kernel of the
+ * type pass, the operand types are known so only division by zero is
+ * checked.
+*/
+int execution_engine_do_kernel(enum ast_type operator, int kernel) {
+    value_t right_operand = callstack_pop();
+    value_t left_operand = callstack_pop();
+    if(kernel == KERNEL_INT) {
+        long long x = unbox_int(left_operand), y = unbox_int(right_operand);
+        switch(operator) {
+            case ast_add: x += y; break;
+            case ast_sub: x -= y; break;
+            case ast_mul: x *= y; break;
+            default: break;
+        }
+        callstack_push(box_int(x));
+        return SUCCESS;
+    }
+    double x = kernel & KERNEL_LEFT_INT ? (double)unbox_int(left_operand) : unbox_double(left_operand);
+    double y = kernel & KERNEL_RIGHT_INT ? (double)unbox_int(right_operand) : unbox_double(right_operand);
+    switch(operator) {
+        case ast_add: x += y; break;
+        case ast_sub: x -= y; break;
+        case ast_mul: x *= y; break;
+        case ast_div:
+            if(y == 0) {
+                report_division_by_zero();
+                return FAILURE;
+            }
+            x /= y;
+            break;
+        default: break;
+    }
+    callstack_push(box_double(x));
+    return SUCCESS;
+}
+
+/**
+ * Execute a flat AST.
+ *
+ * Nodes are in post-order so a single pass over them visits operands
+ * before their operator, exactly like the depth first traversal.
+*/
+int execution_engine_flat(ast_flat_t *flat) {
+    int status = SUCCESS;
+    engine_nodes += flat->size;
+    for(int i = 0; i < flat->size && status == SUCCESS; i++) {
+        ast_flat_node_t *node = &flat->nodes[i];
+        if(node->type == ast_num) {
+            if(callstack_reserve() == FAILURE) {
+                report_memory_budget_exceeded();
+                status = FAILURE;
+            } else {
+                callstack_push(ast_flat_leaf(node));
+            }
+            /* the high half of a wide leaf isn't a node of its own */
+            engine_nodes -= node->wide;
+            i += node->wide;
+        } else if(node->value != KERNEL_GENERIC) {
+            status = execution_engine_do_kernel(node->type, node->value);
+        } else {
+            status = execution_engine_do_operation(node->type);
+        }
+    }
+    if(status == SUCCESS && flat->size > 0) {
+        status = execution_engine_report_result();
+    }
+    callstack_clear();
+    return status;
+}
+
+/**
+ * Hardware counters.
+ *
+ * --stats=hw counts cycles, instructions, branch misses, L1 data cache
+ * read misses and last level cache misses in user space with
+ * perf_event_open, and charges them to the stage the evaluating thread is
+ * in: reading input, tokenizing, parsing, executing (result formatting
+ * included) or anything else. Each thread that evaluates opens its own
+ * group the first time it enters a stage and reads it at every change of
+ * stage; its counts join the report when it releases its buffers. Events
+ * the cpu or the kernel refuse are left out, and when none can be opened,
+ * in containers that deny perf events for example, the report says why.
+*/
+enum hw_event {
+    hw_cycles,
+    hw_instructions,
+    hw_branch_misses,
+    hw_l1d_misses,
+    hw_llc_misses,
+    hw_events
+};
+
+/* what an evaluating thread is doing, for --stats=hw and --slow-lines */
+enum stage {
+    stage_read,
+    stage_tokenize,
+    stage_parse,
+    stage_execute,
+    stage_other,
+    stages
+};
+
+const char *hw_event_name[hw_events] = {"cycles", "instructions", "branch-misses", "L1d-misses", "LLC-misses"};
+const char *stage_name[stages] = {"read", "tokenize", "parse", "execute", "other"};
+
+typedef struct hw_counters {
+    /* 0 before the group is opened, 1 counting, -1 if no event could be opened */
+    int state;
+    /* fd of the first event opened, reads return the whole group */
+    int leader;
+    int fds[hw_events];
+    /* position of each event in a group read, -1 if it is not counted */
+    int slots[hw_events];
+    int opened;
+    enum stage stage;
+    unsigned long long last[hw_events];
+    unsigned long long counts[stages][hw_events];
+    /* nanoseconds the group was enabled, and scheduled on the pmu */
+    unsigned long long enabled;
+    unsigned long long running;
+} hw_counters_t;
+
+/* count hardware events per stage for the stats report */
+int option_stats_hw = 0;
+static _Thread_local hw_counters_t hw_thread;
+/* counts of the threads that finished, events counted by any of them */
+hw_counters_t hw_totals;
+int hw_counted[hw_events];
+long long hw_nodes = 0;
+/* errno of the last event that failed to open on a thread without any */
+int hw_error = 0;
+pthread_mutex_t hw_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * read the group of hw into values, SUCCESS if it could be read.
+*/
+int hw_counters_read(hw_counters_t *hw, unsigned long long *values) {
+    /* PERF_FORMAT_GROUP: nr, time enabled, time running, then the values */
+    unsigned long long data[3 + hw_events];
+    if(read(hw->leader, data, sizeof(data)) < (ssize_t)((3 + hw->opened) * sizeof(data[0]))) {
+        return FAILURE;
+    }
+    hw->enabled = data[1];
+    hw->running = data[2];
+    for(int e = 0; e < hw_events; e++) {
+        if(hw->slots[e] != -1) {
+            values[e] = data[3 + hw->slots[e]];
+        }
+    }
+    return SUCCESS;
+}
+
+/**
+ * open and start the group of events counted on this thread.
+*/
+void hw_counters_open(hw_counters_t *hw) {
+    static const struct {
+        unsigned type;
+        unsigned long long config;
+    } events[hw_events] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8 |
+            PERF_COUNT_HW_CACHE_RESULT_MISS << 16},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    };
+    int error = 0;
+    hw->opened = 0;
+    hw->leader = -1;
+    for(int e = 0; e < hw_events; e++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[e].type;
+        attr.config = events[e].config;
+        /* the leader starts the whole group once it is complete */
+        attr.disabled = hw->leader == -1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        hw->fds[e] = syscall(SYS_perf_event_open, &attr, 0, -1, hw->leader, PERF_FLAG_FD_CLOEXEC);
+        if(hw->fds[e] == -1) {
+            hw->slots[e] = -1;
+            error = errno;
+            continue;
+        }
+        if(hw->leader == -1) {
+            hw->leader = hw->fds[e];
+        }
+        hw->slots[e] = hw->opened++;
+    }
+    if(hw->leader == -1 || ioctl(hw->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) == -1 ||
+        hw_counters_read(hw, hw->last) == FAILURE) {
+        if(hw->leader != -1) {
+            error = errno;
+        }
+        for(int e = 0; e < hw_events; e++) {
+            if(hw->slots[e] != -1) {
+                close(hw->fds[e]);
+                hw->slots[e] = -1;
+            }
+        }
+        pthread_mutex_lock(&hw_mutex);
+        hw_error = error;
+        pthread_mutex_unlock(&hw_mutex);
+        hw->state = -1;
+        return;
+    }
+    hw->state = 1;
+}
+
+/**
+ * charge the events since the last change of stage to the current one and
+ * enter stage.
+*/
+void hw_stage_enter(enum stage stage) {
+    hw_counters_t *hw = &hw_thread;
+    if(hw->state == 0) {
+        hw_counters_open(hw);
+    } else if(hw->state == 1) {
+        unsigned long long now[hw_events];
+        if(hw_counters_read(hw, now) == SUCCESS) {
+            for(int e = 0; e < hw_events; e++) {
+                if(hw->slots[e] != -1) {
+                    hw->counts[hw->stage][e] += now[e] - hw->last[e];
+                    hw->last[e] = now[e];
+                }
+            }
+        }
+    }
+    hw->stage = stage;
+}
+
+/**
+ * add the counts of this thread to the totals and close its group.
+*/
+void hw_counters_release() {
+    hw_counters_t *hw = &hw_thread;
+    if(!option_stats_hw) {
+        return;
+    }
+    hw_stage_enter(stage_other);
+    pthread_mutex_lock(&hw_mutex);
+    hw_nodes += engine_nodes;
+    if(hw->state == 1) {
+        for(int e = 0; e < hw_events; e++) {
+            if(hw->slots[e] == -1) {
+                continue;
+            }
+            hw_counted[e] = 1;
+            for(int stage = 0; stage < stages; stage++) {
+                hw_totals.counts[stage][e] += hw->counts[stage][e];
+            }
+            close(hw->fds[e]);
+        }
+        hw_totals.enabled += hw->enabled;
+        hw_totals.running += hw->running;
+    }
+    pthread_mutex_unlock(&hw_mutex);
+    memset(hw, 0, sizeof(*hw));
+    engine_nodes = 0;
+}
+
+/**
+ * Slow lines.
+ *
+ * --slow-lines=N times every line and keeps the N slowest in a min-heap on
+ * their time, so a line faster than all of them costs one comparison. Each
+ * is kept with its number, size, tokens, nodes and the time it spent in
+ * each stage. Times are read from the time stamp counter at every change
+ * of stage and converted to microseconds against the monotonic clock when
+ * the list is printed at exit; without the x86 kernels the ticks are the
+ * monotonic clock's nanoseconds. Like diagnostics, workers keep the slow
+ * lines of a chunk or a file numbered from its first line and the main
+ * thread merges them.
+*/
+typedef struct slow_line {
+    long long line;
+    /* file the line is from when there are several, NULL otherwise */
+    const char *source;
+    int bytes;
+    /* -1 when the parallel front end tokenized the line */
+    int tokens;
+    int nodes;
+    unsigned long long ticks;
+    unsigned long long stage_ticks[stages];
+} slow_line_t;
+
+typedef struct slow_lines {
+    /* option_slow_lines entries, allocated with the first line */
+    slow_line_t *heap;
+    int size;
+} slow_lines_t;
+
+/* lines to keep, 0 if they are not timed */
+int option_slow_lines = 0;
+/* lines of the main thread, and those merged from the workers */
+slow_lines_t main_slow_lines;
+/* where the current thread keeps its slow lines */
+_Thread_local slow_lines_t *slow_lines;
+/**
+ * ticks of the time stamp counter, or nanoseconds of the monotonic clock
+ * where there is none to read.
+*/
+static inline unsigned long long slow_lines_now() {
+#ifdef CALCULATOR_X86_KERNELS
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+/* ticks and monotonic clock when timing started */
+unsigned long long slow_lines_ticks_start;
+struct timespec slow_lines_clock_start;
+/* stage of this thread, when it began, and the ticks of the current line */
+static _Thread_local enum stage slow_lines_stage = stage_other;
+static _Thread_local unsigned long long slow_lines_stage_start;
+static _Thread_local unsigned long long slow_lines_ticks[stages];
+
+/**
+ * keep line if it is one of the option_slow_lines slowest of lines.
+*/
+void slow_lines_offer(slow_lines_t *lines, const slow_line_t *line) {
+    slow_line_t *heap = lines->heap;
+    if(lines->size == option_slow_lines && line->ticks <= heap[0].ticks) {
+        return;
+    }
+    if(heap == NULL && (heap = lines->heap = malloc(option_slow_lines * sizeof(slow_line_t))) == NULL) {
+        return;
+    }
+    int i;
+    if(lines->size < option_slow_lines) {
+        /* sift up from the new leaf */
+        for(i = lines->size++; i > 0 && heap[(i-1)/2].ticks > line->ticks; i = (i-1)/2) {
+            heap[i] = heap[(i-1)/2];
+        }
+    } else {
+        /* replace the fastest, sift down from the root */
+        for(i = 0; 2*i+1 < lines->size; ) {
+            int child = 2*i+1;
+            if(child+1 < lines->size && heap[child+1].ticks < heap[child].ticks) {
+                child++;
+            }
+            if(heap[child].ticks >= line->ticks) {
+                break;
+            }
+            heap[i] = heap[child];
+            i = child;
+        }
+    }
+    heap[i] = *line;
+}
+
+/**
+ * charge the ticks since the last change of stage to the current one and
+ * enter stage.
+*/
+void slow_lines_stage_enter(enum stage stage) {
+    unsigned long long now = slow_lines_now();
+    if(slow_lines_stage_start != 0) {
+        slow_lines_ticks[slow_lines_stage] += now - slow_lines_stage_start;
+    }
+    slow_lines_stage_start = now;
+    slow_lines_stage = stage;
+}
+
+/**
+ * offer the line just evaluated, of bytes, tokens and nodes, and start
+ * timing the next.
+*/
+void slow_lines_record(int bytes, int tokens, int nodes) {
+    slow_line_t line = {diagnostic_line, NULL, bytes, tokens, nodes, 0, {0}};
+    for(int stage = 0; stage < stage_other; stage++) {
+        line.stage_ticks[stage] = slow_lines_ticks[stage];
+        line.ticks += slow_lines_ticks[stage];
+    }
+    if(slow_lines == &main_slow_lines) {
+        line.source = diagnostics_source;
+    }
+    memset(slow_lines_ticks, 0, sizeof(slow_lines_ticks));
+    slow_lines_offer(slow_lines, &line);
+}
+
+/**
+ * move the slow lines of a chunk or a file, numbered from line_base, to
+ * the main list. Only the main thread merges.
+*/
+void slow_lines_merge(slow_lines_t *lines, long long line_base, const char *source) {
+    for(int i = 0; i < lines->size; i++) {
+        slow_line_t line = lines->heap[i];
+        line.line += line_base;
+        line.source = source;
+        slow_lines_offer(&main_slow_lines, &line);
+    }
+    lines->size = 0;
+}
+
+int slow_line_compare(const void *a, const void *b) {
+    const slow_line_t *x = a, *y = b;
+    return x->ticks < y->ticks ? 1 : x->ticks > y->ticks ? -1 : 0;
+}
+
+/**
+ * print the slow lines, slowest first.
+*/
+void slow_lines_report() {
+#ifdef CALCULATOR_X86_KERNELS
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    unsigned long long ticks = slow_lines_now() - slow_lines_ticks_start;
+    double nanoseconds = (now.tv_sec - slow_lines_clock_start.tv_sec) * 1e9 +
+        (now.tv_nsec - slow_lines_clock_start.tv_nsec);
+    double us_per_tick = ticks > 0 ? nanoseconds / ticks / 1000 : 0;
+#else
+    /* the ticks are nanoseconds already */
+    double us_per_tick = 1e-3;
+#endif
+    qsort(main_slow_lines.heap, main_slow_lines.size, sizeof(slow_line_t), slow_line_compare);
+    fprintf(stderr, "--- slow lines ---\n");
+    fprintf(stderr, "%-20s %10s %8s %8s %12s", "line", "bytes", "tokens", "nodes", "total us");
+    for(int stage = 0; stage < stage_other; stage++) {
+        fprintf(stderr, " %10s", stage_name[stage]);
+    }
+    fprintf(stderr, "\n");
+    for(int i = 0; i < main_slow_lines.size; i++) {
+        slow_line_t *line = &main_slow_lines.heap[i];
+        char where[4096];
+        snprintf(where, sizeof(where), "%s%s%lld", line->source ? line->source : "", line->source ? ":" : "",
+            line->line);
+        fprintf(stderr, "%-20s %10d ", where, line->bytes);
+        if(line->tokens < 0) {
+            fprintf(stderr, "%8s", "-");
+        } else {
+            fprintf(stderr, "%8d", line->tokens);
+        }
+        fprintf(stderr, " %8d %12.1f", line->nodes, line->ticks * us_per_tick);
+        for(int stage = 0; stage < stage_other; stage++) {
+            fprintf(stderr, " %10.1f", line->stage_ticks[stage] * us_per_tick);
+        }
+        fprintf(stderr, "\n");
+    }
+    free(main_slow_lines.heap);
+}
+
+static inline void stage_enter(enum stage stage) {
+    if(option_slow_lines) {
+        slow_lines_stage_enter(stage);
+    }
+    if(option_stats_hw) {
+        hw_stage_enter(stage);
+    }
+}
+
+/**
+ * Session snapshots.
+ *
+ * --session=FILE keeps the values of the lines evaluated in a file, so a
+ * restarted repl or batch run answers the lines it has seen before without
+ * lexing, parsing or executing them. The language has no variables or
+ * functions, a line's value is all the state there is; lines that fail,
+ * lines longer than SESSION_LINE_MAX and values on the heap (big integers)
+ * are evaluated every time.
+ *
+ * The file is a header, an open addressing table of buckets and the
+ * entries they point to, every reference an offset from the start of the
+ * file. It is mapped read-only and used where it lands, so loading costs an
+ * mmap and the checks of the header: magic, version, size and a hash of the
+ * options values depend on. A snapshot that fails them is ignored with a
+ * warning and replaced at exit; a file without the magic is not a snapshot
+ * and is never replaced, the run stops instead. Lines evaluated meanwhile
+ * are added to a
+ * table per thread, merged when the thread releases its buffers, and
+ * written at exit with the mapped ones to FILE.tmp, renamed over FILE.
+*/
+#define SESSION_MAGIC "BODMASSN"
+#define SESSION_VERSION 1
+/* longer lines are not kept */
+#define SESSION_LINE_MAX 1024
+/* entries a snapshot may hold */
+#define SESSION_ENTRIES_MAX (1 << 20)
+/* bytes of an entry for a line of size bytes, entries are 8 byte aligned */
+#define SESSION_ENTRY_SIZE(size) ((offsetof(session_entry_t, line) + (size) + 7) & ~(size_t)7)
+
+typedef struct session_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    /* options the values depend on */
+    uint64_t options_hash;
+    uint64_t file_size;
+    /* a power of two of offsets of entries, 0 for none */
+    uint64_t buckets;
+    uint64_t buckets_offset;
+    uint64_t entries;
+    /* over every run of the session: runs, lines looked up, answered */
+    uint64_t runs;
+    uint64_t lines;
+    uint64_t hits;
+} session_header_t;
+
+typedef struct session_entry {
+    uint64_t hash;
+    value_t value;
+    uint32_t size;
+    char line[];
+} session_entry_t;
+
+/* entries added during the run, open addressing on their hash */
+typedef struct session_table {
+    session_entry_t **slots;
+    size_t capacity;
+    size_t size;
+} session_table_t;
+
+/* the snapshot file, NULL to run without one */
+const char *option_session = NULL;
+/* the snapshot mapped at startup, NULL when starting cold */
+const char *session_map = NULL;
+size_t session_map_size = 0;
+/* entries of the threads that finished, lines they looked up and found */
+session_table_t session_merged;
+long long session_lines = 0;
+long long session_hits = 0;
+pthread_mutex_t session_mutex = PTHREAD_MUTEX_INITIALIZER;
+static _Thread_local session_table_t session_added;
+static _Thread_local long long session_thread_lines;
+static _Thread_local long long session_thread_hits;
+
+/* FNV-1a */
+uint64_t session_hash(const char *data, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for(size_t i = 0; i < size; i++) {
+        hash = (hash ^ (unsigned char)data[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/**
+ * hash of what a value means: the format and the number options.
+*/
+uint64_t session_options_hash() {
+    uint64_t options[] = {SESSION_VERSION, sizeof(value_t), number_mode, decimal_scale, decimal_rounding};
+    return session_hash((const char *)options, sizeof(options));
+}
+
+/**
+ * the entry of line in the mapped snapshot, NULL if it has none.
+*/
+const session_entry_t *session_map_find(uint64_t hash, const char *line, int size) {
+    const session_header_t *header = (const session_header_t *)session_map;
+    const uint64_t *buckets = (const uint64_t *)(session_map + header->buckets_offset);
+    uint64_t mask = header->buckets - 1;
+    for(uint64_t i = hash & mask, probes = 0; probes < header->buckets; i = (i+1) & mask, probes++) {
+        uint64_t offset = buckets[i];
+        if(offset == 0 || offset % 8 != 0 || offset > session_map_size - SESSION_ENTRY_SIZE(0)) {
+            /* empty, or not pointing inside the file */
+            return NULL;
+        }
+        const session_entry_t *entry = (const session_entry_t *)(session_map + offset);
+        if(entry->hash == hash && entry->size == (uint32_t)size &&
+            SESSION_ENTRY_SIZE(size) <= session_map_size - offset && !memcmp(entry->line, line, size)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * the slot of line in table, or the empty one it would take.
+*/
+session_entry_t **session_table_slot(session_table_t *table, uint64_t hash, const char *line, int size) {
+    size_t mask = table->capacity - 1;
+    for(size_t i = hash & mask;; i = (i+1) & mask) {
+        session_entry_t *entry = table->slots[i];
+        if(entry == NULL ||
+            (entry->hash == hash && entry->size == (uint32_t)size && !memcmp(entry->line, line, size))) {
+            return &table->slots[i];
+        }
+    }
+}
+
+/**
+ * add entry to table unless it has its line, SUCCESS if table owns it.
+*/
+int session_table_insert(session_table_t *table, session_entry_t *entry) {
+    if(table->size >= table->capacity / 2) {
+        if(table->size >= SESSION_ENTRIES_MAX) {
+            return FAILURE;
+        }
+        size_t capacity = table->capacity ? table->capacity*2 : 64;
+        session_entry_t **slots = calloc(capacity, sizeof(session_entry_t *));
+        if(slots == NULL) {
+            return FAILURE;
+        }
+        session_table_t grown = {slots, capacity, table->size};
+        for(size_t i = 0; i < table->capacity; i++) {
+            session_entry_t *moved = table->slots[i];
+            if(moved != NULL) {
+                *session_table_slot(&grown, moved->hash, moved->line, moved->size) = moved;
+            }
+        }
+        free(table->slots);
+        *table = grown;
+    }
+    session_entry_t **slot = session_table_slot(table, entry->hash, entry->line, entry->size);
+    if(*slot != NULL) {
+        return FAILURE;
+    }
+    *slot = entry;
+    table->size++;
+    return SUCCESS;
+}
+
+/**
+ * map the snapshot at path, starting cold if there is none or it does not
+ * fit this run. Fails if path is a file other than a snapshot.
+*/
+int session_open(const char *path) {
+    const char *reason = NULL;
+    struct stat st;
+    char magic[8];
+    int fd = open(path, O_RDONLY);
+    if(fd == -1) {
+        if(errno != ENOENT) {
+            fprintf(stderr, "%s: %s, starting a new session.\n", path, strerror(errno));
+        }
+        return SUCCESS;
+    }
+    if(fstat(fd, &st) == -1) {
+        perror(path);
+        close(fd);
+        return FAILURE;
+    }
+    if(st.st_size < 8 || pread(fd, magic, 8, 0) != 8 || memcmp(magic, SESSION_MAGIC, 8) != 0) {
+        /* someone else's file, it is not ours to replace */
+        fprintf(stderr, "%s: not a session snapshot, leaving it as it is.\n", path);
+        close(fd);
+        return FAILURE;
+    }
+    if((size_t)st.st_size < sizeof(session_header_t)) {
+        reason = "truncated or corrupt";
+    } else if((session_map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+        session_map = NULL;
+        reason = strerror(errno);
+    }
+    close(fd);
+    if(session_map != NULL) {
+        const session_header_t *header = (const session_header_t *)session_map;
+        session_map_size = st.st_size;
+        if(header->version != SESSION_VERSION || header->header_size != sizeof(session_header_t)) {
+            reason = "written by another version";
+        } else if(header->options_hash != session_options_hash()) {
+            reason = "written with other number options";
+        } else if(header->file_size != session_map_size || header->buckets == 0 ||
+            (header->buckets & (header->buckets-1)) != 0 || header->buckets_offset % 8 != 0 ||
+            header->buckets > session_map_size / 8 ||
+            header->buckets_offset > session_map_size - header->buckets * 8) {
+            reason = "truncated or corrupt";
+        }
+    }
+    if(reason != NULL) {
+        fprintf(stderr, "%s: %s, starting a new session.\n", path, reason);
+        if(session_map != NULL) {
+            munmap((void *)session_map, session_map_size);
+            session_map = NULL;
+        }
+    }
+    return SUCCESS;
+}
+
+/**
+ * the value of line if the session has it, SUCCESS if found.
+*/
+int session_lookup(const char *line, int size, value_t *value) {
+    uint64_t hash = session_hash(line, size);
+    const session_entry_t *entry = NULL;
+    session_thread_lines++;
+    if(session_map != NULL) {
+        entry = session_map_find(hash, line, size);
+    }
+    if(entry == NULL && session_added.size > 0) {
+        entry = *session_table_slot(&session_added, hash, line, size);
+    }
+    if(entry == NULL) {
+        return FAILURE;
+    }
+    session_thread_hits++;
+    *value = entry->value;
+    return SUCCESS;
+}
+
+/**
+ * keep the value of line for the rest of the session.
+*/
+void session_add(const char *line, int size, value_t value) {
+    if(number_mode == numbers_dynamic && value_is_big(value)) {
+        /* it points into memory freed after the line */
+        return;
+    }
+    session_entry_t *entry = malloc(offsetof(session_entry_t, line) + size);
+    if(entry == NULL) {
+        return;
+    }
+    entry->hash = session_hash(line, size);
+    entry->value = value;
+    entry->size = size;
+    memcpy(entry->line, line, size);
+    if(session_table_insert(&session_added, entry) != SUCCESS) {
+        free(entry);
+    }
+}
+
+/**
+ * merge the lines this thread added into the session.
+*/
+void session_release() {
+    pthread_mutex_lock(&session_mutex);
+    for(size_t i = 0; i < session_added.capacity; i++) {
+        session_entry_t *entry = session_added.slots[i];
+        if(entry != NULL && session_table_insert(&session_merged, entry) != SUCCESS) {
+            free(entry);
+        }
+    }
+    session_lines += session_thread_lines;
+    session_hits += session_thread_hits;
+    pthread_mutex_unlock(&session_mutex);
+    free(session_added.slots);
+    memset(&session_added, 0, sizeof(session_added));
+    session_thread_lines = session_thread_hits = 0;
+}
+
+/**
+ * write the mapped entries and the merged ones to the snapshot, returns
+ * the exit status.
+*/
+int session_save(const char *path) {
+    const session_header_t *old = (const session_header_t *)session_map;
+    size_t mapped = old ? old->buckets : 0;
+    size_t count = 0;
+    if(old != NULL && session_merged.size == 0) {
+        /* nothing new, only the totals of the header change */
+        session_header_t header = *old;
+        header.runs++;
+        header.lines += session_lines;
+        header.hits += session_hits;
+        munmap((void *)session_map, session_map_size);
+        session_map = NULL;
+        int fd = open(path, O_WRONLY);
+        if(fd == -1 || pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+            perror(path);
+            if(fd != -1) {
+                close(fd);
+            }
+            return FAILURE;
+        }
+        return close(fd) == 0 ? SUCCESS : FAILURE;
+    }
+    const session_entry_t **entries = malloc((mapped + session_merged.size + 1) * sizeof(session_entry_t *));
+    if(entries == NULL) {
+        perror("malloc");
+        return FAILURE;
+    }
+    for(size_t i = 0; i < mapped; i++) {
+        uint64_t offset = ((const uint64_t *)(session_map + old->buckets_offset))[i];
+        const session_entry_t *entry = (const session_entry_t *)(session_map + offset);
+        /* entries checked like session_map_find does */
+        if(offset != 0 && offset % 8 == 0 && offset <= session_map_size - SESSION_ENTRY_SIZE(0) &&
+            SESSION_ENTRY_SIZE(entry->size) <= session_map_size - offset) {
+            entries[count++] = entry;
+        }
+    }
+    for(size_t i = 0; i < session_merged.capacity && count < SESSION_ENTRIES_MAX; i++) {
+        if(session_merged.slots[i] != NULL) {
+            entries[count++] = session_merged.slots[i];
+        }
+    }
+    session_header_t header = {.magic = SESSION_MAGIC, .version = SESSION_VERSION,
+        .header_size = sizeof(session_header_t), .options_hash = session_options_hash()};
+    header.buckets = 16;
+    while(header.buckets < count*2) {
+        header.buckets *= 2;
+    }
+    header.buckets_offset = sizeof(header);
+    header.entries = count;
+    header.runs = (old ? old->runs : 0) + 1;
+    header.lines = (old ? old->lines : 0) + session_lines;
+    header.hits = (old ? old->hits : 0) + session_hits;
+    uint64_t *buckets = calloc(header.buckets, sizeof(uint64_t));
+    if(buckets == NULL) {
+        perror("calloc");
+        free(entries);
+        return FAILURE;
+    }
+    uint64_t offset = header.buckets_offset + header.buckets * sizeof(uint64_t);
+    for(size_t i = 0; i < count; i++) {
+        size_t b = entries[i]->hash & (header.buckets-1);
+        while(buckets[b] != 0) {
+            b = (b+1) & (header.buckets-1);
+        }
+        buckets[b] = offset;
+        offset += SESSION_ENTRY_SIZE(entries[i]->size);
+    }
+    header.file_size = offset;
+    size_t path_size = strlen(path);
+    char *temporary = malloc(path_size + 5);
+    int status = temporary == NULL ? FAILURE : SUCCESS;
+    FILE *file = NULL;
+    if(status == SUCCESS) {
+        memcpy(temporary, path, path_size);
+        memcpy(temporary + path_size, ".tmp", 5);
+        file = fopen(temporary, "w");
+    }
+    if(file != NULL) {
+        static const char padding[8];
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(buckets, sizeof(uint64_t), header.buckets, file);
+        for(size_t i = 0; i < count; i++) {
+            size_t size = offsetof(session_entry_t, line) + entries[i]->size;
+            fwrite(entries[i], 1, size, file);
+            fwrite(padding, 1, SESSION_ENTRY_SIZE(entries[i]->size) - size, file);
+        }
+        if(ferror(file) | fclose(file) || rename(temporary, path) == -1) {
+            perror(path);
+            unlink(temporary);
+            status = FAILURE;
+        }
+    } else {
+        perror(path);
+        status = FAILURE;
+    }
+    free(temporary);
+    free(buckets);
+    free(entries);
+    for(size_t i = 0; i < session_merged.capacity; i++) {
+        free(session_merged.slots[i]);
+    }
+    free(session_merged.slots);
+    if(session_map != NULL) {
+        munmap((void *)session_map, session_map_size);
+        session_map = NULL;
+    }
+    return status;
+}
+
+/**
+ * Traffic capture.
+ *
+ * --capture=FILE records every expression read, in order and with the time
+ * it arrived, for the replay tool to send again at the recorded pace or
+ * faster. After a small header each line is a record of varints: the
+ * microseconds since the previous one, the length of the line without its
+ * newline, then its bytes. Blank lines, which are never evaluated, are left
+ * out. Lines read one at a time are timed one at a time, those of a chunk
+ * for the workers all get the time the chunk was read. Records go through
+ * a large stdio buffer on the reading thread, so a capture costs a clock
+ * read and a copy per line.
+*/
+#define CAPTURE_MAGIC "BODMASCP"
+#define CAPTURE_VERSION 1
+#define CAPTURE_BUFFER_SIZE (1 << 20)
+
+typedef struct capture_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    /* CLOCK_REALTIME nanoseconds when the capture started */
+    uint64_t started;
+} capture_header_t;
+
+/* the capture being written, NULL if lines are not recorded */
+const char *option_capture = NULL;
+FILE *capture_file = NULL;
+/* monotonic microseconds of the last record */
+long long capture_last;
+
+long long capture_now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+void capture_varint(uint64_t value) {
+    for(; value >= 0x80; value >>= 7) {
+        putc_unlocked((value & 0x7f) | 0x80, capture_file);
+    }
+    putc_unlocked(value, capture_file);
+}
+
+int capture_open(const char *path) {
+    struct timespec now;
+    capture_file = fopen(path, "w");
+    if(capture_file == NULL) {
+        perror(path);
+        return FAILURE;
+    }
+    setvbuf(capture_file, NULL, _IOFBF, CAPTURE_BUFFER_SIZE);
+    clock_gettime(CLOCK_REALTIME, &now);
+    capture_header_t header = {CAPTURE_MAGIC, CAPTURE_VERSION, sizeof(capture_header_t),
+        now.tv_sec * 1000000000ULL + now.tv_nsec};
+    fwrite(&header, sizeof(header), 1, capture_file);
+    capture_last = capture_now();
+    return SUCCESS;
+}
+
+/**
+ * record line of size bytes, the last its newline, arrived at time.
+*/
+void capture_line(const char *line, int size, long long time) {
+    capture_varint(time - capture_last);
+    capture_last = time;
+    capture_varint(size-1);
+    fwrite_unlocked(line, 1, size-1, capture_file);
+}
+
+/**
+ * record the lines from p to end, read just now, blank ones left out.
+*/
+void capture_lines(const char *p, const char *end) {
+    long long time = capture_now();
+    const char *newline;
+    while(p < end && (newline = kernel_find_newline(p, end)) != NULL) {
+        int size = newline+1-p;
+        if(!line_is_all_whitespaces(p, size)) {
+            capture_line(p, size, time);
+        }
+        p += size;
+    }
+}
+
+/**
+ * Line editor.
+ *
+ * When stdin and stdout are terminals, or with --repl=live, lines are read
+ * by a line editor in raw mode with history, which shows the value of what
+ * has been typed so far after it on every keystroke. Every token of the
+ * line keeps the state an evaluating operator precedence parser is in
+ * after it: the tops of its value and operator stacks, persistent linked
+ * lists in an arena, so the tokens before an edit and their state stay as
+ * they are. An edit lexes and parses again from the token it touches, so
+ * typing or deleting at the end of a line costs a token or two however
+ * long it is. The preview then reduces what is pending without
+ * allocating, as if open brackets were closed and without a trailing
+ * operator, and only the part of the line that fits the terminal is
+ * redrawn. Operators go through value_operation like in the engine, a
+ * preview is the value Enter prints.
+*/
+#define EDITOR_HISTORY_SIZE 1000
+/* arena nodes before it is rebuilt from the tokens that are still live */
+#define EDITOR_ARENA_MAX (1 << 20)
+/* columns the preview may take */
+#define EDITOR_PREVIEW_WIDTH 32
+#define EDITOR_PROMPT "> "
+
+enum repl_mode {
+    repl_auto,
+    repl_live,
+    repl_plain
+};
+
+enum editor_failure {
+    editor_ok,
+    /* no text after it can make the line valid */
+    editor_syntax,
+    /* an operation failed or a literal does not fit */
+    editor_runtime
+};
+
+typedef struct editor_node {
+    value_t value;
+    /* operator, or BRACKET_MARKER, on the operator stack */
+    int tag;
+    /* node below, -1 at the bottom */
+    int next;
+} editor_node_t;
+
+typedef struct editor_state {
+    /* tops of the value and operator stacks, -1 if empty */
+    int values;
+    int operators;
+    int expect_operand;
+    enum editor_failure failed;
+    /* the error of a runtime failure */
+    enum error_kind error;
+} editor_state_t;
+
+typedef struct editor_token {
+    /* bytes of the line the token spans */
+    int start;
+    int end;
+    /* the parser after the token */
+    editor_state_t state;
+} editor_token_t;
+
+typedef struct editor {
+    struct termios saved;
+    int raw;
+    char *line;
+    int size;
+    int capacity;
+    int cursor;
+    /* first byte of the line on screen */
+    int scroll;
+    editor_token_t *tokens;
+    int tokens_size;
+    int tokens_capacity;
+    editor_node_t *arena;
+    int arena_size;
+    int arena_capacity;
+    /* the lexer rejected a byte of the line */
+    int lex_failed;
+    char *history[EDITOR_HISTORY_SIZE];
+    int history_size;
+    int history_index;
+    /* the line being typed while going through the history */
+    char *draft;
+    char input[256];
+    int input_position;
+    int input_size;
+    /* input ended, after the line being typed */
+    int eof;
+} editor_t;
+
+enum repl_mode option_repl = repl_auto;
+int editor_active = 0;
+editor_t editor;
+/* previews worked out and the time it took, for --stats */
+long long editor_updates = 0;
+long long editor_update_ns = 0;
+long long editor_update_ns_max = 0;
+
+void editor_restore() {
+    if(editor.raw) {
+        tcsetattr(source_file_fd, TCSAFLUSH, &editor.saved);
+        editor.raw = 0;
+    }
+}
+
+/**
+ * read keys from a terminal one at a time, unechoed, restoring it at exit.
+*/
+void editor_open() {
+    editor_active = 1;
+    if(!isatty(source_file_fd) || tcgetattr(source_file_fd, &editor.saved) == -1) {
+        return;
+    }
+    struct termios raw = editor.saved;
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    if(tcsetattr(source_file_fd, TCSAFLUSH, &raw) == 0) {
+        editor.raw = 1;
+        atexit(editor_restore);
+    }
+}
+
+/**
+ * next byte of input, -1 at its end.
+*/
+int editor_byte() {
+    if(editor.input_position == editor.input_size) {
+        ssize_t n;
+        while((n = read(source_file_fd, editor.input, sizeof(editor.input))) == -1 && errno == EINTR);
+        if(n <= 0) {
+            return -1;
+        }
+        editor.input_size = n;
+        editor.input_position = 0;
+    }
+    return (unsigned char)editor.input[editor.input_position++];
+}
+
+/**
+ * push a node on the stack whose top is *top.
+*/
+int editor_push(int *top, value_t value, int tag) {
+    if(editor.arena_size == editor.arena_capacity) {
+        int capacity = editor.arena_capacity ? 2*editor.arena_capacity : 1024;
+        editor_node_t *arena = realloc(editor.arena, capacity * sizeof(editor_node_t));
+        if(arena == NULL) {
+            return FAILURE;
+        }
+        editor.arena = arena;
+        editor.arena_capacity = capacity;
+    }
+    editor.arena[editor.arena_size] = (editor_node_t){value, tag, *top};
+    *top = editor.arena_size++;
+    return SUCCESS;
+}
+
+/**
+ * apply the operator on top of the stack to the two values on top,
+ * leaving the stacks below as they were.
+*/
+void editor_reduce(editor_state_t *state) {
+    editor_node_t *operator = &editor.arena[state->operators];
+    editor_node_t *right = &editor.arena[state->values];
+    editor_node_t *left = &editor.arena[right->next];
+    value_t value = left->value;
+    int below = left->next;
+    state->operators = operator->next;
+    if(value_operation(operator->tag, &value, right->value) == FAILURE) {
+        state->failed = editor_runtime;
+        state->error = diagnostic_last_kind;
+    } else if(editor_push(&below, value, 0) == FAILURE) {
+        state->failed = editor_syntax;
+    }
+    state->values = below;
+}
+
+/**
+ * advance the parser over token, like parser_parse_expression.
+*/
+void editor_feed(editor_state_t *state, token_t *token) {
+    if(state->failed) {
+        return;
+    }
+    if(state->expect_operand) {
+        value_t value;
+        if(token->type == token_bracket_open) {
+            if(editor_push(&state->operators, 0, BRACKET_MARKER) == FAILURE) {
+                state->failed = editor_syntax;
+            }
+            return;
+        }
+        if(token->type != token_number) {
+            state->failed = editor_syntax;
+            return;
+        }
+        if(number_mode == numbers_decimal) {
+            if(decimal_parse(token->lexeme, &value) == FAILURE) {
+                state->failed = editor_runtime;
+                state->error = error_overflow;
+                return;
+            }
+        } else if(number_mode == numbers_dynamic) {
+            if(dynamic_parse(token->lexeme, &value) == FAILURE) {
+                state->failed = editor_syntax;
+                return;
+            }
+        } else {
+            value = (int)str_to_int(token->lexeme);
+        }
+        if(editor_push(&state->values, value, 0) == FAILURE) {
+            state->failed = editor_syntax;
+        }
+        state->expect_operand = 0;
+        return;
+    }
+    int operator = token_operator(token->type);
+    if(operator == -1 && token->type != token_bracket_close) {
+        state->failed = editor_syntax;
+        return;
+    }
+    /* reduce what binds at least as tight, or all up to the innermost bracket */
+    while(!state->failed && state->operators != -1) {
+        int pending = editor.arena[state->operators].tag;
+        if(pending == BRACKET_MARKER ||
+            (operator != -1 && operator_precedence[pending] < operator_precedence[operator])) {
+            break;
+        }
+        editor_reduce(state);
+    }
+    if(state->failed) {
+        return;
+    }
+    if(operator != -1) {
+        if(editor_push(&state->operators, 0, operator) == FAILURE) {
+            state->failed = editor_syntax;
+        }
+        state->expect_operand = 1;
+    } else if(state->operators == -1) {
+        /* a closing bracket without an open one */
+        state->failed = editor_syntax;
+    } else {
+        state->operators = editor.arena[state->operators].next;
+    }
+}
+
+/**
+ * bring the tokens and their states up to date after the line changed
+ * from byte changed on.
+*/
+void editor_update(int changed) {
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    if(editor.arena_size > EDITOR_ARENA_MAX) {
+        /* most nodes belong to tokens since edited, start over */
+        editor.arena_size = 0;
+        changed = 0;
+    }
+    /* tokens ending before the change stay, one ending at it may grow */
+    int low = 0, high = editor.tokens_size;
+    while(low < high) {
+        int middle = (low + high) / 2;
+        if(editor.tokens[middle].end < changed) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    editor.tokens_size = low;
+    int from = low > 0 ? editor.tokens[low-1].end : 0;
+    editor_state_t state = low > 0 ? editor.tokens[low-1].state : (editor_state_t){-1, -1, 1, editor_ok, 0};
+    token_list_t *list = token_list_new();
+    if(list == NULL) {
+        editor.lex_failed = 1;
+        return;
+    }
+    int muted = diagnostics_muted;
+    diagnostics_muted = 1;
+    /* only the tokens lexed now are held at once */
+    line_memory = 0;
+    editor.lex_failed = tokenize_source_line_and_add_to_list(editor.line + from, editor.size - from, list) != SUCCESS;
+    for(token_t *token = list->head; token != NULL; token = token->next) {
+        if(editor.tokens_size == editor.tokens_capacity) {
+            int capacity = editor.tokens_capacity ? 2*editor.tokens_capacity : 256;
+            editor_token_t *tokens = realloc(editor.tokens, capacity * sizeof(editor_token_t));
+            if(tokens == NULL) {
+                editor.lex_failed = 1;
+                break;
+            }
+            editor.tokens = tokens;
+            editor.tokens_capacity = capacity;
+        }
+        editor_token_t *t = &editor.tokens[editor.tokens_size++];
+        t->start = from + token->column - 1;
+        t->end = t->start + (token->type == token_number ? (int)strlen(token->lexeme) : 1);
+        editor_feed(&state, token);
+        t->state = state;
+    }
+    diagnostics_muted = muted;
+    token_list_free(list);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    long long ns = (end.tv_sec - begin.tv_sec) * 1000000000ll + (end.tv_nsec - begin.tv_nsec);
+    editor_updates++;
+    editor_update_ns += ns;
+    if(ns > editor_update_ns_max) {
+        editor_update_ns_max = ns;
+    }
+}
+
+/**
+ * the error of a runtime failure in text, as its kind reads.
+*/
+void editor_error_text(char *text, size_t size, enum error_kind error) {
+    snprintf(text, size, "%s", error_kind_name[error]);
+    for(char *dash = strchr(text, '-'); dash != NULL; dash = strchr(dash, '-')) {
+        *dash = ' ';
+    }
+}
+
+/**
+ * the value of the line so far in text, or an empty string if it has none.
+ * Returns the failure, if the line has one, with its error in text if it
+ * is a runtime one.
+*/
+enum editor_failure editor_preview(char *text, size_t size) {
+    editor_state_t state = editor.tokens_size > 0 ? editor.tokens[editor.tokens_size-1].state :
+        (editor_state_t){-1, -1, 1, editor_ok, 0};
+    text[0] = 0;
+    if(editor.lex_failed) {
+        return editor_syntax;
+    }
+    if(state.failed == editor_runtime) {
+        editor_error_text(text, size, state.error);
+    }
+    if(state.failed) {
+        return state.failed;
+    }
+    int values = state.values, operators = state.operators;
+    /* leave out a trailing operator and brackets opened after it */
+    while(state.expect_operand && operators != -1) {
+        int tag = editor.arena[operators].tag;
+        operators = editor.arena[operators].next;
+        if(tag != BRACKET_MARKER) {
+            break;
+        }
+    }
+    if(values == -1) {
+        return editor_ok;
+    }
+    value_t value = editor.arena[values].value;
+    values = editor.arena[values].next;
+    int muted = diagnostics_muted;
+    diagnostics_muted = 1;
+    for(; operators != -1; operators = editor.arena[operators].next) {
+        int tag = editor.arena[operators].tag;
+        if(tag == BRACKET_MARKER) {
+            continue;
+        }
+        value_t left = editor.arena[values].value;
+        values = editor.arena[values].next;
+        if(value_operation(tag, &left, value) == FAILURE) {
+            diagnostics_muted = muted;
+            editor_error_text(text, size, diagnostic_last_kind);
+            return editor_runtime;
+        }
+        value = left;
+    }
+    diagnostics_muted = muted;
+    if(number_mode == numbers_dynamic && value_is_big(value)) {
+        /* printing every digit costs more than the line */
+        snprintf(text, size, "~%.17g", big_to_double(unbox_big(value)));
+        return editor_ok;
+    }
+    /* as Enter prints it, without colours and the full stop */
+    char printed[96];
+    FILE *stream = fmemopen(printed, sizeof(printed), "w");
+    if(stream == NULL) {
+        return editor_ok;
+    }
+    print_value(stream, value);
+    fclose(stream);
+    printed[sizeof(printed)-1] = 0;
+    char *digits = strchr(printed, 'm');
+    char *stop = digits ? strchr(digits, '\033') : NULL;
+    if(stop != NULL) {
+        snprintf(text, size, "%.*s", (int)(stop - digits - 1), digits + 1);
+    }
+    return editor_ok;
+}
+
+/**
+ * draw the prompt, the part of the line around the cursor that fits and
+ * the preview after it.
+*/
+void editor_refresh(int show_preview) {
+    char preview[EDITOR_PREVIEW_WIDTH*2];
+    enum editor_failure failed = editor_ok;
+    preview[0] = 0;
+    if(show_preview) {
+        failed = editor_preview(preview, sizeof(preview));
+    }
+    int preview_width = preview[0] ? (int)strlen(preview) + 4 : 0;
+    struct winsize window;
+    int columns = ioctl(STDOUT_FILENO, TIOCGWINSZ, &window) == 0 && window.ws_col > 0 ? window.ws_col : 80;
+    int width = columns - (int)strlen(EDITOR_PROMPT) - 1;
+    if(preview_width > EDITOR_PREVIEW_WIDTH || width - preview_width < 8) {
+        preview[0] = 0;
+        preview_width = 0;
+    }
+    width -= preview_width;
+    if(editor.cursor < editor.scroll) {
+        editor.scroll = editor.cursor;
+    } else if(editor.cursor > editor.scroll + width) {
+        editor.scroll = editor.cursor - width;
+    }
+    int shown = editor.size - editor.scroll < width ? editor.size - editor.scroll : width;
+    char screen[1024];
+    int n = snprintf(screen, sizeof(screen), "\r%s", EDITOR_PROMPT);
+    if(shown > (int)sizeof(screen) - 128) {
+        shown = sizeof(screen) - 128;
+    }
+    memcpy(screen + n, editor.line + editor.scroll, shown);
+    n += shown;
+    if(preview[0]) {
+        n += snprintf(screen + n, sizeof(screen) - n, "\033[%sm  %s %s\033[0m", failed ? "2;31" : "2",
+            failed ? "!" : "=", preview);
+    }
+    n += snprintf(screen + n, sizeof(screen) - n, "\033[K\r\033[%dC",
+        (int)strlen(EDITOR_PROMPT) + editor.cursor - editor.scroll);
+    ssize_t written = write(STDOUT_FILENO, screen, n);
+    (void)written;
+}
+
+int editor_reserve(int size) {
+    if(size <= editor.capacity) {
+        return SUCCESS;
+    }
+    int capacity = editor.capacity ? editor.capacity : 256;
+    while(capacity < size) {
+        capacity *= 2;
+    }
+    if((size_t)capacity > memory_budget) {
+        return FAILURE;
+    }
+    char *line = realloc(editor.line, capacity);
+    if(line == NULL) {
+        return FAILURE;
+    }
+    editor.line = line;
+    editor.capacity = capacity;
+    return SUCCESS;
+}
+
+/**
+ * replace the line with text.
+*/
+void editor_set(const char *text) {
+    int size = strlen(text);
+    if(editor_reserve(size) == SUCCESS) {
+        memcpy(editor.line, text, size);
+        editor.size = editor.cursor = size;
+        editor.scroll = 0;
+        editor_update(0);
+    }
+}
+
+/**
+ * move through the history by step, keeping the line being typed.
+*/
+void editor_history_move(int step) {
+    int index = editor.history_index + step;
+    if(index < 0 || index > editor.history_size) {
+        return;
+    }
+    if(editor.history_index == editor.history_size) {
+        free(editor.draft);
+        editor.draft = strndup(editor.line, editor.size);
+    }
+    editor.history_index = index;
+    editor_set(index == editor.history_size ? (editor.draft ? editor.draft : "") : editor.history[index]);
+}
+
+void editor_history_add() {
+    if(line_is_all_whitespaces(editor.line, editor.size)) {
+        return;
+    }
+    if(editor.history_size > 0) {
+        const char *last = editor.history[editor.history_size-1];
+        if((int)strlen(last) == editor.size && !memcmp(last, editor.line, editor.size)) {
+            return;
+        }
+    }
+    if(editor.history_size == EDITOR_HISTORY_SIZE) {
+        free(editor.history[0]);
+        memmove(editor.history, editor.history + 1, (EDITOR_HISTORY_SIZE-1) * sizeof(char *));
+        editor.history_size--;
+    }
+    char *line = strndup(editor.line, editor.size);
+    if(line != NULL) {
+        editor.history[editor.history_size++] = line;
+    }
+}
+
+void editor_insert(char c) {
+    if(editor_reserve(editor.size + 1) == FAILURE) {
+        return;
+    }
+    memmove(editor.line + editor.cursor + 1, editor.line + editor.cursor, editor.size - editor.cursor);
+    editor.line[editor.cursor] = c;
+    editor.size++;
+    editor_update(editor.cursor++);
+}
+
+/**
+ * remove the bytes of the line in [from, to).
+*/
+void editor_delete(int from, int to) {
+    if(from >= to) {
+        return;
+    }
+    memmove(editor.line + from, editor.line + to, editor.size - to);
+    editor.size -= to - from;
+    editor.cursor = from;
+    editor_update(from);
+}
+
+/**
+ * act on an escape sequence: arrows, home, end and delete.
+*/
+void editor_escape() {
+    int c = editor_byte();
+    if(c != '[' && c != 'O') {
+        return;
+    }
+    c = editor_byte();
+    if(c >= '0' && c <= '9') {
+        int code = c - '0';
+        while((c = editor_byte()) >= '0' && c <= '9') {
+            code = code*10 + c - '0';
+        }
+        if(c != '~') {
+            return;
+        }
+        c = code == 3 ? 'X' : code == 1 || code == 7 ? 'H' : code == 4 || code == 8 ? 'F' : 0;
+    }
+    switch(c) {
+        case 'A': editor_history_move(-1); break;
+        case 'B': editor_history_move(1); break;
+        case 'C': editor.cursor += editor.cursor < editor.size; break;
+        case 'D': editor.cursor -= editor.cursor > 0; break;
+        case 'H': editor.cursor = 0; break;
+        case 'F': editor.cursor = editor.size; break;
+        case 'X': editor_delete(editor.cursor, editor.cursor + (editor.cursor < editor.size)); break;
+    }
+}
+
+/**
+ * read a line with the editor into the line buffer, as read_line does.
+*/
+int editor_read_line() {
+    fflush(stdout);
+    for(;;) {
+        editor.size = editor.cursor = editor.scroll = 0;
+        editor.tokens_size = 0;
+        editor.arena_size = 0;
+        editor.lex_failed = 0;
+        editor.history_index = editor.history_size;
+        free(editor.draft);
+        editor.draft = NULL;
+        int submit = editor.eof;
+        if(!submit) {
+            editor_refresh(1);
+        }
+        while(!submit) {
+            int c = editor_byte();
+            switch(c) {
+                case -1:
+                    editor.eof = submit = 1;
+                    break;
+                case '\r':
+                case '\n':
+                    submit = 1;
+                    break;
+                /* ctrl-c drops the line */
+                case 3:
+                    editor.size = editor.cursor = 0;
+                    editor_update(0);
+                    break;
+                /* ctrl-d ends the input on an empty line */
+                case 4:
+                    if(editor.size == 0) {
+                        editor.eof = submit = 1;
+                    } else {
+                        editor_delete(editor.cursor, editor.cursor + (editor.cursor < editor.size));
+                    }
+                    break;
+                case 127:
+                case 8:
+                    editor_delete(editor.cursor - (editor.cursor > 0), editor.cursor);
+                    break;
+                case 1: editor.cursor = 0; break;
+                case 5: editor.cursor = editor.size; break;
+                case 2: editor.cursor -= editor.cursor > 0; break;
+                case 6: editor.cursor += editor.cursor < editor.size; break;
+                case 11: editor_delete(editor.cursor, editor.size); break;
+                case 21: editor_delete(0, editor.cursor); break;
+                case 16: editor_history_move(-1); break;
+                case 14: editor_history_move(1); break;
+                case 27: editor_escape(); break;
+                default:
+                    if(c >= ' ') {
+                        editor_insert(c);
+                    }
+                    break;
+            }
+            if(!submit) {
+                editor_refresh(1);
+            }
+        }
+        if(editor.size == 0 && editor.eof) {
+            /* as read_line marks the end of input */
+            source_file_eof_read = 1;
+            source_file_line[0] = -1;
+            source_file_line_occupied_size = 1;
+            return SUCCESS;
+        }
+        /* the whole line stays on screen, without the preview */
+        char *screen = malloc(editor.size + 16);
+        if(screen != NULL) {
+            int n = sprintf(screen, "\r%s", EDITOR_PROMPT);
+            memcpy(screen + n, editor.line, editor.size);
+            n += editor.size;
+            n += sprintf(screen + n, "\033[K\r\n");
+            ssize_t written = write(STDOUT_FILENO, screen, n);
+            (void)written;
+            free(screen);
+        }
+        source_file_line_number++;
+        if(line_is_all_whitespaces(editor.line, editor.size)) {
+            continue;
+        }
+        editor_history_add();
+        if(line_buffer_reserve((size_t)editor.size + 1) == FAILURE) {
+            return FAILURE;
+        }
+        memcpy(source_file_line, editor.line, editor.size);
+        source_file_line[editor.size] = '\n';
+        source_file_line_occupied_size = editor.size + 1;
+        return SUCCESS;
+    }
+}
+
+/** command line options */
+/* print a statistics report on exit */
+int option_stats = 0;
+/* kernel level forced with --cpu, -1 to detect */
+int option_cpu_level = -1;
+/* worker threads for batch evaluation, 0 evaluates on the main thread */
+#define MAX_WORKERS 256
+int option_jobs = 0;
+/* pin workers to cores */
+int option_pin = 0;
+/* print the NUMA topology and worker placement */
+int option_topology = 0;
+/* evaluate a flat post-order ast instead of a pointer tree */
+int option_flat_ast = 0;
+/* threads lexing and parsing lines of PARALLEL_PARSE_MIN_SIZE or more */
+int option_parse_threads = 1;
+/* more of them for a line the worker evaluates alone, see fill_chunk */
+_Thread_local int standalone_parse_threads = 0;
+/* hand output to a pipe with vmsplice rather than write */
+int option_vmsplice = 1;
+/* read several source files ahead with io_uring */
+int option_uring = 1;
+/* flush results, and diagnostics, after every line */
+int option_line_buffered = 0;
+/* with several files, write each one's output to its path with this suffix */
+const char *option_output_suffix = NULL;
+
+/* node array reused by every line evaluated on this thread */
+_Thread_local ast_flat_t flat_ast;
+
+/**
+ * release the buffers and stacks reused by the lines evaluated on this thread.
+*/
+void evaluation_release() {
+    hw_counters_release();
+    if(option_session != NULL) {
+        session_release();
+    }
+    if(option_summary) {
+        summary_release();
+    }
+    big_release();
+    ast_flat_release(&flat_ast);
+    heap_stack_release(&parser_operators);
+    heap_stack_release(&parser_operands);
+    heap_stack_release(&engine_pending);
+    heap_stack_release(&callstack);
+}
+
+/**
+ * Parallel front end.
+ *
+ * A line of at least PARALLEL_PARSE_MIN_SIZE bytes is lexed and parsed by
+ * several threads. Each indexes the brackets and operators of one chunk of
+ * the line with the structural index kernel, and a prefix sum over the
+ * chunks' bracket depth changes gives every chunk the depth it starts at.
+ * The line is then cut at operators of the loosest binding kind found at
+ * the shallowest depth into segments of about PARSE_SEGMENT_SIZE bytes.
+ * Every segment after the first is parsed with a placeholder operand in
+ * front, standing for everything before it, so stitching the segments
+ * gives exactly the tree of the sequential parser. Lines with invalid
+ * characters, unbalanced brackets or syntax errors go through the
+ * sequential front end, which reports the error.
+*/
+#define PARALLEL_PARSE_MIN_SIZE (1 << 20)
+#define PARSE_SEGMENT_SIZE (1 << 20)
+/* bytes indexed by one kernel call */
+#define INDEX_BLOCK_SIZE (1 << 16)
+
+typedef struct front_end_chunk {
+    /* byte range of the line */
+    int begin;
+    int end;
+    /* positions in the line of its brackets and operators */
+    int *index;
+    size_t index_size;
+    size_t index_capacity;
+    int invalid;
+    /* bracket depth at the end, lowest depth and lowest depth of an
+    operator, all relative to the start */
+    int depth_change;
+    int min_depth;
+    int operator_depth;
+    /* bit per ast_type of the operators at operator_depth */
+    int operator_kinds;
+    /* depth at the start, from the prefix sum */
+    int start_depth;
+    /* positions the line is cut at */
+    int *splits;
+    size_t splits_size;
+    size_t splits_capacity;
+} front_end_chunk_t;
+
+typedef struct front_end_segment {
+    int begin;
+    int end;
+    ast_t *tree;
+    /* the placeholder leaf of tree */
+    ast_t **placeholder;
+    ast_flat_t flat;
+    /* where the flat nodes go in the stitched array */
+    size_t offset;
+    int failed;
+} front_end_segment_t;
+
+typedef struct front_end {
+    const char *line;
+    int threads;
+    front_end_chunk_t chunks[MAX_WORKERS];
+    /* depth and kind of the operators the line is cut at */
+    int depth;
+    int split_operator;
+    /* bytes between the brackets enclosing everything at depth */
+    int range_begin;
+    int range_end;
+    int segments_wanted;
+    front_end_segment_t *segments;
+    int segments_size;
+    /* next segment to parse, taken atomically */
+    int next_segment;
+    /* stitched flat ast, NULL to build a tree */
+    ast_flat_t *flat;
+    /* bytes of tokens and tree nodes of every thread, see line_memory */
+    size_t memory;
+} front_end_t;
+
+typedef struct front_end_task {
+    front_end_t *front_end;
+    int id;
+} front_end_task_t;
+
+/**
+ * make room for size positions, within the memory budget.
+*/
+int positions_reserve(int **positions, size_t *capacity, size_t size) {
+    if(size <= *capacity) {
+        return SUCCESS;
+    }
+    size_t new_capacity = *capacity ? *capacity : INDEX_BLOCK_SIZE;
+    while(new_capacity < size) {
+        new_capacity *= 2;
+    }
+    if(new_capacity > memory_budget / sizeof(int)) {
+        return FAILURE;
+    }
+    int *resized = realloc(*positions, new_capacity*sizeof(int));
+    if(resized == NULL) {
+        return FAILURE;
+    }
+    *positions = resized;
+    *capacity = new_capacity;
+    return SUCCESS;
+}
+
+/* operator written as c */
+int character_operator(char c) {
+    switch(c) {
+        case '+': return ast_add;
+        case '-': return ast_sub;
+        case '*': return ast_mul;
+        default: return ast_div;
+    }
+}
+
+/**
+ * index the chunk and sum up its bracket depths.
+*/
+void *front_end_index_chunk(void *argument) {
+    front_end_task_t *task = argument;
+    front_end_t *front_end = task->front_end;
+    front_end_chunk_t *chunk = &front_end->chunks[task->id];
+    int depth = 0;
+    chunk->min_depth = 0;
+    chunk->operator_depth = INT_MAX;
+    for(int block = chunk->begin; block < chunk->end; block += INDEX_BLOCK_SIZE) {
+        int block_end = chunk->end - block > INDEX_BLOCK_SIZE ? block + INDEX_BLOCK_SIZE : chunk->end;
+        if(positions_reserve(&chunk->index, &chunk->index_capacity, chunk->index_size + (block_end-block)) == FAILURE) {
+            chunk->invalid = 1;
+            return NULL;
+        }
+        int *offsets = &chunk->index[chunk->index_size];
+        int n = kernel_index_structure(&front_end->line[block], &front_end->line[block_end], offsets);
+        if(n == -1) {
+            chunk->invalid = 1;
+            return NULL;
+        }
+        for(int i = 0; i < n; i++) {
+            offsets[i] += block;
+            char c = front_end->line[offsets[i]];
+            if(c == '(') {
+                depth++;
+            } else if(c == ')') {
+                depth--;
+                if(depth < chunk->min_depth) {
+                    chunk->min_depth = depth;
+                }
+            } else {
+                if(depth < chunk->operator_depth) {
+                    chunk->operator_depth = depth;
+                    chunk->operator_kinds = 0;
+                }
+                if(depth == chunk->operator_depth) {
+                    chunk->operator_kinds |= 1 << character_operator(c);
+                }
+            }
+        }
+        chunk->index_size += n;
+    }
+    chunk->depth_change = depth;
+    return NULL;
+}
+
+/* position in the line segment j of the wanted segments should start at */
+#define front_end_target(front_end, j) \
+    ((front_end)->range_begin + \
+    (int)((long long)((front_end)->range_end - (front_end)->range_begin) * (j) / (front_end)->segments_wanted))
+
+/**
+ * pick the operators the chunk's part of the line is cut at, the first
+ * splitting operator at or after each target position.
+*/
+void *front_end_split_chunk(void *argument) {
+    front_end_task_t *task = argument;
+    front_end_t *front_end = task->front_end;
+    front_end_chunk_t *chunk = &front_end->chunks[task->id];
+    int depth = chunk->start_depth;
+    int j = 1;
+    while(j < front_end->segments_wanted && front_end_target(front_end, j) < chunk->begin) {
+        j++;
+    }
+    for(size_t i = 0; i < chunk->index_size && j < front_end->segments_wanted; i++) {
+        int position = chunk->index[i];
+        char c = front_end->line[position];
+        if(c == '(') {
+            depth++;
+        } else if(c == ')') {
+            depth--;
+        } else if(depth == front_end->depth && character_operator(c) == front_end->split_operator &&
+            position >= front_end_target(front_end, j) &&
+            position > front_end->range_begin && position < front_end->range_end) {
+            if(positions_reserve(&chunk->splits, &chunk->splits_capacity, chunk->splits_size+1) == FAILURE) {
+                chunk->invalid = 1;
+                return NULL;
+            }
+            chunk->splits[chunk->splits_size++] = position;
+            while(j < front_end->segments_wanted && front_end_target(front_end, j) <= position) {
+                j++;
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * tokenize and parse one segment. Segments after the first start with the
+ * splitting operator and get a placeholder operand in front of it.
+*/
+void front_end_parse_segment(front_end_t *front_end, front_end_segment_t *segment, int placeholder) {
+    token_list_t *stream = token_list_new();
+    int status = tokenize_source_line_and_add_to_list(&front_end->line[segment->begin],
+        segment->end - segment->begin, stream);
+    if(status == SUCCESS) {
+        if(placeholder) {
+            token_t *token = token_new();
+            token->type = token_number;
+            token->lexeme = strdup("0");
+            token->next = stream->head;
+            stream->head = token;
+            if(stream->tail == NULL) {
+                stream->tail = token;
+            }
+        }
+        token_t *end = token_new();
+        end->type = token_end_of_expression;
+        token_list_append(stream, end);
+        if(front_end->flat != NULL) {
+            status = parse_token_stream_into_flat_ast(stream, &segment->flat);
+        } else {
+            status = parse_token_stream_into_ast(stream, &segment->tree);
+            if(status == SUCCESS && placeholder) {
+                /* the placeholder is the leftmost leaf */
+                ast_t **leaf = &segment->tree;
+                while((*leaf)->type != ast_num) {
+                    leaf = &(*leaf)->children[0];
+                }
+                segment->placeholder = leaf;
+            }
+        }
+    }
+    token_list_free(stream);
+    segment->failed = status != SUCCESS;
+}
+
+void *front_end_parse_segments(void *argument) {
+    front_end_task_t *task = argument;
+    front_end_t *front_end = task->front_end;
+    /* errors are reported by the sequential front end */
+    int muted = diagnostics_muted;
+    diagnostics_muted = 1;
+    line_memory_shared = &front_end->memory;
+    for(;;) {
+        int i = __atomic_fetch_add(&front_end->next_segment, 1, __ATOMIC_RELAXED);
+        if(i >= front_end->segments_size) {
+            break;
+        }
+        front_end_parse_segment(front_end, &front_end->segments[i], i > 0);
+    }
+    line_memory_shared = NULL;
+    diagnostics_muted = muted;
+    if(task->id != 0) {
+        evaluation_release();
+    }
+    return NULL;
+}
+
+/* nodes of the placeholder leading flat segment i, a wide leaf takes two */
+int front_end_placeholder_nodes(front_end_t *front_end, int i) {
+    return i > 0 ? 1 + front_end->segments[i].flat.nodes[0].wide : 0;
+}
+
+/**
+ * copy the flat segments into the stitched array, without their placeholders.
+*/
+void *front_end_copy_segments(void *argument) {
+    front_end_task_t *task = argument;
+    front_end_t *front_end = task->front_end;
+    for(int i = task->id; i < front_end->segments_size; i += front_end->threads) {
+        ast_flat_t *flat = &front_end->segments[i].flat;
+        int skip = front_end_placeholder_nodes(front_end, i);
+        memcpy(&front_end->flat->nodes[front_end->segments[i].offset], &flat->nodes[skip],
+            (flat->size - skip) * sizeof(ast_flat_node_t));
+    }
+    return NULL;
+}
+
+/**
+ * run phase on every thread of the front end, the calling one included.
+*/
+void front_end_run(front_end_t *front_end, void *(*phase)(void *)) {
+    front_end_task_t tasks[MAX_WORKERS];
+    pthread_t threads[MAX_WORKERS];
+    int started[MAX_WORKERS];
+    for(int i = 0; i < front_end->threads; i++) {
+        tasks[i].front_end = front_end;
+        tasks[i].id = i;
+        started[i] = i > 0 && pthread_create(&threads[i], NULL, phase, &tasks[i]) == 0;
+    }
+    phase(&tasks[0]);
+    for(int i = 1; i < front_end->threads; i++) {
+        if(started[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            phase(&tasks[i]);
+        }
+    }
+}
+
+/**
+ * check that [0, range_begin) and [range_end, end) hold the depth
+ * brackets enclosing the range and nothing but whitespace.
+*/
+int front_end_find_range(front_end_t *front_end, int end) {
+    const char *line = front_end->line;
+    int brackets = 0;
+    int i = 0;
+    for(; brackets < front_end->depth && i < end; i++) {
+        if(line[i] == '(') {
+            brackets++;
+        } else if(!is_whitespace(line[i])) {
+            return FAILURE;
+        }
+    }
+    front_end->range_begin = i;
+    for(brackets = 0, i = end; brackets < front_end->depth && i > front_end->range_begin; i--) {
+        if(line[i-1] == ')') {
+            brackets++;
+        } else if(!is_whitespace(line[i-1])) {
+            return FAILURE;
+        }
+    }
+    front_end->range_end = i;
+    return brackets == front_end->depth ? SUCCESS : FAILURE;
+}
+
+/**
+ * stitch the parsed segments together.
+*/
+int front_end_stitch(front_end_t *front_end, ast_t **tree) {
+    if(front_end->flat == NULL) {
+        ast_t *stitched = front_end->segments[0].tree;
+        front_end->segments[0].tree = NULL;
+        for(int i = 1; i < front_end->segments_size; i++) {
+            front_end_segment_t *segment = &front_end->segments[i];
+            free(*segment->placeholder);
+            *segment->placeholder = stitched;
+            stitched = segment->tree;
+            segment->tree = NULL;
+        }
+        *tree = stitched;
+        return SUCCESS;
+    }
+    size_t size = 0;
+    for(int i = 0; i < front_end->segments_size; i++) {
+        front_end->segments[i].offset = size;
+        size += front_end->segments[i].flat.size - front_end_placeholder_nodes(front_end, i);
+    }
+    ast_flat_t *flat = front_end->flat;
+    if(size > (size_t)flat->capacity) {
+        if(size > INT_MAX) {
+            return FAILURE;
+        }
+        ast_flat_node_t *nodes = realloc(flat->nodes, size*sizeof(ast_flat_node_t));
+        if(nodes == NULL) {
+            return FAILURE;
+        }
+        flat->nodes = nodes;
+        flat->capacity = size;
+    }
+    front_end_run(front_end, front_end_copy_segments);
+    flat->size = size;
+    return SUCCESS;
+}
+
+void front_end_free(front_end_t *front_end) {
+    for(int i = 0; i < front_end->threads; i++) {
+        free(front_end->chunks[i].index);
+        free(front_end->chunks[i].splits);
+    }
+    for(int i = 0; i < front_end->segments_size; i++) {
+        ast_free(front_end->segments[i].tree);
+        ast_flat_release(&front_end->segments[i].flat);
+    }
+    free(front_end->segments);
+    free(front_end);
+}
+
+/**
+ * lex and parse line on threads threads into tree, or flat when it isn't
+ * NULL. Fails without reporting anything when the line has to go through
+ * the sequential front end.
+*/
+int parse_line_in_parallel(const char *line, int line_size, int threads, ast_t **tree, ast_flat_t *flat) {
+    front_end_t *front_end = calloc(1, sizeof(front_end_t));
+    if(front_end == NULL) {
+        return FAILURE;
+    }
+    front_end->line = line;
+    front_end->threads = threads;
+    front_end->flat = flat;
+    for(int i = 0; i < threads; i++) {
+        front_end->chunks[i].begin = (long long)line_size * i / threads;
+        front_end->chunks[i].end = (long long)line_size * (i+1) / threads;
+    }
+    front_end_run(front_end, front_end_index_chunk);
+    /* prefix sum of the depth changes */
+    int status = SUCCESS;
+    int depth = 0;
+    int operator_kinds = 0;
+    front_end->depth = INT_MAX;
+    for(int i = 0; i < threads && status == SUCCESS; i++) {
+        front_end_chunk_t *chunk = &front_end->chunks[i];
+        chunk->start_depth = depth;
+        if(chunk->invalid || depth + chunk->min_depth < 0) {
+            status = FAILURE;
+        } else if(chunk->operator_depth != INT_MAX) {
+            if(depth + chunk->operator_depth < front_end->depth) {
+                front_end->depth = depth + chunk->operator_depth;
+                operator_kinds = 0;
+            }
+            if(depth + chunk->operator_depth == front_end->depth) {
+                operator_kinds |= chunk->operator_kinds;
+            }
+        }
+        depth += chunk->depth_change;
+    }
+    if(status == FAILURE || depth != 0 || operator_kinds == 0) {
+        front_end_free(front_end);
+        return FAILURE;
+    }
+    front_end->split_operator = -1;
+    for(int kind = ast_add; kind <= ast_mul; kind++) {
+        if(operator_kinds & (1 << kind) && (front_end->split_operator == -1 ||
+            operator_precedence[kind] < operator_precedence[front_end->split_operator])) {
+            front_end->split_operator = kind;
+        }
+    }
+    int end = line[line_size-1] == '\n' ? line_size-1 : line_size;
+    if(front_end_find_range(front_end, end) == FAILURE) {
+        front_end_free(front_end);
+        return FAILURE;
+    }
+    front_end->segments_wanted = (front_end->range_end - front_end->range_begin) / PARSE_SEGMENT_SIZE;
+    if(front_end->segments_wanted < threads) {
+        front_end->segments_wanted = threads;
+    }
+    front_end_run(front_end, front_end_split_chunk);
+    size_t splits = 0;
+    for(int i = 0; i < threads; i++) {
+        status |= front_end->chunks[i].invalid;
+        splits += front_end->chunks[i].splits_size;
+    }
+    front_end->segments = calloc(splits+1, sizeof(front_end_segment_t));
+    if(status == FAILURE || front_end->segments == NULL) {
+        front_end_free(front_end);
+        return FAILURE;
+    }
+    int begin = front_end->range_begin;
+    for(int i = 0; i < threads; i++) {
+        for(size_t j = 0; j < front_end->chunks[i].splits_size; j++) {
+            front_end->segments[front_end->segments_size].begin = begin;
+            front_end->segments[front_end->segments_size++].end = begin = front_end->chunks[i].splits[j];
+        }
+    }
+    front_end->segments[front_end->segments_size].begin = begin;
+    front_end->segments[front_end->segments_size++].end = front_end->range_end;
+    front_end_run(front_end, front_end_parse_segments);
+    for(int i = 0; i < front_end->segments_size; i++) {
+        status |= front_end->segments[i].failed;
+    }
+    if(status == SUCCESS) {
+        status = front_end_stitch(front_end, tree);
+    }
+    front_end_free(front_end);
+    return status;
+}
+
+/**
+ * Evaluate one line: tokenize, parse and execute it.
+ * The line must end with a newline (or be the EOF marker).
+*/
+int process_line(const char *line, int line_size) {
+    int status = FAILURE;
+    int parsed = FAILURE;
+    long long tokens = lexer_tokens;
+    long long nodes = engine_nodes;
+    value_t value;
+    if(option_session != NULL && line_size <= SESSION_LINE_MAX && session_lookup(line, line_size, &value) == SUCCESS) {
+        print_result(value);
+        stage_enter(stage_other);
+        if(option_slow_lines) {
+            /* its ticks so far are its own, not the next line's */
+            slow_lines_record(line_size, 0, 0);
+        }
+        return SUCCESS;
+    }
+    engine_has_result = 0;
+    line_memory = 0;
+    token_list_t *stream = token_list_new();
+    ast_t *tree = NULL;
+    int parse_threads = standalone_parse_threads > option_parse_threads ?
+        standalone_parse_threads : option_parse_threads;
+    /* big literals belong to the thread that parses them */
+    if(parse_threads > 1 && line_size >= PARALLEL_PARSE_MIN_SIZE && number_mode != numbers_dynamic) {
+        /* the parallel front end tokenizes as it parses */
+        stage_enter(stage_parse);
+        parsed = parse_line_in_parallel(line, line_size, parse_threads, &tree,
+            option_flat_ast ? &flat_ast : NULL);
+        /* its threads did the tokenizing */
+        tokens = parsed == SUCCESS ? -1 : tokens;
+    }
+    if(parsed != SUCCESS) {
+        stage_enter(stage_tokenize);
+        if(tokenize_source_line_and_add_to_list(line, line_size, stream) == SUCCESS) {
+            stage_enter(stage_parse);
+            if(option_flat_ast) {
+                parsed = parse_token_stream_into_flat_ast(stream, &flat_ast);
+                if(parsed == SUCCESS && number_mode == numbers_dynamic) {
+                    parsed = type_pass(&flat_ast);
+                }
+            } else {
+                parsed = parse_token_stream_into_ast(stream, &tree);
+            }
+        }
+    }
+    if(parsed == SUCCESS) {
+        stage_enter(stage_execute);
+        status = option_flat_ast ? execution_engine_flat(&flat_ast) : execution_engine(tree);
+    }
+    stage_enter(stage_other);
+    if(option_scan && status != SUCCESS) {
+        scan_add(0, 1);
+    }
+    if(option_session != NULL && status == SUCCESS && engine_has_result && line_size <= SESSION_LINE_MAX) {
+        session_add(line, line_size, engine_result);
+    }
+    if(option_slow_lines) {
+        slow_lines_record(line_size, tokens < 0 ? -1 : lexer_tokens - tokens, engine_nodes - nodes);
+    }
+    ast_free(tree);
+    token_list_free(stream);
+    big_release();
+    return status;
+}
+
+/**
+ * parse a size in bytes with an optional K, M or G suffix, 0 if invalid.
+*/
+size_t parse_size(const char *text) {
+    char *end;
+    unsigned long long size = strtoull(text, &end, 10);
+    switch(*end) {
+        case 'G': size <<= 10; /* fall through */
+        case 'M': size <<= 10; /* fall through */
+        case 'K': size <<= 10; end++; break;
+    }
+    return *end || end == text ? 0 : size;
+}
+
+/**
+ * parse options and the source file paths, none for stdin.
+*/
+int parse_arguments(int argc, char **argv, char ***source_file_paths, int *source_file_paths_size) {
+    *source_file_paths = calloc(argc, sizeof(char *));
+    *source_file_paths_size = 0;
+    if(*source_file_paths == NULL) {
+        perror("calloc");
+        return FAILURE;
+    }
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--stats")) {
+            option_stats = 1;
+        } else if(!strcmp(argv[i], "--stats=hw")) {
+            option_stats = option_stats_hw = 1;
+        } else if(!strncmp(argv[i], "--cpu=", 6)) {
+            for(option_cpu_level = cpu_levels-1; option_cpu_level >= 0; option_cpu_level--) {
+                if(!strcmp(&argv[i][6], cpu_level_name[option_cpu_level])) {
+                    break;
+                }
+            }
+            if(option_cpu_level == -1) {
+                fprintf(stderr, "Unknown cpu level %s.\n", &argv[i][6]);
+                return FAILURE;
+            }
+        } else if(!strncmp(argv[i], "-j", 2)) {
+            const char *jobs = argv[i][2] ? &argv[i][2] : (i+1 < argc ? argv[++i] : "");
+            option_jobs = atoi(jobs);
+            if(option_jobs < 1 || option_jobs > MAX_WORKERS) {
+                fprintf(stderr, "-j expects 1 to %d workers.\n", MAX_WORKERS);
+                return FAILURE;
+            }
+        } else if(!strcmp(argv[i], "--pin")) {
+            option_pin = 1;
+        } else if(!strcmp(argv[i], "--topology")) {
+            option_topology = 1;
+        } else if(!strncmp(argv[i], "--memory-budget=", 16)) {
+            memory_budget = parse_size(&argv[i][16]);
+            if(memory_budget < LINE_BUFFER_SIZE) {
+                fprintf(stderr, "Invalid memory budget %s.\n", &argv[i][16]);
+                return FAILURE;
+            }
+        } else if(!strncmp(argv[i], "--capture=", 10)) {
+            option_capture = &argv[i][10];
+        } else if(!strcmp(argv[i], "--line-buffered")) {
+            option_line_buffered = 1;
+        } else if(!strcmp(argv[i], "--summary")) {
+            option_summary = 1;
+        } else if(!strncmp(argv[i], "--scan=", 7)) {
+            for(option_scan = scan_sum; option_scan <= scan_max; option_scan++) {
+                if(!strcmp(&argv[i][7], scan_name[option_scan])) {
+                    break;
+                }
+            }
+            if(option_scan > scan_max) {
+                fprintf(stderr, "--scan expects sum, min or max.\n");
+                return FAILURE;
+            }
+            /* the sum of no results is 0, min and max have none */
+            scan_has_total = option_scan == scan_sum;
+        } else if(!strncmp(argv[i], "--session=", 10)) {
+            option_session = &argv[i][10];
+        } else if(!strncmp(argv[i], "--slow-lines=", 13)) {
+            option_slow_lines = atoi(&argv[i][13]);
+            if(option_slow_lines < 1) {
+                fprintf(stderr, "--slow-lines expects a number of lines.\n");
+                return FAILURE;
+            }
+            slow_lines_ticks_start = slow_lines_now();
+            clock_gettime(CLOCK_MONOTONIC, &slow_lines_clock_start);
+        } else if(!strncmp(argv[i], "--parse-threads=", 16)) {
+            option_parse_threads = atoi(&argv[i][16]);
+            if(option_parse_threads < 1 || option_parse_threads > MAX_WORKERS) {
+                fprintf(stderr, "--parse-threads expects 1 to %d threads.\n", MAX_WORKERS);
+                return FAILURE;
+            }
+        } else if(!strncmp(argv[i], "--diagnostics=", 14)) {
+            diagnostics_file = fopen(&argv[i][14], "w");
+            if(diagnostics_file == NULL) {
+                perror("fopen");
+                return FAILURE;
+            }
+            setvbuf(diagnostics_file, NULL, _IOFBF, DIAGNOSTICS_BUFFER_SIZE);
+        } else if(!strncmp(argv[i], "--pipe-output=", 14)) {
+            if(!strcmp(&argv[i][14], "vmsplice")) {
+                option_vmsplice = 1;
+            } else if(!strcmp(&argv[i][14], "write")) {
+                option_vmsplice = 0;
+            } else {
+                fprintf(stderr, "Unknown pipe output %s.\n", &argv[i][14]);
+                return FAILURE;
+            }
+        } else if(!strncmp(argv[i], "--output-suffix=", 16)) {
+            option_output_suffix = &argv[i][16];
+            if(!*option_output_suffix) {
+                fprintf(stderr, "--output-suffix expects a suffix.\n");
+                return FAILURE;
+            }
+        } else if(!strncmp(argv[i], "--io=", 5)) {
+            if(!strcmp(&argv[i][5], "uring")) {
+                option_uring = 1;
+            } else if(!strcmp(&argv[i][5], "blocking")) {
+                option_uring = 0;
+            } else {
+                fprintf(stderr, "Unknown io %s.\n", &argv[i][5]);
+                return FAILURE;
+            }
+        } else if(!strncmp(argv[i], "--decimal=", 10)) {
+            char *end;
+            long scale = strtol(&argv[i][10], &end, 10);
+            if(end == &argv[i][10] || *end || scale < 0 || scale > DECIMAL_MAX_SCALE) {
+                fprintf(stderr, "--decimal expects a scale from 0 to %d.\n", DECIMAL_MAX_SCALE);
+                return FAILURE;
+            }
+            number_mode = numbers_decimal;
+            decimal_scale = scale;
+            for(decimal_unit = 1; scale > 0; scale--) {
+                decimal_unit *= 10;
+            }
+            lexer_table = lexer_transition_decimal;
+        } else if(!strcmp(argv[i], "--dynamic")) {
+            number_mode = numbers_dynamic;
+            lexer_table = lexer_transition_decimal;
+        } else if(!strncmp(argv[i], "--dispatch=", 11)) {
+            if(!strcmp(&argv[i][11], "typed")) {
+                option_typed_dispatch = 1;
+            } else if(!strcmp(&argv[i][11], "generic")) {
+                option_typed_dispatch = 0;
+            } else {
+                fprintf(stderr, "Unknown dispatch %s.\n", &argv[i][11]);
+                return FAILURE;
+            }
+        } else if(!strncmp(argv[i], "--rounding=", 11)) {
+            for(decimal_rounding = 0; decimal_rounding < roundings; decimal_rounding++) {
+                if(!strcmp(&argv[i][11], rounding_name[decimal_rounding])) {
+                    break;
+                }
+            }
+            if(decimal_rounding == roundings) {
+                fprintf(stderr, "Unknown rounding %s.\n", &argv[i][11]);
+                return FAILURE;
+            }
+        } else if(!strncmp(argv[i], "--repl=", 7)) {
+            if(!strcmp(&argv[i][7], "auto")) {
+                option_repl = repl_auto;
+            } else if(!strcmp(&argv[i][7], "live")) {
+                option_repl = repl_live;
+            } else if(!strcmp(&argv[i][7], "plain")) {
+                option_repl = repl_plain;
+            } else {
+                fprintf(stderr, "Unknown repl %s.\n", &argv[i][7]);
+                return FAILURE;
+            }
+        } else if(!strncmp(argv[i], "--ast=", 6)) {
+            if(!strcmp(&argv[i][6], "flat")) {
+                option_flat_ast = 1;
+            } else if(!strcmp(&argv[i][6], "tree")) {
+                option_flat_ast = 0;
+            } else {
+                fprintf(stderr, "Unknown ast %s.\n", &argv[i][6]);
+                return FAILURE;
+            }
+        } else if(argv[i][0] == '-' && argv[i][1] == '-') {
+            fprintf(stderr, "Unknown option %s.\n", argv[i]);
+            fprintf(stderr, "usage: %s [--stats[=hw]] [--slow-lines=N] [--summary] [--scan=sum|min|max] [--session=FILE] [--capture=FILE] [--line-buffered] [--cpu=scalar|sse2|avx2|avx512] [--ast=tree|flat]"
+                " [--repl=auto|live|plain] [--memory-budget=SIZE] [--parse-threads=N] [--diagnostics=FILE] [--pipe-output=vmsplice|write]"
+                " [--io=uring|blocking] [--output-suffix=SUFFIX]"
+                " [--decimal=SCALE [--rounding=half-even|half-up|down|floor|ceiling] | --dynamic [--dispatch=typed|generic]]"
+                " [-j N [--pin] [--topology]] [file...]\n",
+                argv[0]);
+            return FAILURE;
+        } else {
+            (*source_file_paths)[(*source_file_paths_size)++] = argv[i];
+        }
+    }
+    if(number_mode == numbers_dynamic) {
+        /* the type pass works on flat asts */
+        option_flat_ast = 1;
+    }
+    return SUCCESS;
+}
+
+/** statistics gathered for --stats */
+/* lines between two resident set size samples */
+#define STATS_SAMPLE_INTERVAL 10000
+/* samples taken before this many lines only warm up allocator caches */
+#define STATS_WARMUP_LINES 100000
+/* expressions processed */
+long long stats_lines = 0;
+/* resident set size in KiB at the end of warm-up, highest after it and last */
+long stats_rss_warmup = -1;
+long stats_rss_max = 0;
+long stats_rss_final = 0;
+
+/**
+ * resident set size of this process in KiB, -1 if unknown.
+*/
+long stats_read_rss() {
+    char statm[128];
+    long size, resident;
+    int fd = open("/proc/self/statm", O_RDONLY);
+    if(fd == -1) {
+        return -1;
+    }
+    ssize_t n = read(fd, statm, sizeof(statm)-1);
+    close(fd);
+    if(n <= 0) {
+        return -1;
+    }
+    statm[n] = 0;
+    if(sscanf(statm, "%ld %ld", &size, &resident) != 2) {
+        return -1;
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/**
+ * account for processed expressions, sampling memory at intervals.
+*/
+void stats_count_lines(long long lines) {
+    long long before = stats_lines;
+    stats_lines += lines;
+    if(stats_lines / STATS_SAMPLE_INTERVAL != before / STATS_SAMPLE_INTERVAL) {
+        long rss = stats_read_rss();
+        stats_rss_final = rss;
+        if(stats_lines >= STATS_WARMUP_LINES) {
+            if(stats_rss_warmup == -1) {
+                stats_rss_warmup = rss;
+            }
+            if(rss > stats_rss_max) {
+                stats_rss_max = rss;
+            }
+        }
+    }
+}
+
+/**
+ * Load balance.
+ *
+ * What every worker did, chunks or files and the lines in them, how many
+ * it took from another worker's slots and how long it spent evaluating,
+ * and how long the main thread waited to write a chunk out in order.
+*/
+typedef struct worker_load {
+    long long tasks;
+    long long stolen;
+    long long lines;
+    long long busy_ns;
+} worker_load_t;
+
+/* the load of every worker, kept when they are joined */
+worker_load_t *balance_loads = NULL;
+int balance_workers = 0;
+long long balance_wait_ns = 0;
+/* lines costly enough to be a chunk of their own */
+long long balance_standalone = 0;
+
+long long stats_now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ll + now.tv_nsec;
+}
+
+void balance_report() {
+    long long busy_max = 0, busy_total = 0;
+    fprintf(stderr, "--- load balance ---\n");
+    fprintf(stderr, "%-14s %10s %10s %12s %12s\n", "worker", "tasks", "stolen", "lines", "busy ms");
+    for(int i = 0; i < balance_workers; i++) {
+        worker_load_t *load = &balance_loads[i];
+        fprintf(stderr, "%-14d %10lld %10lld %12lld %12.1f\n", i, load->tasks, load->stolen, load->lines,
+            load->busy_ns / 1e6);
+        busy_total += load->busy_ns;
+        if(load->busy_ns > busy_max) {
+            busy_max = load->busy_ns;
+        }
+    }
+    if(busy_total > 0) {
+        /* 1 when every worker was as busy as the busiest */
+        fprintf(stderr, "imbalance      %.2f\n", (double)busy_max * balance_workers / busy_total);
+    }
+    fprintf(stderr, "standalone     %lld lines\n", balance_standalone);
+    fprintf(stderr, "write waits    %.1f ms\n", balance_wait_ns / 1e6);
+    free(balance_loads);
+}
+
+/**
+ * print one row of the hardware counters report, the counts divided by
+ * divisor.
+*/
+void hw_report_row(const char *name, unsigned long long *counts, double divisor) {
+    fprintf(stderr, "%-14s", name);
+    for(int e = 0; e < hw_events; e++) {
+        if(!hw_counted[e]) {
+            fprintf(stderr, " %13s", "n/a");
+        } else {
+            fprintf(stderr, " %13.1f", counts[e] / divisor);
+        }
+        if(e == hw_instructions) {
+            if(hw_counted[hw_cycles] && hw_counted[hw_instructions] && counts[hw_cycles] > 0) {
+                fprintf(stderr, " %5.2f", (double)counts[hw_instructions] / counts[hw_cycles]);
+            } else {
+                fprintf(stderr, " %5s", "n/a");
+            }
+        }
+    }
+    fprintf(stderr, "\n");
+}
+
+/**
+ * per stage counts per line, then per node of the whole evaluation.
+*/
+void hw_report() {
+    unsigned long long total[hw_events] = {0};
+    int counted = 0;
+    fprintf(stderr, "--- hardware counters ---\n");
+    for(int e = 0; e < hw_events; e++) {
+        counted |= hw_counted[e];
+    }
+    if(!counted) {
+        fprintf(stderr, "unavailable    %s\n", hw_error ? strerror(hw_error) : "no events opened");
+        return;
+    }
+    fprintf(stderr, "nodes          %lld\n", hw_nodes);
+    if(hw_totals.running < hw_totals.enabled) {
+        /* the group shared the pmu, what it counted is a sample */
+        fprintf(stderr, "counting       %.1f%% of the time\n", 100.0 * hw_totals.running / hw_totals.enabled);
+    }
+    fprintf(stderr, "%-14s", "per line");
+    for(int e = 0; e < hw_events; e++) {
+        fprintf(stderr, " %13s", hw_event_name[e]);
+        if(e == hw_instructions) {
+            fprintf(stderr, " %5s", "IPC");
+        }
+    }
+    fprintf(stderr, "\n");
+    double lines = stats_lines > 0 ? stats_lines : 1;
+    for(int stage = 0; stage < stages; stage++) {
+        hw_report_row(stage_name[stage], hw_totals.counts[stage], lines);
+        for(int e = 0; e < hw_events; e++) {
+            total[e] += hw_totals.counts[stage][e];
+        }
+    }
+    hw_report_row("total", total, lines);
+    hw_report_row("per node", total, hw_nodes > 0 ? hw_nodes : 1);
+}
+
+void stats_report() {
+    stats_rss_final = stats_read_rss();
+    if(stats_rss_final > stats_rss_max) {
+        stats_rss_max = stats_rss_final;
+    }
+    fprintf(stderr, "--- stats ---\n");
+    fprintf(stderr, "lines          %lld\n", stats_lines);
+    fprintf(stderr, "kernels        %s\n", cpu_level_name[kernel_level]);
+    fprintf(stderr, "workers        %d%s\n", option_jobs, option_pin ? " pinned" : "");
+    fprintf(stderr, "rss warm-up    %ld KiB\n", stats_rss_warmup);
+    fprintf(stderr, "rss max        %ld KiB\n", stats_rss_max);
+    fprintf(stderr, "rss final      %ld KiB\n", stats_rss_final);
+    if(option_session != NULL) {
+        fprintf(stderr, "session hits   %lld of %lld lines\n", session_hits, session_lines);
+    }
+    if(balance_loads != NULL) {
+        balance_report();
+    }
+    if(editor_updates > 0) {
+        fprintf(stderr, "preview        %lld updates, mean %.1f us, max %.1f us\n", editor_updates,
+            editor_update_ns / 1e3 / editor_updates, editor_update_ns_max / 1e3);
+    }
+    if(option_stats_hw) {
+        hw_report();
+    }
+}
+
+/**
+ * NUMA topology.
+ *
+ * The cpus this process may run on, grouped by the node they belong to as
+ * listed in /sys/devices/system/node. Without sysfs every cpu is on node 0.
+*/
+#define MAX_CPUS 1024
+/* usable cpus ordered by node */
+int topology_cpus[MAX_CPUS];
+int topology_cpus_size = 0;
+/* node of every cpu */
+int topology_cpu_node[MAX_CPUS];
+int topology_nodes = 1;
+
+/**
+ * mark the cpus in a sysfs cpulist such as "0-3,8-11" as on node.
+*/
+void topology_parse_cpulist(const char *cpulist, int node, cpu_set_t *allowed) {
+    const char *p = cpulist;
+    while(*p >= '0' && *p <= '9') {
+        char *end;
+        int first = strtol(p, &end, 10);
+        int last = first;
+        if(*end == '-') {
+            last = strtol(end+1, &end, 10);
+        }
+        for(int cpu = first; cpu <= last && cpu < MAX_CPUS; cpu++) {
+            if(CPU_ISSET(cpu, allowed)) {
+                topology_cpu_node[cpu] = node;
+            }
+        }
+        p = *end == ',' ? end+1 : end;
+    }
+}
+
+void topology_detect() {
+    cpu_set_t allowed;
+    char path[64], cpulist[4096];
+    CPU_ZERO(&allowed);
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) == -1) {
+        CPU_SET(0, &allowed);
+    }
+    for(int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        topology_cpu_node[cpu] = CPU_ISSET(cpu, &allowed) ? 0 : -1;
+    }
+    for(int node = 0;; node++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        int fd = open(path, O_RDONLY);
+        if(fd == -1) {
+            break;
+        }
+        ssize_t n = read(fd, cpulist, sizeof(cpulist)-1);
+        close(fd);
+        cpulist[n > 0 ? n : 0] = 0;
+        topology_parse_cpulist(cpulist, node, &allowed);
+        topology_nodes = node+1;
+    }
+    topology_cpus_size = 0;
+    for(int node = 0; node < topology_nodes; node++) {
+        for(int cpu = 0; cpu < MAX_CPUS; cpu++) {
+            if(topology_cpu_node[cpu] == node) {
+                topology_cpus[topology_cpus_size++] = cpu;
+            }
+        }
+    }
+}
+
+/**
+ * Parallel batch evaluation.
+ *
+ * With -j N the input is cut into chunks of whole lines evaluated by N
+ * worker threads. Chunks are dealt round-robin and every worker owns two
+ * chunk slots whose buffers it allocates and touches itself, after pinning
+ * with --pin, so their pages live on the worker's NUMA node. The main
+ * thread reads input straight into the slot of the worker that will
+ * evaluate it and writes results out in input order.
+ *
+ * Lines cost about the same per token whatever their size, so a chunk ends
+ * at CHUNK_SIZE bytes or at CHUNK_COST tokens, counted from the byte
+ * classes of the lexer as the lines are cut. A line of CHUNK_COST tokens
+ * or more is a chunk of its own, parsed by as many threads as there are
+ * workers when it is long enough for the parallel front end. A worker with
+ * no chunk of its own takes the earliest one waiting in another worker's
+ * slots, so a costly chunk holds up only its own worker.
+*/
+#define CHUNK_SIZE (1 << 18)
+/* a chunk holds whole lines, a terminating newline may be added at eof */
+#define CHUNK_CAPACITY (CHUNK_SIZE + 1)
+/* tokens in a chunk, some 15 ms of evaluation */
+#define CHUNK_COST (1 << 16)
+
+enum chunk_state {
+    chunk_empty,
+    chunk_filled,
+    /* a worker is evaluating it */
+    chunk_taken,
+    chunk_done
+};
+
+typedef struct chunk_slot {
+    enum chunk_state state;
+    char *input;
+    /* bytes of input, -1 tells the worker to stop */
+    int input_size;
+    /* grows past CHUNK_CAPACITY for lines longer than a chunk */
+    size_t input_capacity;
+    /* results and diagnostics of the chunk's lines */
+    FILE *results;
+    char *results_data;
+    size_t results_size;
+    FILE *diagnostics;
+    char *diagnostics_data;
+    size_t diagnostics_size;
+    /* errors in batch mode, lines numbered from the chunk's first */
+    diagnostic_log_t log;
+    /* and the slowest of its lines */
+    slow_lines_t slow;
+    /* expressions evaluated and lines including blank ones */
+    long long lines;
+    long long line_count;
+    int status;
+    /* the chunk is a line over the memory budget, reported and not evaluated */
+    int dropped;
+    /* number of the chunk over all sources, and its lines for --scan */
+    long long chunk;
+    scan_chunk_t scan;
+    /* the chunk is one costly line */
+    int standalone;
+} chunk_slot_t;
+
+typedef struct worker {
+    pthread_t thread;
+    /* cpu and node the worker is pinned to, -1 if not pinned */
+    int cpu;
+    int node;
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    chunk_slot_t slots[2];
+    /* buffers allocated, or allocation failed */
+    int ready;
+    /* every worker is ready, or -1 if they are to return at once */
+    int go;
+    worker_load_t load;
+} worker_t;
+
+worker_t *workers;
+/* guards the state of every chunk slot */
+pthread_mutex_t chunks_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t chunks_changed = PTHREAD_COND_INITIALIZER;
+
+/**
+ * evaluate the lines in [*p, end) that end with a newline and leave *p at
+ * the first one that does not. lines counts every line, errors are reported
+ * on the count, expressions counts the lines evaluated.
+*/
+int process_lines(const char **p, const char *end, long long *lines, long long *expressions) {
+    int status = SUCCESS;
+    const char *newline;
+    while(*p < end && (newline = kernel_find_newline(*p, end)) != NULL) {
+        int size = newline+1-*p;
+        diagnostic_line = ++*lines;
+        if(!line_is_all_whitespaces(*p, size)) {
+            if(process_line(*p, size) != SUCCESS) {
+                status = FAILURE;
+            }
+            ++*expressions;
+        }
+        *p += size;
+    }
+    return status;
+}
+
+/**
+ * evaluate every line of a chunk.
+*/
+void process_chunk(chunk_slot_t *slot) {
+    const char *p = slot->input;
+    const char *end = slot->input + slot->input_size;
+    rewind(slot->results);
+    rewind(slot->diagnostics);
+    result_stream = slot->results;
+    diagnostic_stream = slot->diagnostics;
+    diagnostic_log = &slot->log;
+    slow_lines = &slot->slow;
+    scan_chunk = option_scan ? &slot->scan : NULL;
+    standalone_parse_threads = slot->standalone ? option_jobs : 0;
+    slot->lines = 0;
+    slot->line_count = 0;
+    slot->status = process_lines(&p, end, &slot->line_count, &slot->lines);
+    if(slot->dropped) {
+        diagnostic_line = ++slot->line_count;
+        slot->lines++;
+        report_memory_budget_exceeded();
+        if(option_scan) {
+            scan_add(0, 1);
+        }
+        slot->status = FAILURE;
+    }
+    if(option_scan) {
+        scan_chunk_finish(&slot->scan, slot->chunk, slot->results);
+    }
+    fflush(slot->results);
+    fflush(slot->diagnostics);
+}
+
+/**
+ * pin the calling worker to its cpu, if it has one.
+*/
+void worker_pin(worker_t *w) {
+    if(w->cpu != -1) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(w->cpu, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+}
+
+/**
+ * tell workers_start whether w is ready, 1, or could not set up, -1, and
+ * wait to hear whether every worker started. Returns whether w goes on.
+*/
+int worker_ready(worker_t *w, int ready) {
+    pthread_mutex_lock(&w->mutex);
+    w->ready = ready;
+    pthread_cond_broadcast(&w->changed);
+    while(w->go == 0) {
+        pthread_cond_wait(&w->changed, &w->mutex);
+    }
+    int go = w->go == 1 && ready == 1;
+    pthread_mutex_unlock(&w->mutex);
+    return go;
+}
+
+/**
+ * the earliest chunk waiting in the slots of w, else the earliest waiting
+ * in the slots of another worker on its node, else in any worker's. A chunk
+ * is read into pages on its worker's node, so it is only stolen across
+ * nodes when there is nothing closer. The main thread's request to stop is
+ * only taken by its worker. Called with chunks_mutex held.
+*/
+chunk_slot_t *worker_take(worker_t *w) {
+    chunk_slot_t *slot = NULL;
+    for(int i = 0; i < 2; i++) {
+        chunk_slot_t *own = &w->slots[i];
+        if(own->state == chunk_filled && (slot == NULL || own->chunk < slot->chunk)) {
+            slot = own;
+        }
+    }
+    for(int remote = 0; slot == NULL && remote < 2; remote++) {
+        for(int i = 0; i < option_jobs; i++) {
+            if((workers[i].node != w->node) != remote) {
+                continue;
+            }
+            for(int j = 0; j < 2; j++) {
+                chunk_slot_t *other = &workers[i].slots[j];
+                if(other->state == chunk_filled && other->input_size >= 0 &&
+                    (slot == NULL || other->chunk < slot->chunk)) {
+                    slot = other;
+                }
+            }
+        }
+    }
+    return slot;
+}
+
+void *worker_main(void *argument) {
+    worker_t *w = argument;
+    int ready = 1;
+    worker_pin(w);
+    /* first touch from this thread places the pages on its node */
+    for(int i = 0; i < 2; i++) {
+        chunk_slot_t *slot = &w->slots[i];
+        slot->input = malloc(CHUNK_CAPACITY);
+        slot->results = open_memstream(&slot->results_data, &slot->results_size);
+        slot->diagnostics = open_memstream(&slot->diagnostics_data, &slot->diagnostics_size);
+        if(slot->input == NULL || slot->results == NULL || slot->diagnostics == NULL) {
+            ready = -1;
+            break;
+        }
+        memset(slot->input, 0, CHUNK_CAPACITY);
+        slot->input_capacity = CHUNK_CAPACITY;
+    }
+    int go = worker_ready(w, ready);
+    while(go) {
+        chunk_slot_t *slot;
+        pthread_mutex_lock(&chunks_mutex);
+        while((slot = worker_take(w)) == NULL) {
+            pthread_cond_wait(&chunks_changed, &chunks_mutex);
+        }
+        slot->state = chunk_taken;
+        pthread_mutex_unlock(&chunks_mutex);
+        if(slot->input_size < 0) {
+            break;
+        }
+        long long start = option_stats ? stats_now_ns() : 0;
+        process_chunk(slot);
+        if(option_stats) {
+            w->load.busy_ns += stats_now_ns() - start;
+            w->load.tasks++;
+            w->load.stolen += slot != &w->slots[0] && slot != &w->slots[1];
+            w->load.lines += slot->lines;
+        }
+        pthread_mutex_lock(&chunks_mutex);
+        slot->state = chunk_done;
+        pthread_cond_broadcast(&chunks_changed);
+        pthread_mutex_unlock(&chunks_mutex);
+    }
+    evaluation_release();
+    return NULL;
+}
+
+/**
+ * wait until a worker finished slot.
+*/
+void worker_wait_done(chunk_slot_t *slot) {
+    long long start = option_stats ? stats_now_ns() : 0;
+    pthread_mutex_lock(&chunks_mutex);
+    while(slot->state != chunk_done) {
+        pthread_cond_wait(&chunks_changed, &chunks_mutex);
+    }
+    pthread_mutex_unlock(&chunks_mutex);
+    if(option_stats) {
+        balance_wait_ns += stats_now_ns() - start;
+    }
+}
+
+/**
+ * hand a filled slot to its worker, or any idle one.
+*/
+void worker_post(chunk_slot_t *slot) {
+    pthread_mutex_lock(&chunks_mutex);
+    slot->state = chunk_filled;
+    pthread_cond_broadcast(&chunks_changed);
+    pthread_mutex_unlock(&chunks_mutex);
+}
+
+/**
+ * start the workers running routine, pinned to cpus in node order with
+ * --pin. routine calls worker_ready once it is set up and only goes on if
+ * every worker could, otherwise the ones started are joined.
+*/
+int workers_start(void *(*routine)(void *)) {
+    workers = calloc(option_jobs, sizeof(worker_t));
+    if(workers == NULL) {
+        perror("calloc");
+        return FAILURE;
+    }
+    int status = SUCCESS;
+    int started = 0;
+    for(; started < option_jobs; started++) {
+        worker_t *w = &workers[started];
+        w->cpu = option_pin ? topology_cpus[started % topology_cpus_size] : -1;
+        w->node = option_pin ? topology_cpu_node[w->cpu] : -1;
+        pthread_mutex_init(&w->mutex, NULL);
+        pthread_cond_init(&w->changed, NULL);
+        if(pthread_create(&w->thread, NULL, routine, w) != 0) {
+            fprintf(stderr, "Could not start worker %d.\n", started);
+            status = FAILURE;
+            break;
+        }
+    }
+    for(int i = 0; i < started; i++) {
+        pthread_mutex_lock(&workers[i].mutex);
+        while(workers[i].ready == 0) {
+            pthread_cond_wait(&workers[i].changed, &workers[i].mutex);
+        }
+        if(workers[i].ready != 1) {
+            fprintf(stderr, "Worker %d could not allocate its buffers.\n", i);
+            status = FAILURE;
+        }
+        pthread_mutex_unlock(&workers[i].mutex);
+    }
+    for(int i = 0; i < started; i++) {
+        pthread_mutex_lock(&workers[i].mutex);
+        workers[i].go = status == SUCCESS ? 1 : -1;
+        pthread_cond_broadcast(&workers[i].changed);
+        pthread_mutex_unlock(&workers[i].mutex);
+    }
+    if(status != SUCCESS) {
+        for(int i = 0; i < started; i++) {
+            pthread_join(workers[i].thread, NULL);
+        }
+        free(workers);
+        workers = NULL;
+    }
+    return status;
+}
+
+void topology_report() {
+    fprintf(stderr, "--- topology ---\n");
+    fprintf(stderr, "nodes          %d\n", topology_nodes);
+    for(int node = 0; node < topology_nodes; node++) {
+        fprintf(stderr, "node %-9d cpus", node);
+        for(int i = 0; i < topology_cpus_size; i++) {
+            if(topology_cpu_node[topology_cpus[i]] == node) {
+                fprintf(stderr, " %d", topology_cpus[i]);
+            }
+        }
+        fputc('\n', stderr);
+    }
+    for(int i = 0; i < option_jobs; i++) {
+        if(workers[i].cpu == -1) {
+            fprintf(stderr, "worker %-7d unpinned\n", i);
+        } else {
+            fprintf(stderr, "worker %-7d cpu %d node %d\n", i, workers[i].cpu, workers[i].node);
+        }
+    }
+}
+
+/**
+ * grow the input buffer of slot towards size bytes, as far as the memory
+ * budget allows. Fails if it could not grow at all.
+*/
+int chunk_reserve(chunk_slot_t *slot, size_t size) {
+    size_t limit = memory_budget > CHUNK_CAPACITY ? memory_budget : CHUNK_CAPACITY;
+    if(size <= slot->input_capacity) {
+        return SUCCESS;
+    }
+    if(size < slot->input_capacity*2) {
+        size = slot->input_capacity*2;
+    }
+    if(size > limit) {
+        size = limit;
+    }
+    if(size <= slot->input_capacity || size > INT_MAX) {
+        return FAILURE;
+    }
+    char *input = realloc(slot->input, size);
+    if(input == NULL) {
+        perror("realloc");
+        return FAILURE;
+    }
+    slot->input = input;
+    slot->input_capacity = size;
+    return SUCCESS;
+}
+
+/**
+ * read the next chunk of whole lines into slot. The partial line at the end
+ * of the previous chunk is carried over.
+*/
+char *carry = NULL;
+size_t carry_size = 0;
+
+/**
+ * keep the lines of the size bytes in slot up to CHUNK_COST tokens, or a
+ * costlier line alone, and carry the rest over to the next chunk. Returns
+ * the bytes kept.
+*/
+int chunk_cut(chunk_slot_t *slot, int size) {
+    const char *begin = slot->input, *end = begin + size, *line = begin;
+    long long cost = 0, line_cost = 0;
+    int number = 0;
+    slot->standalone = 0;
+    for(const char *p = begin; p < end; p++) {
+        unsigned char class = lexer_class[(unsigned char)*p];
+        if(class == class_digit || class == class_point) {
+            line_cost += !number;
+            number = 1;
+            continue;
+        }
+        number = 0;
+        line_cost += class != class_space;
+        if(*p != '\n') {
+            continue;
+        }
+        if(line_cost >= CHUNK_COST) {
+            if(line == begin) {
+                slot->standalone = 1;
+                balance_standalone++;
+                end = p+1;
+            } else {
+                end = line;
+            }
+            break;
+        }
+        cost += line_cost;
+        line_cost = 0;
+        line = p+1;
+        if(cost >= CHUNK_COST) {
+            end = line;
+            break;
+        }
+    }
+    if(end < begin + size) {
+        /* what follows is contiguous with the carry, if there is one */
+        carry = (char *)end;
+        carry_size += begin + size - end;
+    }
+    return end - begin;
+}
+
+/**
+ * read past the rest of a line that does not fit in slot within the memory
+ * budget, the worker reports it in place of evaluating it.
+*/
+int fill_chunk_drop(chunk_slot_t *slot) {
+    char *newline = NULL;
+    while(newline == NULL && !source_file_eof_read) {
+        ssize_t n = read(source_file_fd, slot->input, slot->input_capacity);
+        if(n == -1) {
+            perror("read");
+            return FAILURE;
+        }
+        source_file_eof_read = n == 0;
+        if((newline = memchr(slot->input, '\n', n)) != NULL) {
+            carry = newline+1;
+            carry_size = slot->input+n-carry;
+        }
+    }
+    slot->input_size = 0;
+    slot->standalone = 0;
+    slot->dropped = 1;
+    return SUCCESS;
+}
+
+int fill_chunk(chunk_slot_t *slot) {
+    size_t size = carry_size;
+    slot->dropped = 0;
+    chunk_reserve(slot, carry_size + CHUNK_SIZE + 1);
+    if(slot->input_capacity <= carry_size) {
+        return FAILURE;
+    }
+    if(carry_size > 0) {
+        memcpy(slot->input, carry, carry_size);
+        carry_size = 0;
+    }
+    for(;;) {
+        /* one byte is kept for the newline added at eof */
+        while(size < slot->input_capacity-1 && !source_file_eof_read) {
+            ssize_t n = read(source_file_fd, slot->input+size, slot->input_capacity-1-size);
+            if(n == -1) {
+                perror("read");
+                return FAILURE;
+            }
+            source_file_eof_read = n == 0;
+            size += n;
+        }
+        if(source_file_eof_read) {
+            if(size > 0 && slot->input[size-1] != '\n') {
+                /* last line has no newline, terminate it */
+                slot->input[size++] = '\n';
+            }
+            break;
+        }
+        char *last_newline = memrchr(slot->input, '\n', size);
+        if(last_newline != NULL) {
+            /* the tail stays readable in this slot until the next chunk copies it */
+            carry = last_newline+1;
+            carry_size = slot->input+size-carry;
+            size -= carry_size;
+            break;
+        }
+        /* a line longer than the chunk, grown up to the memory budget */
+        if(chunk_reserve(slot, slot->input_capacity*2) == FAILURE) {
+            return fill_chunk_drop(slot);
+        }
+    }
+    slot->input_size = chunk_cut(slot, size);
+    return SUCCESS;
+}
+
+/**
+ * wait for the workers to return.
+*/
+void workers_join() {
+    for(int i = 0; i < option_jobs; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    if(option_stats && (balance_loads = calloc(option_jobs, sizeof(worker_load_t))) != NULL) {
+        balance_workers = option_jobs;
+        for(int i = 0; i < option_jobs; i++) {
+            balance_loads[i] = workers[i].load;
+        }
+    }
+    free(workers);
+}
+
+/* chunks handed to the workers and written out, over all source files */
+long long chunks_posted = 0;
+long long chunks_written = 0;
+
+/**
+ * evaluate the source file on the workers, returns the exit status.
+*/
+int run_parallel() {
+    int return_code = SUCCESS;
+    long long next = chunks_posted;
+    long long written = chunks_written;
+    /* lines before the next chunk to write */
+    long long line_base = 0;
+    carry_size = 0;
+    for(;;) {
+        worker_t *w = &workers[next % option_jobs];
+        chunk_slot_t *slot = &w->slots[(next / option_jobs) % 2];
+        /* the slot last held chunk next - 2 * jobs, write everything up to it */
+        while(written <= next - 2*option_jobs) {
+            worker_t *ww = &workers[written % option_jobs];
+            chunk_slot_t *done = &ww->slots[(written / option_jobs) % 2];
+            worker_wait_done(done);
+            fwrite(done->results_data, 1, done->results_size, stdout);
+            fwrite(done->diagnostics_data, 1, done->diagnostics_size, stderr);
+            if(diagnostics_file != NULL) {
+                diagnostics_flush(&done->log, line_base);
+            }
+            if(option_slow_lines) {
+                slow_lines_merge(&done->slow, line_base, diagnostics_source);
+            }
+            line_base += done->line_count;
+            return_code |= done->status;
+            stats_count_lines(done->lines);
+            done->state = chunk_empty;
+            written++;
+        }
+        if(source_file_eof_read && carry_size == 0) {
+            break;
+        }
+        stage_enter(stage_read);
+        if(fill_chunk(slot) != SUCCESS) {
+            return_code = FAILURE;
+            break;
+        }
+        stage_enter(stage_other);
+        if(slot->input_size == 0 && !slot->dropped) {
+            break;
+        }
+        if(capture_file != NULL) {
+            capture_lines(slot->input, slot->input + slot->input_size);
+        }
+        slot->chunk = next;
+        worker_post(slot);
+        next++;
+    }
+    /* drain chunks in flight */
+    for(; written < next; written++) {
+        worker_t *ww = &workers[written % option_jobs];
+        chunk_slot_t *done = &ww->slots[(written / option_jobs) % 2];
+        worker_wait_done(done);
+        fwrite(done->results_data, 1, done->results_size, stdout);
+        fwrite(done->diagnostics_data, 1, done->diagnostics_size, stderr);
+        if(diagnostics_file != NULL) {
+            diagnostics_flush(&done->log, line_base);
+        }
+        if(option_slow_lines) {
+            slow_lines_merge(&done->slow, line_base, diagnostics_source);
+        }
+        line_base += done->line_count;
+        return_code |= done->status;
+        stats_count_lines(done->lines);
+        done->state = chunk_empty;
+    }
+    chunks_posted = chunks_written = next;
+    return return_code;
+}
+
+/**
+ * stop the workers once every chunk was written.
+*/
+void workers_stop() {
+    long long next = chunks_posted;
+    /* every worker's next slot is empty now, tell them to stop */
+    for(int i = 0; i < option_jobs; i++) {
+        long long chunk = next;
+        while(chunk % option_jobs != i) {
+            chunk++;
+        }
+        chunk_slot_t *slot = &workers[i].slots[(chunk / option_jobs) % 2];
+        slot->input_size = -1;
+        worker_post(slot);
+    }
+    workers_join();
+}
+
+/**
+ * Pipe output.
+ *
+ * When stdout is a pipe, output is gathered in a page-aligned buffer as
+ * large as the pipe and every full buffer is given to the pipe with
+ * vmsplice and SPLICE_F_GIFT instead of being copied into it by write.
+ * Pages given away are never written again: the buffer is unmapped, the
+ * pipe keeps its own references to them, and fresh pages are mapped for
+ * the output that follows. Files, terminals and pipes vmsplice does not
+ * work on are written as before.
+*/
+#define PIPE_OUTPUT_SIZE (1 << 18)
+
+typedef struct pipe_output {
+    int fd;
+    char *buffer;
+    /* bytes in the buffer */
+    size_t size;
+    /* size of the pipe and of the buffer */
+    size_t capacity;
+    /* pages of the buffer were given to the pipe */
+    int gifted;
+    /* vmsplice failed, copy with write */
+    int use_write;
+} pipe_output_t;
+
+pipe_output_t pipe_output;
+
+/**
+ * send size bytes at data to the pipe.
+*/
+int pipe_output_send(pipe_output_t *out, char *data, size_t size) {
+    struct iovec iov = {data, size};
+    while(iov.iov_len > 0) {
+        ssize_t n;
+        if(out->use_write) {
+            n = write(out->fd, iov.iov_base, iov.iov_len);
+        } else {
+            n = vmsplice(out->fd, &iov, 1, SPLICE_F_GIFT);
+        }
+        if(n == -1) {
+            if(errno == EINTR) {
+                continue;
+            }
+            if(!out->use_write && (errno == EINVAL || errno == ENOSYS)) {
+                out->use_write = 1;
+                continue;
+            }
+            return FAILURE;
+        }
+        out->gifted |= !out->use_write;
+        iov.iov_base = (char *)iov.iov_base + n;
+        iov.iov_len -= n;
+    }
+    return SUCCESS;
+}
+
+/**
+ * replace the buffer given to the pipe by fresh pages.
+*/
+int pipe_output_renew(pipe_output_t *out) {
+    munmap(out->buffer, out->capacity);
+    out->gifted = 0;
+    out->buffer = mmap(NULL, out->capacity, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if(out->buffer == MAP_FAILED) {
+        out->buffer = NULL;
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+/* fopencookie write function, 0 on error */
+ssize_t pipe_output_write(void *cookie, const char *data, size_t size) {
+    pipe_output_t *out = cookie;
+    size_t written = 0;
+    if(out->buffer == NULL) {
+        return 0;
+    }
+    while(written < size) {
+        size_t n = out->capacity - out->size;
+        if(n > size - written) {
+            n = size - written;
+        }
+        memcpy(out->buffer + out->size, data + written, n);
+        out->size += n;
+        written += n;
+        if(out->size == out->capacity) {
+            if(pipe_output_send(out, out->buffer, out->size) == FAILURE) {
+                return 0;
+            }
+            out->size = 0;
+            if(out->gifted && pipe_output_renew(out) == FAILURE) {
+                return 0;
+            }
+        }
+    }
+    return size;
+}
+
+/**
+ * fopencookie close function. The rest is copied with write, it is less
+ * than a buffer.
+*/
+int pipe_output_close(void *cookie) {
+    pipe_output_t *out = cookie;
+    if(out->buffer == NULL) {
+        return EOF;
+    }
+    out->use_write = 1;
+    int status = pipe_output_send(out, out->buffer, out->size);
+    munmap(out->buffer, out->capacity);
+    return status == SUCCESS ? 0 : EOF;
+}
+
+/**
+ * replace stdout by a stream writing through pipe_output if stdout is a
+ * pipe. Any other stdout is left alone.
+*/
+void pipe_output_open() {
+    struct stat st;
+    if(fstat(STDOUT_FILENO, &st) == -1 || !S_ISFIFO(st.st_mode)) {
+        return;
+    }
+    /* a larger pipe means fewer splices, the buffer follows whatever it is */
+    fcntl(STDOUT_FILENO, F_SETPIPE_SZ, PIPE_OUTPUT_SIZE);
+    int capacity = fcntl(STDOUT_FILENO, F_GETPIPE_SZ);
+    if(capacity <= 0 || capacity % sysconf(_SC_PAGESIZE) != 0) {
+        return;
+    }
+    char *buffer = mmap(NULL, capacity, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if(buffer == MAP_FAILED) {
+        return;
+    }
+    pipe_output.fd = STDOUT_FILENO;
+    pipe_output.buffer = buffer;
+    pipe_output.capacity = capacity;
+    cookie_io_functions_t functions = {.write = pipe_output_write, .close = pipe_output_close};
+    FILE *stream = fopencookie(&pipe_output, "w", functions);
+    if(stream == NULL) {
+        munmap(buffer, capacity);
+        pipe_output.capacity = 0;
+        return;
+    }
+    fflush(stdout);
+    stdout = stream;
+}
+
+/**
+ * Source files.
+ *
+ * Each source is evaluated to its end in turn. With several files each one
+ * gets a ==> path <== header and, while one is evaluated, the files after
+ * it are read ahead with io_uring: regular files of up to
+ * LOADED_FILE_MAX bytes are read whole into memory by many reads in flight
+ * at once, bounded by FILES_IN_FLIGHT files and the memory budget. Other
+ * files, stdin and every file when io_uring is not available, or from the
+ * first time the ring fails, are read line by line like a single source.
+ * --io=blocking turns read-ahead off.
+*/
+#define FILES_IN_FLIGHT 64
+#define LOADED_FILE_MAX ((size_t)16 << 20)
+/* a file is read in pieces of at most this size */
+#define FILE_READ_SIZE (1 << 20)
+#define URING_ENTRIES 256
+
+/**
+ * evaluate the opened source file to its end, returns the exit status.
+*/
+int evaluate_source() {
+    int status = SUCCESS;
+    source_file_eof_read = 0;
+    source_file_line_number = 0;
+    source_buffer_position = source_buffer_size = 0;
+    if(option_jobs > 0) {
+        return run_parallel();
+    }
+    while(source_file_eof_read == 0) {
+        stage_enter(stage_read);
+        if((editor_active ? editor_read_line() : read_line()) == FAILURE) {
+            status = FAILURE;
+            break;
+        }
+        if(source_file_eof_read && source_file_line_occupied_size == 1 && source_file_line[0] == -1) {
+            /* the end of input marker, not a line */
+            break;
+        }
+        diagnostic_line = source_file_line_number;
+        if(source_file_line_dropped) {
+            /* longer than the memory budget allows, it is not evaluated */
+            report_memory_budget_exceeded();
+            if(option_scan) {
+                scan_add(0, 1);
+            }
+            status = FAILURE;
+        } else {
+            if(capture_file != NULL && source_file_line[source_file_line_occupied_size-1] == '\n') {
+                capture_line(source_file_line, source_file_line_occupied_size, capture_now());
+            }
+            if(process_line(source_file_line, source_file_line_occupied_size) != SUCCESS) {
+                status = FAILURE;
+            }
+        }
+        if(diagnostics_file != NULL) {
+            diagnostics_flush(&main_diagnostic_log, 0);
+        }
+        if(option_line_buffered) {
+            fflush(result_stream);
+            if(diagnostics_file != NULL) {
+                fflush(diagnostics_file);
+            }
+        }
+        if(option_stats) {
+            stats_count_lines(1);
+        }
+    }
+    return status;
+}
+
+enum source_file_state {
+    file_unopened,
+    /* opened, waiting for memory to read it into */
+    file_opened,
+    file_loading,
+    /* read line by line when its turn comes */
+    file_streamed,
+    file_failed
+};
+
+typedef struct source_file {
+    const char *path;
+    enum source_file_state state;
+    int fd;
+    /* file contents, room for a newline after them */
+    char *data;
+    size_t size;
+    /* bytes for which reads were queued */
+    size_t queued;
+    int reads_pending;
+    /* a read found the end of the file before size */
+    size_t end;
+    /* errno of the failed open or read */
+    int error;
+} source_file_t;
+
+/* a read in flight, the sqe's user_data is its index */
+typedef struct file_read {
+    source_file_t *file;
+    size_t offset;
+    size_t length;
+} file_read_t;
+
+/* submission and completion rings mapped from the kernel */
+typedef struct uring {
+    int fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    /* sqes queued but not submitted, reads not completed */
+    unsigned to_submit;
+    unsigned in_flight;
+    file_read_t reads[URING_ENTRIES];
+    int free_reads[URING_ENTRIES];
+    int free_reads_size;
+} uring_t;
+
+/**
+ * set up a ring of URING_ENTRIES entries with the raw system calls.
+*/
+int uring_setup(uring_t *ring) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if(ring->fd == -1) {
+        return FAILURE;
+    }
+    /* kernels without IORING_OP_READ have no probe either, files are read as before */
+    struct io_uring_probe *probe = calloc(1, sizeof(*probe) + 256*sizeof(struct io_uring_probe_op));
+    int readable = probe != NULL &&
+        syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+        probe->last_op >= IORING_OP_READ && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    if(!readable) {
+        close(ring->fd);
+        return FAILURE;
+    }
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if(params.features & IORING_FEAT_SINGLE_MMAP) {
+        if(ring->cq_ring_size > ring->sq_ring_size) {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+        ring->fd, IORING_OFF_SQ_RING);
+    ring->cq_ring = ring->sq_ring;
+    if(ring->sq_ring != MAP_FAILED && !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+            ring->fd, IORING_OFF_CQ_RING);
+    }
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+        ring->fd, IORING_OFF_SQES);
+    if(ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        close(ring->fd);
+        return FAILURE;
+    }
+    char *sq = ring->sq_ring;
+    char *cq = ring->cq_ring;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    ring->to_submit = ring->in_flight = 0;
+    for(int i = 0; i < URING_ENTRIES; i++) {
+        ring->free_reads[i] = URING_ENTRIES-1-i;
+    }
+    ring->free_reads_size = URING_ENTRIES;
+    return SUCCESS;
+}
+
+void uring_release(uring_t *ring) {
+    munmap(ring->sqes, ring->sqes_size);
+    if(ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+}
 
 /**
- * token stream populated by the tokenizer stage.
- * 
-*/
-static token_list_t *parser_token_stream = NULL;
-/**
- * pointer to the token that will be returned when
- * the parser requests a new one. 
-*/
-static token_t *parser_next_token = NULL;
-/**
- * The last token to have been requested by the parser.
+ * queue a read of length bytes at offset of file, the caller checked that
+ * a read is free.
 */
-static token_t *parser_active_token = NULL;
-
-char *get_token_lexeme(token_t *token) {
-    static char *operator_lexeme[] = {"+", "-", "*", "/", ")", "(", "-1", "\\n"};
-    switch(token->type) {
-        case token_number: return token->lexeme;
-        case token_plus : return operator_lexeme[0];
-        case token_minus : return operator_lexeme[1];
-        case token_times : return operator_lexeme[2];
-        case token_divide : return operator_lexeme[3];
-        case token_bracket_close : return operator_lexeme[4];
-        case token_bracket_open : return operator_lexeme[5];
-        case token_end_of_file : return operator_lexeme[6];
-        case token_end_of_expression : return operator_lexeme[7];
-    }
-    //unreacheable
-    return NULL;
+void uring_queue_read(uring_t *ring, source_file_t *file, size_t offset, size_t length) {
+    int id = ring->free_reads[--ring->free_reads_size];
+    ring->reads[id] = (file_read_t){file, offset, length};
+    unsigned tail = *ring->sq_tail;
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = file->fd;
+    sqe->addr = (unsigned long)(file->data + offset);
+    sqe->len = length;
+    sqe->off = offset;
+    sqe->user_data = id;
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail+1, __ATOMIC_RELEASE);
+    ring->to_submit++;
+    ring->in_flight++;
+    file->reads_pending++;
 }
 
 /**
- * set the stream of tokens to use. 
+ * submit the queued reads and wait for at least wait completions.
 */
-int parser_register_token_stream(token_list_t *stream) {
-    parser_token_stream = stream;
-    if(stream != NULL) {
-        parser_next_token = stream->head;
+int uring_enter(uring_t *ring, unsigned wait) {
+    while(ring->to_submit > 0 || wait > 0) {
+        int n = syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, wait,
+            wait > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if(n == -1) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return FAILURE;
+        }
+        ring->to_submit -= n;
+        if(wait > 0) {
+            break;
+        }
     }
     return SUCCESS;
 }
 
 /**
- * Get a token from the registered stream.
- * 
- * Parser routines don't have to know how to access the stream.
+ * wait for every read the kernel took from the ring to complete, the ones
+ * still queued are dropped with the ring. Fails if it cannot wait, the
+ * kernel may then still write to the buffers of the reads.
 */
-token_t *parser_get_next_token() {
-    if(parser_next_token != NULL) {
-        parser_active_token = parser_next_token;
-        parser_next_token = parser_next_token->next;
+int uring_drain(uring_t *ring) {
+    unsigned queued = *ring->sq_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    unsigned submitted = ring->in_flight - queued;
+    while(submitted > 0) {
+        unsigned head = *ring->cq_head;
+        unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        if(head == tail) {
+            if(syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) == -1 &&
+                errno != EINTR) {
+                return FAILURE;
+            }
+            continue;
+        }
+        submitted -= tail - head;
+        __atomic_store_n(ring->cq_head, tail, __ATOMIC_RELEASE);
     }
-    return parser_active_token;
+    return SUCCESS;
 }
 
-/* compare a token's type to x */
-#define token_type_is(x) \
-    (parser_active_token->type == x)
-
-/**
- * Grammar's EBNF
- * 
- *  0. calculator           ->  arithmetic EOF
- *  1. arithmetic           ->  expression EOX
- *  2. expression           ->  add_expression
- *  3.                      |   EPSILON                       
- *  4. add_expression       ->  sub_expression add_expression_p
- *  5. add_expression_p     ->  ADD  sub_expression add_expression_p
- *  6.                      |   EPSILON
- *  7. sub_expression       ->  mul_expression sub_expression_p
- *  8. sub_expression_p     ->  SUB  mul_expression sub_expression_p
- *  9.                      |   EPSILON
- * 10. mul_expression       ->  div_expression mul_expression_p
- * 11. mul_expression_p     ->  MUL  div_expression mul_expression_p
- * 12.                      |   EPSILON
- * 13. div_expression       ->  unit_expression div_expression_p
- * 14. add_expression_p     ->  DIV  unit_expression div_expression_p
- * 15.                      |   EPSILON
- * 16. unit_expression      ->  NUMBER
- * 17.                      |   OPENBRACKET add_expression CLOSEBRACKET
-*/
-
-int parser_parse_add_expression(ast_t **tree);
-int parser_parse_expression(ast_t **tree);
-int parser_parse_sub_expression(ast_t **tree);
-int parser_parse_mul_expression(ast_t **tree);
-int parser_parse_div_expression(ast_t **tree);
-int parser_parse_unit_expression(ast_t **tree);
-
 /**
- * production 0
+ * account for the completed reads, short ones are queued again for the rest.
 */
-int parse_token_stream_into_ast(token_list_t *stream, ast_t **tree) {
-    int r = SUCCESS;
-    parser_register_token_stream(stream);
-    parser_get_next_token();
-    /* no processing on eof */
-    if(!token_type_is(token_end_of_file)) {
-        r = parser_parse_expression(tree);
+void uring_reap(uring_t *ring) {
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    for(; head != tail; head++) {
+        struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+        int id = cqe->user_data;
+        file_read_t read = ring->reads[id];
+        source_file_t *file = read.file;
+        ring->free_reads[ring->free_reads_size++] = id;
+        ring->in_flight--;
+        file->reads_pending--;
+        if(cqe->res < 0) {
+            file->error = -cqe->res;
+        } else if(cqe->res == 0) {
+            /* the file shrank since it was opened */
+            if(read.offset < file->end) {
+                file->end = read.offset;
+            }
+        } else if((size_t)cqe->res < read.length) {
+            uring_queue_read(ring, file, read.offset + cqe->res, read.length - cqe->res);
+        }
     }
-    return r;
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
 }
 
 /**
- * Productions 1, 2 & 3
+ * open a file, it is read ahead if it is small and regular.
 */
-int parser_parse_expression(ast_t **tree) {
-    /* Our input system ignores blank and empty lines therefore the active token
-    at this point cannot be of type EOX
-    */
-    int r = parser_parse_add_expression(tree);
-    if(r == SUCCESS && !token_type_is(token_end_of_expression)&& !token_type_is(token_end_of_file)) {
-        fprintf(stderr, "\033[1;31mSyntaxError: Expected end of expression near %c.\033[0m\n", get_token_lexeme(parser_active_token)[0]);
-        r = FAILURE;
+void source_file_open(source_file_t *file, int read_ahead) {
+    struct stat st;
+    if((file->fd = source_open(file->path)) == -1 || fstat(file->fd, &st) == -1) {
+        file->error = errno;
+        file->state = file_failed;
+        return;
+    }
+    file->size = file->end = st.st_size;
+    /* stdin and compressed files are streamed */
+    if(read_ahead && file->fd != STDIN_FILENO && S_ISREG(st.st_mode) && file->size <= LOADED_FILE_MAX && file->size < memory_budget) {
+        file->state = file_opened;
+    } else {
+        file->state = file_streamed;
     }
-    parser_get_next_token();
-    return r;
 }
 
+typedef struct source_files {
+    source_file_t *files;
+    int size;
+    /* files evaluated and files opened */
+    int evaluated;
+    int opened;
+    /* bytes of the files being read ahead */
+    size_t loading;
+    uring_t ring;
+} source_files_t;
+
 /**
- * Productions 4, 5 & 6
+ * give up reading ahead after the ring failed: the files being read ahead
+ * are streamed like the ones after them once the reads in flight are done.
 */
-int parser_parse_add_expression(ast_t **tree) {
-    int r = parser_parse_sub_expression(tree);
-    while(token_type_is(token_plus) && r == SUCCESS) {
-        parser_get_next_token();
-        ast_t *new_ast = ast_new();
-        new_ast->type = ast_add;
-        new_ast->children[0] = *tree;
-        if(parser_parse_sub_expression(&(new_ast->children[1])) == FAILURE) {
-            r = FAILURE;
-            break;
+void source_files_stop_read_ahead(source_files_t *sources) {
+    int drained = uring_drain(&sources->ring) == SUCCESS;
+    for(int i = sources->evaluated; i < sources->opened; i++) {
+        source_file_t *file = &sources->files[i];
+        if(file->state == file_loading) {
+            /* left to the kernel if it may still be reading into it */
+            if(drained) {
+                free(file->data);
+            }
+            file->data = NULL;
+            file->queued = 0;
+            file->reads_pending = 0;
+            file->error = 0;
+            file->state = file_streamed;
+        } else if(file->state == file_opened) {
+            file->state = file_streamed;
         }
-        *tree = new_ast;
     }
-    return r;
+    sources->loading = 0;
+    uring_release(&sources->ring);
 }
 
 /**
- * Production 7, 8 & 9
+ * open the files ahead of the one being evaluated, allocate memory for the
+ * ones that fit and queue their reads while the ring has room.
 */
-int parser_parse_sub_expression(ast_t **tree) {
-    int r = parser_parse_mul_expression(tree);
-    while(token_type_is(token_minus) && r == SUCCESS) {
-        parser_get_next_token();
-        ast_t *new_ast = ast_new();
-        new_ast->type = ast_sub;
-        new_ast->children[0] = *tree;
-        if(parser_parse_mul_expression(&(new_ast->children[1])) == FAILURE) {
-            r = FAILURE;
-            break;
+void source_files_read_ahead(source_files_t *sources) {
+    while(sources->opened < sources->size && sources->opened - sources->evaluated < FILES_IN_FLIGHT) {
+        source_file_t *file = &sources->files[sources->opened];
+        if(file->state == file_unopened) {
+            source_file_open(file, 1);
+        }
+        if(file->state == file_opened) {
+            /* the file being evaluated may always load */
+            if(sources->opened > sources->evaluated && sources->loading + file->size > memory_budget) {
+                break;
+            }
+            file->data = malloc(file->size+1);
+            if(file->data == NULL) {
+                file->state = file_streamed;
+            } else {
+                file->state = file_loading;
+                sources->loading += file->size;
+            }
+        }
+        sources->opened++;
+    }
+    uring_t *ring = &sources->ring;
+    for(int i = sources->evaluated; i < sources->opened && ring->free_reads_size > 0; i++) {
+        source_file_t *file = &sources->files[i];
+        while(file->state == file_loading && file->queued < file->size && ring->free_reads_size > 0) {
+            size_t length = file->size - file->queued;
+            if(length > FILE_READ_SIZE) {
+                length = FILE_READ_SIZE;
+            }
+            uring_queue_read(ring, file, file->queued, length);
+            file->queued += length;
         }
-        *tree = new_ast;
     }
-    return r;
 }
 
 /**
- * production 10 , 11 & 12
+ * open the file results and error messages of the source at path go to
+ * with --output-suffix.
 */
-int parser_parse_mul_expression(ast_t **tree) {
-    int r = parser_parse_div_expression(tree);
-    while(token_type_is(token_times) && r == SUCCESS) {
-        parser_get_next_token();
-        ast_t *new_ast = ast_new();
-        new_ast->type = ast_mul;
-        new_ast->children[0] = *tree;
-        if(parser_parse_div_expression(&(new_ast->children[1])) == FAILURE) {
-            r = FAILURE;
-            break;
-        }
-        *tree = new_ast;
+FILE *file_output_open(const char *path) {
+    char *output_path = malloc(strlen(path) + strlen(option_output_suffix) + 1);
+    if(output_path == NULL) {
+        return NULL;
     }
-    return r;
+    strcat(strcpy(output_path, path), option_output_suffix);
+    FILE *output = fopen(output_path, "w");
+    free(output_path);
+    return output;
 }
 
 /**
- * Production 13, 14 & 15
+ * evaluate a file read into memory.
 */
-int parser_parse_div_expression(ast_t **tree) {
-    int r = parser_parse_unit_expression(tree);
-    while(token_type_is(token_divide) && r == SUCCESS) {
-        parser_get_next_token();
-        ast_t *new_ast = ast_new();
-        new_ast->type = ast_div;
-        new_ast->children[0] = *tree;
-        if(parser_parse_unit_expression(&(new_ast->children[1])) == FAILURE) {
-            r = FAILURE;
-            break;
-        }
-        *tree = new_ast;
+int evaluate_loaded_file(source_file_t *file) {
+    size_t size = file->end;
+    long long lines = 0, expressions = 0;
+    if(size > 0 && file->data[size-1] != '\n') {
+        /* last line has no newline, terminate it */
+        file->data[size++] = '\n';
     }
-    return r;
+    const char *p = file->data;
+    int status = process_lines(&p, file->data + size, &lines, &expressions);
+    if(diagnostics_file != NULL) {
+        diagnostics_flush(&main_diagnostic_log, 0);
+    }
+    if(option_stats) {
+        stats_count_lines(expressions);
+    }
+    return status;
 }
 
 /**
- * Production 16 & 17
+ * evaluate several files in order, returns the exit status.
 */
-int parser_parse_unit_expression(ast_t **tree) {
-    int r = SUCCESS;
-    if(token_type_is(token_bracket_open)) {
-        parser_get_next_token();
-        r = parser_parse_add_expression(tree);
-        if(r == FAILURE) {
-            return FAILURE;
+int run_files(char **paths, int paths_size) {
+    int return_code = SUCCESS;
+    source_files_t sources = {0};
+    sources.size = paths_size;
+    sources.files = calloc(paths_size, sizeof(source_file_t));
+    if(sources.files == NULL) {
+        perror("calloc");
+        return FAILURE;
+    }
+    for(int i = 0; i < sources.size; i++) {
+        sources.files[i].path = paths[i];
+        sources.files[i].fd = -1;
+    }
+    int uring = option_uring && uring_setup(&sources.ring) == SUCCESS;
+    int sections = 0;
+    for(; sources.evaluated < sources.size; sources.evaluated++) {
+        source_file_t *file = &sources.files[sources.evaluated];
+        if(uring) {
+            source_files_read_ahead(&sources);
+            while(uring && file->state == file_loading && (file->reads_pending > 0 || file->queued < file->size)) {
+                if(uring_enter(&sources.ring, 1) == FAILURE) {
+                    source_files_stop_read_ahead(&sources);
+                    uring = 0;
+                    break;
+                }
+                uring_reap(&sources.ring);
+                source_files_read_ahead(&sources);
+            }
+            if(uring && uring_enter(&sources.ring, 0) == FAILURE) {
+                source_files_stop_read_ahead(&sources);
+                uring = 0;
+            }
         }
-        if(!token_type_is(token_bracket_close)) {
-            /* bracket opened above does not have a matching closing bracket */
-            fprintf(stderr, "\033[1;31mSyntaxError: Expected closing ) before end of expression.\033[0m\n");
-            return FAILURE;
+        if(file->state == file_unopened) {
+            source_file_open(file, 0);
         }
-    } else {
-        /* at this point only NUM tokens are accepted */
-        if(token_type_is(token_number)) {
-            *tree = ast_new();
-            (*tree)->type = ast_num;
-            (*tree)->value = str_to_int(parser_active_token->lexeme);
+        diagnostics_source = file->path;
+        FILE *output = NULL;
+        if(file->state != file_failed && option_output_suffix != NULL &&
+            (output = file_output_open(file->path)) == NULL) {
+            file->error = errno;
+            file->state = file_failed;
+        }
+        if(file->state == file_failed || (file->state == file_loading && file->error != 0)) {
+            fprintf(stderr, "%s: %s\n", file->path, strerror(file->error));
+            return_code = FAILURE;
         } else {
-            fprintf(stderr, "\033[1;31mSyntaxError: Expected an integer or '(' near %c.\033[0m\n",
-             get_token_lexeme(parser_active_token)[0]);
-            return FAILURE;
+            if(output != NULL) {
+                result_stream = diagnostic_stream = output;
+            } else {
+                printf("%s==> %s <==\n", sections++ > 0 ? "\n" : "", file->path);
+            }
+            if(file->state == file_loading) {
+                return_code |= evaluate_loaded_file(file);
+            } else {
+                source_file_fd = file->fd;
+                return_code |= evaluate_source();
+            }
+        }
+        if(output != NULL) {
+            result_stream = stdout;
+            diagnostic_stream = stderr;
+            if(fclose(output) != 0) {
+                perror("fclose");
+                return_code = FAILURE;
+            }
+        }
+        if(file->state == file_loading) {
+            sources.loading -= file->size;
+            free(file->data);
+        }
+        if(file->fd > STDIN_FILENO) {
+            close(file->fd);
         }
     }
-    parser_get_next_token();
-    return r;
+    diagnostics_source = NULL;
+    source_file_fd = STDIN_FILENO;
+    if(uring) {
+        uring_release(&sources.ring);
+    }
+    free(sources.files);
+    return return_code;
 }
 
-/** stack creation and manipulation procedures */
-#define MAX_CALLSTACK_DEPTH 32
-/* the stack */
-int callstack[MAX_CALLSTACK_DEPTH];
-/* the top the stack (downward growing stack) */
-int callstack_top = MAX_CALLSTACK_DEPTH;
-
-#define callstack_push(x) \
-    (callstack[--callstack_top] = x)
-
-#define callstack_pop() \
-    (callstack[callstack_top++])
+/**
+ * Concurrent files.
+ *
+ * With -j and several files every worker evaluates whole files, taking the
+ * largest one left first (longest processing time first) so a big file
+ * does not start last and hold up the end of the run. A file's results and
+ * error messages are kept in memory and written by the main thread as
+ * sections in argument order, or go to the file's own output file with
+ * --output-suffix. Errors are numbered by the line in their own file.
+*/
+typedef struct file_task {
+    const char *path;
+    /* bytes, 0 if unknown */
+    off_t size;
+    FILE *results;
+    char *results_data;
+    size_t results_size;
+    FILE *diagnostics;
+    char *diagnostics_data;
+    size_t diagnostics_size;
+    diagnostic_log_t log;
+    slow_lines_t slow;
+    long long expressions;
+    int status;
+    /* errno if the file could not be read */
+    int error;
+    int done;
+} file_task_t;
 
-#define callstack_is_full() \
-    (callstack_top == 0)
+typedef struct file_tasks {
+    file_task_t *tasks;
+    int size;
+    /* tasks largest first and the index of the next to take */
+    file_task_t **order;
+    int next;
+    pthread_mutex_t mutex;
+    pthread_cond_t done;
+} file_tasks_t;
 
-#define callstack_is_empty() \
-    (callstack_top == MAX_CALLSTACK_DEPTH)
+file_tasks_t file_tasks;
 
-#define callstack_clear() \
-    (callstack_top = MAX_CALLSTACK_DEPTH)
+int file_task_compare(const void *a, const void *b) {
+    off_t x = (*(file_task_t *const *)a)->size, y = (*(file_task_t *const *)b)->size;
+    return (x < y) - (x > y);
+}
 
 /**
- * perform an operation on the two topmost stack elements and
- * push the result back to the stack.
+ * evaluate the file of a task from fd, read in blocks of CHUNK_SIZE bytes
+ * that grow for longer lines within the memory budget.
 */
-int execution_engine_do_operation(enum ast_type operator) {
-    int right_operand = callstack_pop();
-    int left_operand = callstack_pop();
-    switch(operator) {
-        case ast_add: {
-            left_operand += right_operand;
-            break;
-        }
-        case ast_sub: {
-            left_operand -= right_operand;
-            break;
+void file_task_evaluate(file_task_t *task, int fd) {
+    static _Thread_local char *input;
+    static _Thread_local size_t input_capacity;
+    long long lines = 0;
+    size_t size = 0;
+    int eof = 0;
+    /* reading past a line over the memory budget */
+    int dropping = 0;
+    while(!eof) {
+        if(input_capacity - size <= 1) {
+            size_t capacity = input_capacity ? input_capacity*2 : CHUNK_CAPACITY;
+            if(capacity > memory_budget && input_capacity < memory_budget) {
+                capacity = memory_budget;
+            }
+            char *grown = capacity > input_capacity ? realloc(input, capacity) : NULL;
+            if(grown == NULL) {
+                /* line too long, reported and not evaluated */
+                diagnostic_line = ++lines;
+                report_memory_budget_exceeded();
+                task->expressions++;
+                task->status = FAILURE;
+                dropping = 1;
+                size = 0;
+            } else {
+                input = grown;
+                input_capacity = capacity;
+            }
         }
-        case ast_mul: {
-            left_operand *= right_operand;
+        /* one byte is kept for the newline added at eof */
+        stage_enter(stage_read);
+        ssize_t n = read(fd, input+size, input_capacity-1-size);
+        stage_enter(stage_other);
+        if(n == -1) {
+            task->error = errno;
             break;
         }
-        case ast_div: {
-            if(right_operand == 0) {
-                fprintf(stderr, "\033[1;31mRuntimeError: Division by Zero\033[0m.\n");
-                return FAILURE;
+        size += n;
+        eof = n == 0;
+        if(dropping) {
+            char *newline = memchr(input, '\n', size);
+            if(newline == NULL) {
+                size = 0;
+                continue;
             }
-            left_operand /= right_operand;
-            break;
+            dropping = 0;
+            size = input+size-(newline+1);
+            memmove(input, newline+1, size);
+        }
+        if(eof && size > 0 && input[size-1] != '\n') {
+            /* last line has no newline, terminate it */
+            input[size++] = '\n';
         }
+        const char *p = input;
+        task->status |= process_lines(&p, input+size, &lines, &task->expressions);
+        size = input+size-p;
+        memmove(input, p, size);
     }
-    callstack_push(left_operand);
-    return SUCCESS;
 }
 
-/**
- * Do a depth first traversal of the AST tree rooted at node. 
-*/
-int execution_engine_process_ast_node(ast_t *node) {
-    if(node != NULL) {
-        switch(node->type) {
-            case ast_num: {
-                if(callstack_is_full()) {
-                    /* expression is too nested */
-                    fprintf(stderr, "\033[1;31mRuntimeError: StackOverflow\033[0m.\n");
-                    return FAILURE;
+void *file_worker_main(void *argument) {
+    worker_t *w = argument;
+    worker_pin(w);
+    int go = worker_ready(w, 1);
+    while(go) {
+        int i = __atomic_fetch_add(&file_tasks.next, 1, __ATOMIC_RELAXED);
+        if(i >= file_tasks.size) {
+            break;
+        }
+        file_task_t *task = file_tasks.order[i];
+        FILE *output = NULL;
+        /* a source that can't be read gets no output file */
+        int fd = source_open(task->path);
+        if(fd == -1 || (option_output_suffix != NULL && (output = file_output_open(task->path)) == NULL)) {
+            task->error = errno;
+        } else {
+            task->results = output ? output : open_memstream(&task->results_data, &task->results_size);
+            task->diagnostics = output ? output :
+                open_memstream(&task->diagnostics_data, &task->diagnostics_size);
+            if(task->results == NULL || task->diagnostics == NULL) {
+                task->error = errno;
+            } else {
+                result_stream = task->results;
+                diagnostic_stream = task->diagnostics;
+                diagnostic_log = &task->log;
+                slow_lines = &task->slow;
+                long long start = option_stats ? stats_now_ns() : 0;
+                file_task_evaluate(task, fd);
+                if(option_stats) {
+                    w->load.busy_ns += stats_now_ns() - start;
+                    w->load.tasks++;
+                    w->load.lines += task->expressions;
                 }
-                callstack_push(node->value);
-                break;
             }
-            default: {
-                int status = execution_engine_process_ast_node(node->children[0]);
-                if(status != SUCCESS) {
-                    return FAILURE;
-                }
-                status = execution_engine_process_ast_node(node->children[1]);
-                if(status != SUCCESS) {
-                    return FAILURE;
-                }
-                if(execution_engine_do_operation(node->type) == FAILURE) {
-                    return FAILURE;
-                }
+            if(task->diagnostics != NULL && task->diagnostics != output) {
+                fclose(task->diagnostics);
             }
+            if(task->results != NULL && fclose(task->results) != 0 && task->error == 0) {
+                task->error = errno;
+            }
+        }
+        if(fd > STDIN_FILENO) {
+            close(fd);
         }
+        pthread_mutex_lock(&file_tasks.mutex);
+        task->done = 1;
+        pthread_cond_broadcast(&file_tasks.done);
+        pthread_mutex_unlock(&file_tasks.mutex);
     }
-    return SUCCESS;
+    evaluation_release();
+    return NULL;
 }
 
 /**
- * Begin the execution of AST tree.
- * 
- * When the xecution is done there should be a single element at the top
- * of the callstack which is the result of calculations.
+ * evaluate several files concurrently on the workers, returns the exit
+ * status.
 */
-int execution_engine(ast_t *tree) {
-    int status = SUCCESS;
-    if(tree != NULL) {
-        status = execution_engine_process_ast_node(tree);
-        if(status == SUCCESS) {
-            if(callstack_is_empty()) {
-                /* Things have gone really wrong !!!*/
-                fprintf(stderr, "\033[1;31mRuntimeError: StackUnderflow\033[0m.\n");
-                return FAILURE;
-            }
-            printf("\033[1;32m%d\033[0m.\n", callstack_pop());
+int run_files_parallel(char **paths, int paths_size) {
+    int return_code = SUCCESS;
+    file_tasks.tasks = calloc(paths_size, sizeof(file_task_t));
+    file_tasks.order = calloc(paths_size, sizeof(file_task_t *));
+    if(file_tasks.tasks == NULL || file_tasks.order == NULL) {
+        perror("calloc");
+        return FAILURE;
+    }
+    file_tasks.size = paths_size;
+    pthread_mutex_init(&file_tasks.mutex, NULL);
+    pthread_cond_init(&file_tasks.done, NULL);
+    for(int i = 0; i < paths_size; i++) {
+        struct stat st;
+        file_task_t *task = &file_tasks.tasks[i];
+        task->path = paths[i];
+        if(stat(task->path, &st) == 0 && S_ISREG(st.st_mode)) {
+            task->size = st.st_size;
         }
+        file_tasks.order[i] = task;
     }
-    callstack_clear();
-    return status;
+    qsort(file_tasks.order, paths_size, sizeof(file_task_t *), file_task_compare);
+    if(workers_start(file_worker_main) != SUCCESS) {
+        return FAILURE;
+    }
+    if(option_topology) {
+        topology_report();
+    }
+    int sections = 0;
+    for(int i = 0; i < paths_size; i++) {
+        file_task_t *task = &file_tasks.tasks[i];
+        pthread_mutex_lock(&file_tasks.mutex);
+        while(!task->done) {
+            pthread_cond_wait(&file_tasks.done, &file_tasks.mutex);
+        }
+        pthread_mutex_unlock(&file_tasks.mutex);
+        if(task->error != 0) {
+            fprintf(stderr, "%s: %s\n", task->path, strerror(task->error));
+            return_code = FAILURE;
+        } else if(option_output_suffix == NULL) {
+            printf("%s==> %s <==\n", sections++ > 0 ? "\n" : "", task->path);
+            fwrite(task->results_data, 1, task->results_size, stdout);
+            fwrite(task->diagnostics_data, 1, task->diagnostics_size, stderr);
+        }
+        if(diagnostics_file != NULL) {
+            diagnostics_source = task->path;
+            diagnostics_flush(&task->log, 0);
+        }
+        if(option_slow_lines) {
+            slow_lines_merge(&task->slow, 0, task->path);
+        }
+        return_code |= task->status;
+        stats_count_lines(task->expressions);
+        free(task->results_data);
+        free(task->diagnostics_data);
+        free(task->log.records);
+        free(task->slow.heap);
+    }
+    diagnostics_source = NULL;
+    workers_join();
+    free(file_tasks.tasks);
+    free(file_tasks.order);
+    return return_code;
 }
 
 /**
@@ -642,35 +7559,127 @@ int execution_engine(ast_t *tree) {
 */
 int main(int argc, char **argv) {
     int return_code = SUCCESS;
-    char *source_file_path = argc == 2 ? argv[1] : NULL;
-    if(open_source_file(source_file_path) != SUCCESS) {
+    char **source_file_paths;
+    int source_file_paths_size;
+    result_stream = stdout;
+    diagnostic_stream = stderr;
+    diagnostic_log = &main_diagnostic_log;
+    slow_lines = &main_slow_lines;
+    if(parse_arguments(argc, argv, &source_file_paths, &source_file_paths_size) != SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    if(cpu_select_kernels(option_cpu_level) != SUCCESS) {
+        fprintf(stderr, "This CPU can not run the %s kernels.\n", cpu_level_name[option_cpu_level]);
+        return EXIT_UNSUPPORTED;
+    }
+    if(option_session != NULL) {
+        /* after the options its values depend on */
+        if(session_open(option_session) != SUCCESS) {
+            return EXIT_FAILURE;
+        }
+    }
+    if(source_file_paths_size <= 1 &&
+        open_source_file(source_file_paths_size ? source_file_paths[0] : NULL) != SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    if(option_capture != NULL) {
+        if(source_file_paths_size > 1) {
+            fprintf(stderr, "--capture records a single source.\n");
+            return EXIT_FAILURE;
+        }
+        if(capture_open(option_capture) != SUCCESS) {
+            return EXIT_FAILURE;
+        }
+    }
+    if(option_line_buffered) {
+        /* every result leaves as soon as its line is evaluated */
+        option_jobs = 0;
+    }
+    if(option_scan && number_mode == numbers_dynamic) {
+        fprintf(stderr, "--scan works with int and decimal numbers.\n");
         return EXIT_FAILURE;
     }
-    if(isatty(source_file_fd)) {
+    if(option_scan && source_file_paths_size > 1) {
+        /* workers would take a file each, the aggregate runs through them in order */
+        option_jobs = 0;
+    }
+    if(source_file_paths_size <= 1 && (option_repl == repl_live ||
+        (option_repl == repl_auto && isatty(source_file_fd) && isatty(STDOUT_FILENO)))) {
+        /* lines come from the editor, evaluated as they are entered */
+        option_jobs = 0;
+        editor_open();
+    }
+    if(source_file_paths_size <= 1 && isatty(source_file_fd)) {
+        /* the repl evaluates line by line */
+        option_jobs = 0;
         printf("A BODMAS calculator.\n"
                 "Version 1.0.\n"
                 "https://devbumbuna.com/building-an-interpreter-a-repl-calculator.\n");
+    } else if(option_vmsplice && !option_line_buffered && !editor_active) {
+        /* the repl's prompts and results must not wait for a full buffer */
+        pipe_output_open();
+        result_stream = stdout;
     }
-    while(source_file_eof_read == 0) {
-        token_list_t *stream = token_list_new();
-        if(read_line() == FAILURE) {
-            return_code = FAILURE;
-            break;
-        }
-        if(tokenize_source_line_and_add_to_list(stream) == FAILURE) {
-            return_code = FAILURE;
-            continue;
-        }
-        ast_t *tree = NULL;
-        if(parse_token_stream_into_ast(stream, &tree) == SUCCESS) {
-            if(execution_engine(tree) != SUCCESS) {
-                return_code = FAILURE;
+    if(option_jobs > 0) {
+        topology_detect();
+    }
+    if(option_jobs > 0 && source_file_paths_size > 1) {
+        return_code = run_files_parallel(source_file_paths, source_file_paths_size);
+    } else {
+        if(option_jobs > 0) {
+            if(workers_start(worker_main) != SUCCESS) {
+                return EXIT_FAILURE;
+            }
+            if(option_topology) {
+                topology_report();
             }
-            token_list_free(stream);
+        }
+        if(source_file_paths_size > 1) {
+            return_code = run_files(source_file_paths, source_file_paths_size);
         } else {
-            return_code = FAILURE;
+            return_code = evaluate_source();
         }
+        if(option_jobs > 0) {
+            workers_stop();
+        }
+    }
+    if(__atomic_load_n(&decompression_failed, __ATOMIC_RELAXED)) {
+        return_code = FAILURE;
+    }
+    evaluation_release();
+    if(option_session != NULL && session_save(option_session) != SUCCESS) {
+        return_code = FAILURE;
+    }
+    if(capture_file != NULL && fclose(capture_file) != 0) {
+        perror(option_capture);
+        return_code = FAILURE;
     }
+    editor_restore();
+    free(source_file_line);
+    free(source_file_paths);
     printf("\n");
+    if(diagnostics_file != NULL) {
+        if(fclose(diagnostics_file) != 0) {
+            perror("fclose");
+            return_code = FAILURE;
+        }
+        fflush(stdout);
+        diagnostics_report();
+    }
+    if(option_stats) {
+        fflush(stdout);
+        stats_report();
+    }
+    if(option_slow_lines) {
+        fflush(stdout);
+        slow_lines_report();
+    }
+    if(option_summary) {
+        fflush(stdout);
+        summary_report();
+    }
+    if(pipe_output.capacity > 0 && fclose(stdout) != 0) {
+        return_code = FAILURE;
+    }
     return return_code;
-}
\ No newline at end of file
+}
@@ -0,0 +1,14 @@
+# Evaluates INPUT with --capture, its results discarded, to make a capture
+# for the replay tool.
+#
+# cmake -D CALCULATOR=... -D INPUT=... -D CAPTURE=... -P capture.cmake
+
+execute_process(
+    COMMAND ${CALCULATOR} --capture=${CAPTURE} ${INPUT}
+    RESULT_VARIABLE status
+    OUTPUT_QUIET
+    ERROR_QUIET)
+# invalid lines make the exit status 1
+if(status GREATER 1)
+    message(FATAL_ERROR "calculator --capture exited with ${status}")
+endif()
@@ -0,0 +1,47 @@
+# Captures a few lines, blank and invalid ones among them, and checks the
+# results are the same as without a capture, that the capture holds every
+# line evaluated, and that the replay tool gets an answer for each of them.
+#
+# cmake -D CALCULATOR=... -D REPLAY=... [-D ARGS=...]
+#       [-D NAME=...] -P capture_replay.cmake
+
+set(DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}/${NAME})
+file(MAKE_DIRECTORY ${DIRECTORY})
+set(INPUT ${DIRECTORY}/capture_replay_input.txt)
+set(CAPTURE ${DIRECTORY}/capture_replay.bin)
+set(DUMP ${DIRECTORY}/capture_replay_dump.txt)
+file(WRITE ${INPUT} "1+2*3\n\n(4+5)/3\n7/0\n  \n12a\n(1+2\n10-4-3\n")
+set(expected "1+2*3\n(4+5)/3\n7/0\n12a\n(1+2\n10-4-3\n")
+separate_arguments(ARGS)
+execute_process(
+    COMMAND ${CALCULATOR} ${ARGS}
+    INPUT_FILE ${INPUT}
+    OUTPUT_VARIABLE plain
+    ERROR_QUIET)
+execute_process(
+    COMMAND ${CALCULATOR} ${ARGS} --capture=${CAPTURE}
+    INPUT_FILE ${INPUT}
+    RESULT_VARIABLE status
+    OUTPUT_VARIABLE output
+    ERROR_QUIET)
+if(NOT status EQUAL 1 OR NOT output STREQUAL plain)
+    message(FATAL_ERROR "results differ with --capture (${status}):\n${output}")
+endif()
+execute_process(
+    COMMAND ${REPLAY} --capture ${CAPTURE} --dump ${DUMP}
+    RESULT_VARIABLE status)
+file(READ ${DUMP} dump)
+if(NOT status EQUAL 0 OR NOT dump STREQUAL expected)
+    message(FATAL_ERROR "the capture does not hold the lines evaluated:\n${dump}")
+endif()
+foreach(speed max 100)
+    execute_process(
+        COMMAND ${REPLAY} --capture ${CAPTURE} --speed ${speed} "calculator=${CALCULATOR} ${ARGS}"
+        RESULT_VARIABLE status
+        OUTPUT_VARIABLE report
+        ERROR_VARIABLE errors)
+    if(NOT status EQUAL 0 OR NOT report MATCHES "^replay: 6 lines" OR NOT report MATCHES "\ncalculator +[0-9.]+ ")
+        message(FATAL_ERROR "replay at ${speed} failed (${status}):\n${report}${errors}")
+    endif()
+endforeach()
+file(REMOVE ${INPUT} ${CAPTURE} ${DUMP})
@@ -0,0 +1,53 @@
+# Evaluates a corpus compressed with gzip, as a file, as two concatenated
+# members, on stdin and piped into stdin, and checks the results match the uncompressed
+# corpus.
+#
+# cmake -D GENERATOR=... -D CALCULATOR=... -D GZIP=... [-D ARGS=...]
+#       [-D NAME=...] -P compressed_input.cmake
+
+set(DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}/${NAME})
+file(MAKE_DIRECTORY ${DIRECTORY})
+set(CORPUS ${DIRECTORY}/compressed_input_corpus.txt)
+execute_process(
+    COMMAND ${GENERATOR} --seed 89 --count 20000 --max-depth 4 --max-length 64 --output ${CORPUS}
+    RESULT_VARIABLE status)
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "generator failed: ${status}")
+endif()
+execute_process(COMMAND ${GZIP} -c ${CORPUS} OUTPUT_FILE ${CORPUS}.gz RESULT_VARIABLE status)
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "gzip failed: ${status}")
+endif()
+execute_process(COMMAND ${CMAKE_COMMAND} -E cat ${CORPUS}.gz ${CORPUS}.gz OUTPUT_FILE ${CORPUS}.twice.gz)
+execute_process(COMMAND ${CMAKE_COMMAND} -E cat ${CORPUS} ${CORPUS} OUTPUT_FILE ${CORPUS}.twice)
+separate_arguments(ARGS)
+execute_process(COMMAND ${CALCULATOR} ${ARGS} ${CORPUS} OUTPUT_VARIABLE expected ERROR_QUIET)
+execute_process(COMMAND ${CALCULATOR} ${ARGS} ${CORPUS}.twice OUTPUT_VARIABLE expected_twice ERROR_QUIET)
+execute_process(COMMAND ${CALCULATOR} ${ARGS} ${CORPUS}.gz
+    RESULT_VARIABLE status OUTPUT_VARIABLE output ERROR_QUIET)
+execute_process(COMMAND ${CALCULATOR} ${ARGS} ${CORPUS}.twice.gz OUTPUT_VARIABLE output_twice ERROR_QUIET)
+execute_process(COMMAND ${CALCULATOR} ${ARGS} INPUT_FILE ${CORPUS}.gz OUTPUT_VARIABLE output_stdin ERROR_QUIET)
+# a pipe can't be read at an offset, the magic bytes have to be peeked
+execute_process(COMMAND ${CMAKE_COMMAND} -E cat ${CORPUS}.gz COMMAND ${CALCULATOR} ${ARGS} -
+    OUTPUT_VARIABLE output_pipe ERROR_QUIET)
+file(REMOVE ${CORPUS} ${CORPUS}.gz ${CORPUS}.twice ${CORPUS}.twice.gz)
+# invalid lines make the exit status 1
+if(NOT status EQUAL 1)
+    message(FATAL_ERROR "calculator exited with ${status}")
+endif()
+string(LENGTH "${expected}" length)
+if(length LESS 65536)
+    message(FATAL_ERROR "expected more than 64 KiB of results, got ${length} bytes")
+endif()
+if(NOT output STREQUAL expected)
+    message(FATAL_ERROR "results of the compressed corpus differ")
+endif()
+if(NOT output_twice STREQUAL expected_twice)
+    message(FATAL_ERROR "results of the concatenated gzip members differ")
+endif()
+if(NOT output_stdin STREQUAL expected)
+    message(FATAL_ERROR "results of the compressed corpus on stdin differ")
+endif()
+if(NOT output_pipe STREQUAL expected)
+    message(FATAL_ERROR "results of the compressed corpus piped into stdin differ")
+endif()
@@ -0,0 +1,68 @@
+# Evaluates fixed point expressions with --decimal and every rounding mode
+# and checks the printed results, that overflow is an error, and that
+# integer mode still rejects a decimal point.
+#
+# cmake -D CALCULATOR=... [-D ARGS=...] [-D NAME=...] -P decimal.cmake
+
+set(DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}/${NAME})
+file(MAKE_DIRECTORY ${DIRECTORY})
+set(INPUT ${DIRECTORY}/decimal_input.txt)
+separate_arguments(ARGS)
+string(ASCII 27 escape)
+
+# evaluate input with the options and compare the results, one per line
+function(check options input expected)
+    file(WRITE ${INPUT} "${input}")
+    execute_process(
+        COMMAND ${CALCULATOR} ${ARGS} ${options} ${INPUT}
+        RESULT_VARIABLE status
+        OUTPUT_VARIABLE output
+        ERROR_VARIABLE errors)
+    file(REMOVE ${INPUT})
+    string(REGEX REPLACE "${escape}\\[[0-9;]*m" "" output "${output}")
+    string(REGEX REPLACE "\\.\n" "\n" output "${output}")
+    if(NOT output STREQUAL "${expected}\n\n")
+        message(FATAL_ERROR "${options} on ${input}: expected\n${expected}\ngot\n${output}${errors}")
+    endif()
+endfunction()
+
+check(--decimal=2 "1.25*2\n10/3\n2/3\n1.005+0\n7.\n100-200.5\n(1-2)/3\n" "2.50\n3.33\n0.67\n1.00\n7.00\n-100.50\n-0.33")
+check(--decimal=0 "7/2\n5/2\n2.5*1" "4\n2\n2")
+check(--decimal=4 "19.99*3*1.0825" "64.9175")
+check("--decimal=2;--rounding=half-even" "0.125+0\n0.135+0\n0-0.125*1\n1/8\n3/8" "0.12\n0.14\n-0.12\n0.12\n0.38")
+check("--decimal=2;--rounding=half-up" "0.125+0\n0-1/8\n1/3" "0.13\n-0.13\n0.33")
+check("--decimal=2;--rounding=down" "0.129+0\n2/3\n0-2/3" "0.12\n0.66\n-0.66")
+check("--decimal=2;--rounding=floor" "2/3\n(0-1)/3" "0.66\n-0.34")
+check("--decimal=2;--rounding=ceiling" "1/3\n(0-2)/3" "0.34\n-0.66")
+
+# overflow is an error, never a wrapped amount
+file(WRITE ${INPUT} "92233720368547758.07+0.01\n0-92233720368547758.07-0.02\n92233720368547758.07*2\n92233720368547758.07/0.5\n92233720368547758.08\n92233720368547758.07-0.01\n")
+execute_process(
+    COMMAND ${CALCULATOR} ${ARGS} --decimal=2 ${INPUT}
+    RESULT_VARIABLE status
+    OUTPUT_VARIABLE output
+    ERROR_VARIABLE errors)
+string(REGEX MATCHALL "Decimal Overflow" overflows "${errors}")
+list(LENGTH overflows overflows)
+string(REGEX REPLACE "${escape}\\[[0-9;]*m" "" output "${output}")
+if(NOT status EQUAL 1 OR NOT overflows EQUAL 4 OR NOT errors MATCHES "OverflowError: 92233720368547758.08 does not fit"
+    OR NOT output STREQUAL "92233720368547758.06.\n\n")
+    message(FATAL_ERROR "--decimal=2 overflow: ${status}\n${output}${errors}")
+endif()
+file(WRITE ${INPUT} "10\n9.2+0\n")
+execute_process(
+    COMMAND ${CALCULATOR} ${ARGS} --decimal=18 ${INPUT}
+    RESULT_VARIABLE status
+    OUTPUT_VARIABLE output
+    ERROR_VARIABLE errors)
+string(REGEX REPLACE "${escape}\\[[0-9;]*m" "" output "${output}")
+if(NOT status EQUAL 1 OR NOT errors MATCHES "OverflowError: 10 does not fit" OR NOT output STREQUAL "9.200000000000000000.\n\n")
+    message(FATAL_ERROR "--decimal=18 accepted 10: ${status}\n${output}${errors}")
+endif()
+
+file(WRITE ${INPUT} "1.5\n")
+execute_process(COMMAND ${CALCULATOR} ${ARGS} ${INPUT} RESULT_VARIABLE status ERROR_VARIABLE errors)
+file(REMOVE ${INPUT})
+if(NOT status EQUAL 1 OR NOT errors MATCHES "Unexpected character")
+    message(FATAL_ERROR "integer mode accepted 1.5: ${status} ${errors}")
+endif()
@@ -0,0 +1,76 @@
+# Evaluates lines nested LEVELS brackets deep, far deeper than the C stack
+# would allow a recursive parser, and checks every line gives a result.
+# Then evaluates 1+(1+(...)) nested as deep, which keeps LEVELS operands on
+# the value stack at once, and checks its sum. Last, with a memory budget
+# too small for that line, checks it is reported and the lines around it
+# are still evaluated, in one file and in two.
+#
+# cmake -D GENERATOR=... -D CALCULATOR=... -D LEVELS=... -D LINES=...
+#       [-D ARGS=...] [-D NAME=...] -P deep_nesting.cmake
+
+set(DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}/${NAME})
+file(MAKE_DIRECTORY ${DIRECTORY})
+set(CORPUS ${DIRECTORY}/deep_nesting_${LEVELS}.txt)
+math(EXPR LENGTH "${LEVELS} * 4 + 64")
+execute_process(
+    COMMAND ${GENERATOR} --seed 82 --count ${LINES} --invalid 0 --shape nested
+        --max-depth ${LEVELS} --max-length ${LENGTH} --output ${CORPUS}
+    RESULT_VARIABLE status)
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "generator failed: ${status}")
+endif()
+separate_arguments(ARGS)
+execute_process(
+    COMMAND ${CALCULATOR} ${ARGS} ${CORPUS}
+    RESULT_VARIABLE status
+    OUTPUT_VARIABLE output
+    ERROR_VARIABLE errors)
+file(REMOVE ${CORPUS})
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "calculator exited with ${status}: ${errors}")
+endif()
+string(REGEX MATCHALL "\n" results "${output}")
+list(LENGTH results count)
+# one line per result and the newline printed at the end of input
+math(EXPR expected "${LINES} + 1")
+if(NOT count EQUAL expected)
+    message(FATAL_ERROR "expected ${LINES} results, got: ${output}")
+endif()
+
+set(RIGHT ${DIRECTORY}/deep_nesting_right_${LEVELS}.txt)
+string(REPEAT "1+(" ${LEVELS} open)
+string(REPEAT ")" ${LEVELS} close)
+file(WRITE ${RIGHT} "${open}1${close}\n")
+# its tokens and nodes take more than the default budget
+execute_process(
+    COMMAND ${CALCULATOR} ${ARGS} --memory-budget=1G ${RIGHT}
+    RESULT_VARIABLE status
+    OUTPUT_VARIABLE output
+    ERROR_VARIABLE errors)
+math(EXPR sum "${LEVELS} + 1")
+if(NOT status EQUAL 0 OR NOT output MATCHES "m${sum}")
+    message(FATAL_ERROR "right nested sum: expected ${sum}, got ${status}: ${output}${errors}")
+endif()
+
+file(WRITE ${RIGHT} "1+2\n${open}1${close}\n3*4\n")
+foreach(files 1 2)
+    set(paths ${RIGHT})
+    if(files EQUAL 2)
+        list(APPEND paths ${RIGHT})
+    endif()
+    execute_process(
+        COMMAND ${CALCULATOR} ${ARGS} --memory-budget=1M ${paths}
+        RESULT_VARIABLE status
+        OUTPUT_VARIABLE output
+        ERROR_VARIABLE errors)
+    string(REGEX MATCHALL "MemoryError" reported "${errors}")
+    string(REGEX MATCHALL "m3[^0-9]" before "${output}")
+    string(REGEX MATCHALL "m12[^0-9]" after "${output}")
+    list(LENGTH reported reported)
+    list(LENGTH before before)
+    list(LENGTH after after)
+    if(status EQUAL 0 OR NOT reported EQUAL files OR NOT before EQUAL files OR NOT after EQUAL files)
+        message(FATAL_ERROR "line over the budget in ${files} file(s): got ${status}: ${output}${errors}")
+    endif()
+endforeach()
+file(REMOVE ${RIGHT})
@@ -0,0 +1,36 @@
+# Runs a file with known errors in batch mode and checks the diagnostics
+# file records each of them as line:column:kind, blank lines counted, and
+# that only the per-kind summary reaches stderr.
+#
+# cmake -D CALCULATOR=... [-D ARGS=...] [-D NAME=...] -P diagnostics.cmake
+
+set(DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}/${NAME})
+file(MAKE_DIRECTORY ${DIRECTORY})
+set(INPUT ${DIRECTORY}/diagnostics_input.txt)
+set(DIAGNOSTICS ${DIRECTORY}/diagnostics_output.txt)
+file(WRITE ${INPUT} "1+2\n1+a\n(1+2\n\n4/0\n2 3\n7")
+set(expected "2:3:unexpected-character\n3:5:syntax\n5:0:division-by-zero\n6:3:syntax\n")
+separate_arguments(ARGS)
+execute_process(
+    COMMAND ${CALCULATOR} ${ARGS} --diagnostics=${DIAGNOSTICS} ${INPUT}
+    RESULT_VARIABLE status
+    OUTPUT_VARIABLE output
+    ERROR_VARIABLE errors)
+file(READ ${DIAGNOSTICS} diagnostics)
+file(REMOVE ${INPUT} ${DIAGNOSTICS})
+if(NOT status EQUAL 1)
+    message(FATAL_ERROR "calculator exited with ${status}: ${errors}")
+endif()
+if(NOT diagnostics STREQUAL expected)
+    message(FATAL_ERROR "unexpected diagnostics:\n${diagnostics}")
+endif()
+if(errors MATCHES "Error" OR NOT errors MATCHES "syntax +2\n" OR
+    NOT errors MATCHES "division-by-zero +1\n")
+    message(FATAL_ERROR "unexpected summary:\n${errors}")
+endif()
+string(REGEX MATCHALL "\n" results "${output}")
+list(LENGTH results count)
+# 3 and 7 and the newline printed at the end of input
+if(NOT count EQUAL 3)
+    message(FATAL_ERROR "expected 2 results, got: ${output}")
+endif()
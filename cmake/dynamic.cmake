@@ -0,0 +1,49 @@
+# Evaluates expressions with --dynamic and checks ints grow into big
+# integers instead of wrapping, and that doubles come from literals with a
+# decimal point and from inexact quotients.
+#
+# cmake -D CALCULATOR=... [-D ARGS=...] [-D NAME=...] -P dynamic.cmake
+
+set(DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}/${NAME})
+file(MAKE_DIRECTORY ${DIRECTORY})
+set(INPUT ${DIRECTORY}/dynamic_input.txt)
+separate_arguments(ARGS)
+string(ASCII 27 escape)
+
+# evaluate input and compare the results, one per line
+function(check input expected)
+    file(WRITE ${INPUT} "${input}")
+    execute_process(
+        COMMAND ${CALCULATOR} ${ARGS} --dynamic ${INPUT}
+        OUTPUT_VARIABLE output
+        ERROR_VARIABLE errors)
+    file(REMOVE ${INPUT})
+    string(REGEX REPLACE "${escape}\\[[0-9;]*m" "" output "${output}")
+    string(REGEX REPLACE "\\.\n" "\n" output "${output}")
+    if(NOT output STREQUAL "${expected}\n\n")
+        message(FATAL_ERROR "${input}: expected\n${expected}\ngot\n${output}${errors}")
+    endif()
+endfunction()
+
+# small ints, and past the 48 bits they are boxed in
+check("1+2*3\n8/2\n140737488355327+1\n0-140737488355328-1\n(0-140737488355328)/(0-1)"
+    "7\n4\n140737488355328\n-140737488355329\n140737488355328")
+# past 64 bits, and back to a small int
+check("2147483647*2147483647*2147483647*2147483647\n99999999999999999999999*99999999999999999999999/99999999999999999999999-99999999999999999999999"
+    "21267647892944572736998860269687930881\n0")
+check("123456789012345678901234567890/3\n0-123456789012345678901234567890/(0-10)"
+    "41152263004115226300411522630\n12345678901234567890123456789")
+# doubles
+check("1.5+1\n7/2\n0.1+0.2\n1/3\n2.0*3\n100000000000000000000/3"
+    "2.5\n3.5\n0.30000000000000004\n0.3333333333333333\n6.0\n3.333333333333333e+19")
+# inexact big quotients round once: operands past the double range, and a
+# quotient the operands' own roundings would pull off by one ulp
+string(REPEAT "0" 400 zeros)
+check("(1${zeros}+1)/1${zeros}\n(0-1${zeros})/3${zeros}7\n99999999999999999999999/7"
+    "1.0\n-0.03333333333333333\n1.4285714285714286e+22")
+check("1/0\n1.5/0\n12345678901234567890123/0\n2+2" "4")
+# kernels of the type pass: int ranges at the edge of a small int, doubles
+# mixed with ints, and generic operands under double operators
+check("70368744177663*2+1\n70368744177664*2\n(1+2)*2.5\n2.5*(1+2)\n(7/2)*2\n1.5*100000000000000000000"
+    "140737488355327\n140737488355328\n7.5\n7.5\n7.0\n1.5e+20")
+
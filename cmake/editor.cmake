@@ -0,0 +1,49 @@
+# Types lines into the line editor, with --repl=live as stdin is not a
+# terminal, and checks the previews shown while typing, editing and going
+# through the history, and the results of the lines entered.
+#
+# cmake -D CALCULATOR=... [-D ARGS=...] [-D NAME=...] -P editor.cmake
+
+set(DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}/${NAME})
+file(MAKE_DIRECTORY ${DIRECTORY})
+set(KEYS ${DIRECTORY}/editor_keys.txt)
+string(ASCII 4 ctrl_d)
+string(ASCII 21 ctrl_u)
+string(ASCII 27 escape)
+string(ASCII 127 backspace)
+set(left "${escape}[D")
+set(up "${escape}[A")
+string(REPEAT "+1" 20000 terms)
+# an open bracket is previewed as closed, a division by zero is dropped
+# with ctrl-u, a line from the history is edited in its middle
+file(WRITE ${KEYS} "1+2*3\r(4+5)/3\r7/0${ctrl_u}8-5\r${up}${left}${left}0\r1${terms}${backspace}1\r${ctrl_d}")
+separate_arguments(ARGS)
+execute_process(
+    COMMAND ${CALCULATOR} ${ARGS} --repl=live --stats
+    INPUT_FILE ${KEYS}
+    RESULT_VARIABLE status
+    OUTPUT_VARIABLE output
+    ERROR_VARIABLE errors)
+file(REMOVE ${KEYS})
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "calculator exited with ${status}:\n${errors}")
+endif()
+string(REGEX MATCHALL "${escape}\\[1;32m[^${escape}]*" results "${output}")
+string(REGEX REPLACE "${escape}\\[1;32m([0-9]+)(\\.0+)?" "\\1" results "${results}")
+if(NOT results STREQUAL "7;3;3;75;20001")
+    message(FATAL_ERROR "results are \"${results}\", expected \"7;3;3;75;20001\"")
+endif()
+# what is left on the screen line once the cursor moves are taken out
+string(REGEX REPLACE "${escape}\\[[0-9;]*[A-Za-z]" "" screen "${output}")
+# decimals preview as many places as they print
+string(REPLACE ".00" "" screen "${screen}")
+foreach(preview "> 1+2  = 3\r" "> 1+2*3  = 7\r" "> (4+5  = 9\r" "> (4+5)/  = 9\r"
+        "> 7/0  ! division by zero\r" "> 8-  = 8\r" "> 80-5  = 75\r")
+    string(FIND "${screen}" "${preview}" found)
+    if(found EQUAL -1)
+        message(FATAL_ERROR "no preview \"${preview}\" in:\n${screen}")
+    endif()
+endforeach()
+if(NOT errors MATCHES "preview +[0-9]+ updates, mean [0-9.]+ us, max [0-9.]+ us")
+    message(FATAL_ERROR "--stats has no preview line:\n${errors}")
+endif()
@@ -0,0 +1,47 @@
+# Evaluates a few lines with --stats=hw and checks the results are the
+# same as without it, that every line is counted once, and that the report
+# has a row for every stage or, where perf events are denied, says they are
+# unavailable.
+#
+# cmake -D CALCULATOR=... [-D ARGS=...] [-D NAME=...] -P hardware_counters.cmake
+
+set(DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}/${NAME})
+file(MAKE_DIRECTORY ${DIRECTORY})
+set(INPUT ${DIRECTORY}/hardware_counters_input.txt)
+file(WRITE ${INPUT} "1+2*3\n(4+5)/3\n7-(1+1)*2\n")
+separate_arguments(ARGS)
+execute_process(
+    COMMAND ${CALCULATOR} ${ARGS} ${INPUT}
+    RESULT_VARIABLE status
+    OUTPUT_VARIABLE expected)
+execute_process(
+    COMMAND ${CALCULATOR} ${ARGS} --stats=hw ${INPUT}
+    RESULT_VARIABLE status
+    OUTPUT_VARIABLE output
+    ERROR_VARIABLE report)
+file(REMOVE ${INPUT})
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "calculator --stats=hw exited with ${status}: ${report}")
+endif()
+if(NOT output STREQUAL expected)
+    message(FATAL_ERROR "results differ with --stats=hw:\n${output}")
+endif()
+if(NOT report MATCHES "--- hardware counters ---\n")
+    message(FATAL_ERROR "no hardware counters report:\n${report}")
+endif()
+# the end of input is not a line
+if(NOT report MATCHES "\nlines +3\n")
+    message(FATAL_ERROR "expected 3 lines:\n${report}")
+endif()
+if(report MATCHES "\nunavailable +[^\n]+\n")
+    message(STATUS "hardware counters unavailable here")
+    return()
+endif()
+foreach(row read tokenize parse execute other total "per node")
+    if(NOT report MATCHES "\n${row} +[0-9n]")
+        message(FATAL_ERROR "no ${row} row in the report:\n${report}")
+    endif()
+endforeach()
+if(NOT report MATCHES "\nnodes +17\n")
+    message(FATAL_ERROR "expected 17 nodes:\n${report}")
+endif()
@@ -0,0 +1,43 @@
+# Evaluates short lines around a line of more than a chunk's worth of
+# tokens and one long enough for the parallel front end, with workers and
+# --stats, and checks that the results are those of evaluating in order,
+# that both long lines were chunks of their own and that the load balance
+# accounts for every line.
+#
+# cmake -D CALCULATOR=... [-D ARGS=...] [-D NAME=...] -P load_balance.cmake
+
+set(DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}/${NAME})
+file(MAKE_DIRECTORY ${DIRECTORY})
+set(INPUT ${DIRECTORY}/load_balance_input.txt)
+string(REPEAT "12+34\n5*(6-7)\n" 50000 short)
+string(REPEAT "1+" 40000 costly)
+string(REPEAT "2*" 600000 long)
+file(WRITE ${INPUT} "${short}${costly}1\n${short}${long}2\n${short}")
+separate_arguments(ARGS)
+execute_process(
+    COMMAND ${CALCULATOR} ${INPUT}
+    OUTPUT_VARIABLE expected)
+execute_process(
+    COMMAND ${CALCULATOR} ${ARGS} --stats ${INPUT}
+    RESULT_VARIABLE status
+    OUTPUT_VARIABLE output
+    ERROR_VARIABLE stats)
+file(REMOVE ${INPUT})
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "calculator exited with ${status}:\n${stats}")
+endif()
+if(NOT output STREQUAL expected)
+    message(FATAL_ERROR "results differ from evaluating in order")
+endif()
+if(NOT stats MATCHES "\nstandalone +2 lines\n" OR NOT stats MATCHES "\nimbalance +[0-9.]+\n")
+    message(FATAL_ERROR "expected 2 standalone lines and the imbalance:\n${stats}")
+endif()
+string(REGEX MATCHALL "\n[0-9]+ +[0-9]+ +[0-9]+ +[0-9]+ " rows "${stats}")
+set(lines 0)
+foreach(row ${rows})
+    string(REGEX MATCH "([0-9]+) $" count "${row}")
+    math(EXPR lines "${lines} + ${CMAKE_MATCH_1}")
+endforeach()
+if(NOT lines EQUAL 300002)
+    message(FATAL_ERROR "the workers evaluated ${lines} lines, not 300002:\n${stats}")
+endif()
@@ -0,0 +1,79 @@
+# Evaluates a set of small files, one missing and one a directory, in a
+# single run and checks the output is every file's own output under a
+# ==> path <== header, that the two that can't be read are named in an error
+# and get no header, and that batch diagnostics name the file. Then evaluates them again with
+# --output-suffix and checks each output file holds that file's results.
+#
+# cmake -D GENERATOR=... -D CALCULATOR=... [-D ARGS=...]
+#       [-D NAME=...] -P multiple_files.cmake
+
+# removed at the end, so never the test's directory itself
+set(DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}/${NAME}/multiple_files)
+set(CORPUS ${DIRECTORY}/all.txt)
+set(LIST ${DIRECTORY}/list.txt)
+execute_process(
+    COMMAND ${CMAKE_COMMAND} -D GENERATOR=${GENERATOR} -D FILES=100 -D LINES=50
+        -D DIRECTORY=${DIRECTORY}/files -D CORPUS=${CORPUS} -D LIST=${LIST}
+        -P ${CMAKE_CURRENT_LIST_DIR}/split_corpus.cmake
+    RESULT_VARIABLE status)
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "could not generate the files")
+endif()
+file(STRINGS ${LIST} paths)
+list(INSERT paths 1 ${DIRECTORY}/missing.txt)
+list(INSERT paths 0 ${DIRECTORY}/files)
+set(expected "")
+set(separator "")
+foreach(path ${paths})
+    if(NOT EXISTS ${path} OR IS_DIRECTORY ${path})
+        continue()
+    endif()
+    execute_process(COMMAND ${CALCULATOR} ${path} OUTPUT_VARIABLE output ERROR_QUIET)
+    # the newline printed at the end of input comes once, after the last file
+    string(REGEX REPLACE "\n$" "" output "${output}")
+    set(expected_${path} "${output}")
+    string(APPEND expected "${separator}==> ${path} <==\n${output}")
+    set(separator "\n")
+endforeach()
+string(APPEND expected "\n")
+separate_arguments(ARGS)
+execute_process(
+    COMMAND ${CALCULATOR} ${ARGS} --diagnostics=${DIRECTORY}/diagnostics.txt ${paths}
+    RESULT_VARIABLE status
+    OUTPUT_VARIABLE output
+    ERROR_VARIABLE errors)
+file(READ ${DIRECTORY}/diagnostics.txt diagnostics)
+# batch mode keeps error messages out of the output files
+execute_process(
+    COMMAND ${CALCULATOR} ${ARGS} --diagnostics=${DIRECTORY}/diagnostics.txt --output-suffix=.out ${paths}
+    RESULT_VARIABLE suffix_status
+    OUTPUT_VARIABLE suffix_output
+    ERROR_QUIET)
+set(suffix_mismatch "")
+foreach(path ${paths})
+    if(IS_DIRECTORY ${path} AND EXISTS ${path}.out)
+        list(APPEND suffix_mismatch ${path})
+    elseif(EXISTS ${path} AND NOT IS_DIRECTORY ${path})
+        file(READ ${path}.out file_output)
+        if(NOT file_output STREQUAL expected_${path})
+            list(APPEND suffix_mismatch ${path})
+        endif()
+    endif()
+endforeach()
+file(REMOVE_RECURSE ${DIRECTORY})
+if(NOT status EQUAL 1 OR NOT errors MATCHES "missing.txt: No such file or directory"
+    OR NOT errors MATCHES "/files: Is a directory")
+    message(FATAL_ERROR "calculator exited with ${status}: ${errors}")
+endif()
+if(NOT output STREQUAL expected)
+    message(FATAL_ERROR "output differs from the files evaluated one by one")
+endif()
+if(NOT diagnostics MATCHES "^${DIRECTORY}/files/0.txt:[0-9]+:[0-9]+:[a-z-]+\n")
+    message(FATAL_ERROR "diagnostics do not name the file:\n${diagnostics}")
+endif()
+if(NOT suffix_status EQUAL 1 OR NOT suffix_output STREQUAL "\n")
+    message(FATAL_ERROR "calculator --output-suffix exited with ${suffix_status}: ${suffix_output}")
+endif()
+if(suffix_mismatch)
+    message(FATAL_ERROR "output files differ from the files evaluated one by one: ${suffix_mismatch}")
+endif()
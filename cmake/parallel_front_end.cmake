@@ -0,0 +1,44 @@
+# Evaluates lines of a few megabytes, valid and invalid, with the sequential
+# and the parallel front end and checks that results and diagnostics match.
+#
+# cmake -D GENERATOR=... -D CALCULATOR=... [-D ARGS=...]
+#       [-D NAME=...] -P parallel_front_end.cmake
+
+set(DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}/${NAME})
+file(MAKE_DIRECTORY ${DIRECTORY})
+set(CORPUS ${DIRECTORY}/parallel_front_end.txt)
+set(PART ${DIRECTORY}/parallel_front_end_part.txt)
+function(generate output)
+    execute_process(COMMAND ${GENERATOR} ${ARGN} --output ${output} RESULT_VARIABLE status)
+    if(NOT status EQUAL 0)
+        message(FATAL_ERROR "generator failed: ${status}")
+    endif()
+endfunction()
+# long chains, half of them mutated into syntax or runtime errors
+generate(${CORPUS} --seed 83 --count 4 --invalid 50 --shape chain --max-length 2500000)
+# deep nesting
+generate(${PART} --seed 84 --count 1 --invalid 0 --shape nested --max-depth 300000 --max-length 1300000)
+file(READ ${PART} part)
+file(APPEND ${CORPUS} "${part}")
+# a chain inside brackets, cut below the top level
+generate(${PART} --seed 85 --count 1 --invalid 0 --shape chain --max-length 1500000)
+file(READ ${PART} part)
+string(STRIP "${part}" part)
+file(APPEND ${CORPUS} "((((${part}))))\n")
+file(REMOVE ${PART})
+
+separate_arguments(ARGS)
+execute_process(COMMAND ${CALCULATOR} ${ARGS} ${CORPUS}
+    RESULT_VARIABLE sequential_status OUTPUT_VARIABLE sequential_output ERROR_VARIABLE sequential_errors)
+execute_process(COMMAND ${CALCULATOR} ${ARGS} --parse-threads=3 ${CORPUS}
+    RESULT_VARIABLE parallel_status OUTPUT_VARIABLE parallel_output ERROR_VARIABLE parallel_errors)
+file(REMOVE ${CORPUS})
+if(NOT sequential_status STREQUAL parallel_status)
+    message(FATAL_ERROR "exit status ${sequential_status} sequential, ${parallel_status} parallel")
+endif()
+if(NOT sequential_output STREQUAL parallel_output)
+    message(FATAL_ERROR "results differ:\n${sequential_output}\nparallel:\n${parallel_output}")
+endif()
+if(NOT sequential_errors STREQUAL parallel_errors)
+    message(FATAL_ERROR "diagnostics differ:\n${sequential_errors}\nparallel:\n${parallel_errors}")
+endif()
@@ -0,0 +1,29 @@
+# Runs the instrumented calculator over the training corpus and puts the
+# resulting profile where the profile-guided build looks for it.
+#
+# cmake -D CALCULATOR=path -D CORPUS=path -D RAW_PROFILE=path -D PROFILE=path
+#       [-D PROFDATA=llvm-profdata] -P pgo_training.cmake
+
+file(REMOVE ${RAW_PROFILE} ${PROFILE})
+# clang writes its raw profile where LLVM_PROFILE_FILE points, gcc next to
+# the object file of the instrumented build
+set(ENV{LLVM_PROFILE_FILE} ${RAW_PROFILE})
+execute_process(COMMAND ${CALCULATOR} ${CORPUS}
+    RESULT_VARIABLE result
+    OUTPUT_QUIET ERROR_QUIET)
+# the corpus has invalid lines so the calculator exits with 1
+if(NOT result MATCHES "^[01]$")
+    message(FATAL_ERROR "training run failed: ${result}")
+endif()
+if(NOT EXISTS ${RAW_PROFILE})
+    message(FATAL_ERROR "training run did not write ${RAW_PROFILE}")
+endif()
+if(PROFDATA)
+    execute_process(COMMAND ${PROFDATA} merge -output=${PROFILE} ${RAW_PROFILE}
+        RESULT_VARIABLE result)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "llvm-profdata merge failed")
+    endif()
+else()
+    configure_file(${RAW_PROFILE} ${PROFILE} COPYONLY)
+endif()
@@ -0,0 +1,37 @@
+# Evaluates a corpus whose results fill the pipe buffers many times over
+# with stdout a pipe, once spliced and once written, and checks both give
+# the same output.
+#
+# cmake -D GENERATOR=... -D CALCULATOR=... [-D ARGS=...]
+#       [-D NAME=...] -P pipe_output.cmake
+
+set(DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}/${NAME})
+file(MAKE_DIRECTORY ${DIRECTORY})
+set(CORPUS ${DIRECTORY}/pipe_output_corpus.txt)
+execute_process(
+    COMMAND ${GENERATOR} --seed 86 --count 200000 --max-depth 4 --max-length 64 --output ${CORPUS}
+    RESULT_VARIABLE status)
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "generator failed: ${status}")
+endif()
+separate_arguments(ARGS)
+foreach(mode write vmsplice)
+    execute_process(
+        COMMAND ${CALCULATOR} ${ARGS} --pipe-output=${mode} ${CORPUS}
+        RESULT_VARIABLE status
+        OUTPUT_VARIABLE output_${mode}
+        ERROR_QUIET)
+    # invalid lines make the exit status 1
+    if(NOT status EQUAL 1)
+        file(REMOVE ${CORPUS})
+        message(FATAL_ERROR "calculator --pipe-output=${mode} exited with ${status}")
+    endif()
+endforeach()
+file(REMOVE ${CORPUS})
+string(LENGTH "${output_vmsplice}" length)
+if(length LESS 1048576)
+    message(FATAL_ERROR "expected more than 1 MiB of results, got ${length} bytes")
+endif()
+if(NOT output_write STREQUAL output_vmsplice)
+    message(FATAL_ERROR "spliced output differs from written output")
+endif()
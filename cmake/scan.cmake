@@ -0,0 +1,61 @@
+# Checks the running aggregates of a few lines, failing ones among them,
+# then evaluates a corpus with --scan and checks that the workers' two pass
+# scan over their chunks gives the same output as evaluating in order, and
+# that the aggregate runs on from one file to the next.
+#
+# cmake -D GENERATOR=... -D CALCULATOR=... [-D MODE=...] [-D ARGS=...]
+#       [-D NAME=...] -P scan.cmake
+
+set(DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}/${NAME})
+file(MAKE_DIRECTORY ${DIRECTORY})
+set(INPUT ${DIRECTORY}/scan_input.txt)
+set(CORPUS ${DIRECTORY}/scan_corpus.txt)
+file(WRITE ${INPUT} "1\n4\n\n1/0\n2\n8-5\n")
+string(ASCII 27 escape)
+separate_arguments(MODE)
+separate_arguments(ARGS)
+set(sum "1 5 ! 5 7 10")
+set(min "1 1 ! 1 1 1")
+set(max "1 4 ! 4 4 4")
+foreach(scan sum min max)
+    execute_process(
+        COMMAND ${CALCULATOR} ${MODE} ${ARGS} --scan=${scan} ${INPUT}
+        RESULT_VARIABLE status
+        OUTPUT_VARIABLE output
+        ERROR_QUIET)
+    string(REGEX REPLACE "${escape}\\[[0-9;]*m" "" output "${output}")
+    string(REGEX REPLACE "(\\.00)?\\.\n" " " output "${output}")
+    string(STRIP "${output}" output)
+    if(NOT status EQUAL 1 OR NOT output STREQUAL "${${scan}}")
+        message(FATAL_ERROR "--scan=${scan} gave \"${output}\", expected \"${${scan}}\"")
+    endif()
+endforeach()
+execute_process(
+    COMMAND ${CALCULATOR} ${MODE} ${ARGS} --scan=sum ${INPUT} ${INPUT}
+    OUTPUT_VARIABLE output
+    ERROR_QUIET)
+string(REGEX REPLACE "${escape}\\[[0-9;]*m" "" output "${output}")
+if(NOT output MATCHES "\n20(\\.00)?\\.\n\n$")
+    message(FATAL_ERROR "the sum does not run on through the second file:\n${output}")
+endif()
+execute_process(
+    COMMAND ${GENERATOR} --seed 98 --count 300000 --max-depth 4 --max-length 64 --output ${CORPUS}
+    RESULT_VARIABLE status)
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "generator failed: ${status}")
+endif()
+foreach(scan sum min max)
+    execute_process(
+        COMMAND ${CALCULATOR} ${MODE} --scan=${scan} ${CORPUS}
+        OUTPUT_VARIABLE expected
+        ERROR_QUIET)
+    execute_process(
+        COMMAND ${CALCULATOR} ${MODE} ${ARGS} --scan=${scan} ${CORPUS}
+        OUTPUT_VARIABLE output
+        ERROR_QUIET)
+    if(NOT output STREQUAL expected)
+        file(REMOVE ${INPUT} ${CORPUS})
+        message(FATAL_ERROR "--scan=${scan} ${ARGS} differs from evaluating in order")
+    endif()
+endforeach()
+file(REMOVE ${INPUT} ${CORPUS})
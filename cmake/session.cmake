@@ -0,0 +1,72 @@
+# Evaluates the same lines with a session snapshot three times: cold, warm
+# from the snapshot, and after corrupting it, and with other number
+# options. Results must match a run without a session every time, the warm
+# run must answer from the snapshot, and bad snapshots must be replaced
+# while files that are not snapshots are refused. Lines answered from the
+# snapshot are timed by --slow-lines like any other.
+#
+# cmake -D CALCULATOR=... [-D ARGS=...] [-D NAME=...] -P session.cmake
+
+set(DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}/${NAME})
+file(MAKE_DIRECTORY ${DIRECTORY})
+set(INPUT ${DIRECTORY}/session_input.txt)
+set(SNAPSHOT ${DIRECTORY}/session_snapshot.bin)
+file(WRITE ${INPUT} "1+2*3\n(4+5)/3\n7/0\n1+2*3\n12\n")
+file(REMOVE ${SNAPSHOT})
+separate_arguments(ARGS)
+
+function(run name args expected_hits expected_warning)
+    execute_process(
+        COMMAND ${CALCULATOR} ${ARGS} ${args} ${INPUT}
+        OUTPUT_VARIABLE expected
+        ERROR_VARIABLE expected_errors)
+    execute_process(
+        COMMAND ${CALCULATOR} ${ARGS} ${args} --stats --session=${SNAPSHOT} ${INPUT}
+        OUTPUT_VARIABLE output
+        ERROR_VARIABLE errors)
+    if(NOT output STREQUAL expected)
+        message(FATAL_ERROR "${name}: results differ with a session:\n${output}")
+    endif()
+    if(NOT errors MATCHES "Division by Zero")
+        message(FATAL_ERROR "${name}: the failing line was not evaluated:\n${errors}")
+    endif()
+    if(NOT errors MATCHES "session hits +${expected_hits} of")
+        message(FATAL_ERROR "${name}: expected ${expected_hits} hits:\n${errors}")
+    endif()
+    if(NOT errors MATCHES "${expected_warning}")
+        message(FATAL_ERROR "${name}: expected a warning matching ${expected_warning}:\n${errors}")
+    endif()
+endfunction()
+
+# the repeated line hits within the run when one thread evaluates both
+run(cold "" "[01]" "")
+if(NOT EXISTS ${SNAPSHOT})
+    message(FATAL_ERROR "no snapshot written")
+endif()
+run(warm "" "4" "")
+run(options --decimal=2 "[01]" "other number options, starting a new session")
+run(rewarm --decimal=2 "4" "")
+# a file that is not a snapshot is refused and left alone
+file(WRITE ${SNAPSHOT} "notes, not a snapshot\n")
+execute_process(
+    COMMAND ${CALCULATOR} ${ARGS} --session=${SNAPSHOT} ${INPUT}
+    RESULT_VARIABLE status
+    OUTPUT_QUIET
+    ERROR_VARIABLE errors)
+file(READ ${SNAPSHOT} notes)
+if(status EQUAL 0 OR NOT errors MATCHES "not a session snapshot" OR NOT notes STREQUAL "notes, not a snapshot\n")
+    message(FATAL_ERROR "a file other than a snapshot was not refused (${status}):\n${errors}")
+endif()
+file(WRITE ${SNAPSHOT} "BODMASSN and then garbage")
+run(corrupt "" "[01]" "starting a new session")
+run(recovered "" "4" "")
+# a line answered from the snapshot is timed as a line of its own, with no
+# tokens or nodes
+execute_process(
+    COMMAND ${CALCULATOR} ${ARGS} --slow-lines=10 --session=${SNAPSHOT} ${INPUT}
+    OUTPUT_QUIET
+    ERROR_VARIABLE errors)
+if(NOT errors MATCHES "\n4 +6 +0 +0 ")
+    message(FATAL_ERROR "a session hit is not among the slow lines:\n${errors}")
+endif()
+file(REMOVE ${INPUT} ${SNAPSHOT})
@@ -0,0 +1,41 @@
+# Evaluates many short lines around a long one, slow enough to outlast
+# any preemption, with --slow-lines and checks the long line is reported
+# slowest with its number, size, tokens and nodes, past the first chunk of
+# the workers, and that the results are the same as without timing.
+#
+# cmake -D CALCULATOR=... [-D ARGS=...] [-D NAME=...] -P slow_lines.cmake
+
+set(DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}/${NAME})
+file(MAKE_DIRECTORY ${DIRECTORY})
+set(INPUT ${DIRECTORY}/slow_lines_input.txt)
+string(REPEAT "1+2\n" 100000 short)
+string(REPEAT "1+" 499999 long)
+# the long line is line 100002, after a blank one
+file(WRITE ${INPUT} "${short}\n${long}1\n${short}")
+separate_arguments(ARGS)
+execute_process(
+    COMMAND ${CALCULATOR} ${ARGS} ${INPUT}
+    RESULT_VARIABLE status
+    OUTPUT_VARIABLE expected)
+execute_process(
+    COMMAND ${CALCULATOR} ${ARGS} --slow-lines=3 ${INPUT}
+    RESULT_VARIABLE status
+    OUTPUT_VARIABLE output
+    ERROR_VARIABLE report)
+file(REMOVE ${INPUT})
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "calculator --slow-lines exited with ${status}: ${report}")
+endif()
+if(NOT output STREQUAL expected)
+    message(FATAL_ERROR "results differ with --slow-lines")
+endif()
+string(REGEX MATCHALL "\n[0-9]+ +[0-9]+ +[0-9-]+ +[0-9]+ +[0-9.]+" rows "${report}")
+list(LENGTH rows count)
+if(NOT report MATCHES "--- slow lines ---\n" OR NOT count EQUAL 3)
+    message(FATAL_ERROR "expected 3 slow lines:\n${report}")
+endif()
+# 999999 characters and the newline, a token for each, and 999999 nodes
+list(GET rows 0 slowest)
+if(NOT slowest MATCHES "^\n100002 +1000000 +1000000 +999999 ")
+    message(FATAL_ERROR "the long line is not the slowest:\n${report}")
+endif()
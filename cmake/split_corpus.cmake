@@ -0,0 +1,24 @@
+# Generates FILES small corpus files of LINES lines each in DIRECTORY, their
+# concatenation in CORPUS and their paths, one per line, in LIST.
+#
+# cmake -D GENERATOR=... -D FILES=... -D LINES=... -D DIRECTORY=...
+#       -D CORPUS=... -D LIST=... [-D ARGS=...] -P split_corpus.cmake
+
+separate_arguments(ARGS)
+file(REMOVE_RECURSE ${DIRECTORY})
+file(MAKE_DIRECTORY ${DIRECTORY})
+file(WRITE ${CORPUS} "")
+file(WRITE ${LIST} "")
+math(EXPR last "${FILES} - 1")
+foreach(i RANGE ${last})
+    set(path ${DIRECTORY}/${i}.txt)
+    execute_process(
+        COMMAND ${GENERATOR} --seed ${i} --count ${LINES} ${ARGS} --output ${path}
+        RESULT_VARIABLE status)
+    if(NOT status EQUAL 0)
+        message(FATAL_ERROR "generator failed: ${status}")
+    endif()
+    file(READ ${path} contents)
+    file(APPEND ${CORPUS} "${contents}")
+    file(APPEND ${LIST} "${path}\n")
+endforeach()
@@ -0,0 +1,80 @@
+# Evaluates the numbers 1 to 1000 with 7 and 42 among them 500 and 300
+# times, all of it 100 times over so the workers get several chunks, with
+# --summary and checks the count, extremes and mean, the median to within
+# the sketch's rank error, a histogram bucket and the two most frequent
+# results. Then checks every quantile of 100000 distinct results, in an
+# order the workers' chunks don't sort, against its exact rank.
+#
+# cmake -D CALCULATOR=... [-D ARGS=...] [-D NAME=...] -P summary.cmake
+
+set(DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}/${NAME})
+file(MAKE_DIRECTORY ${DIRECTORY})
+set(INPUT ${DIRECTORY}/summary_input.txt)
+set(block "")
+foreach(i RANGE 1 1000)
+    string(APPEND block "${i}\n")
+    if(i LESS_EQUAL 500)
+        string(APPEND block "3+4\n")
+    endif()
+    if(i LESS_EQUAL 300)
+        string(APPEND block "6*7\n")
+    endif()
+endforeach()
+string(REPEAT "${block}" 100 numbers)
+# an invalid line has no result
+file(WRITE ${INPUT} "${numbers}1+\n")
+separate_arguments(ARGS)
+execute_process(
+    COMMAND ${CALCULATOR} ${ARGS} --summary ${INPUT}
+    RESULT_VARIABLE status
+    OUTPUT_QUIET
+    ERROR_VARIABLE summary)
+file(REMOVE ${INPUT})
+if(NOT status EQUAL 1)
+    message(FATAL_ERROR "calculator --summary exited with ${status}")
+endif()
+foreach(expected "results +180000\n" "min +1\n" "mean +287\n" "max +1000\n" "\n\\[512, 1024\\) +48900 ")
+    if(NOT summary MATCHES "${expected}")
+        message(FATAL_ERROR "expected ${expected} in the summary:\n${summary}")
+    endif()
+endforeach()
+# ranks are within 1% or so, the median 90000th result is 100
+if(NOT summary MATCHES "\np50 +([0-9.]+)\n" OR CMAKE_MATCH_1 LESS 80 OR CMAKE_MATCH_1 GREATER 120)
+    message(FATAL_ERROR "median off:\n${summary}")
+endif()
+# counts may be over, never under
+if(NOT summary MATCHES "top results ---\n[^\n]*\n7(\\.0+)? +([0-9]+) +[0-9]+\n42(\\.0+)? +([0-9]+) "
+    OR CMAKE_MATCH_2 LESS 50100 OR CMAKE_MATCH_4 LESS 30100)
+    message(FATAL_ERROR "expected 7 and 42 most frequent:\n${summary}")
+endif()
+
+# the numbers 1 to 100000, 1000 of them at a time in a scattered order
+set(block "")
+foreach(i RANGE 0 999)
+    math(EXPR x "${i} * 919 % 1000 + 1")
+    string(APPEND block "OFFSET+${x}\n")
+endforeach()
+set(numbers "")
+foreach(r RANGE 0 99)
+    math(EXPR offset "${r} * 37 % 100 * 1000")
+    string(REPLACE "OFFSET" "${offset}" part "${block}")
+    string(APPEND numbers "${part}")
+endforeach()
+file(WRITE ${INPUT} "${numbers}")
+execute_process(
+    COMMAND ${CALCULATOR} ${ARGS} --summary ${INPUT}
+    OUTPUT_QUIET
+    ERROR_VARIABLE summary)
+file(REMOVE ${INPUT})
+# 99% of quantiles are within 1.35% of their rank, merged or not; the 2%
+# allowed here keeps the test from failing on the other 1%
+foreach(quantile 1 5 25 50 75 95 99)
+    if(NOT summary MATCHES "\np${quantile} +([0-9.]+)\n")
+        message(FATAL_ERROR "no p${quantile}:\n${summary}")
+    endif()
+    math(EXPR low "${quantile} * 1000 - 2000")
+    math(EXPR high "${quantile} * 1000 + 2000")
+    if(CMAKE_MATCH_1 LESS low OR CMAKE_MATCH_1 GREATER high)
+        message(FATAL_ERROR "p${quantile} ${CMAKE_MATCH_1} is not within 2% of ${quantile}000:\n${summary}")
+    endif()
+endforeach()
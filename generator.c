@@ -0,0 +1,341 @@
+// Jacob Bumbuna <developer@devbumbuna.com>
+// 2022
+// no copyright
+
+/**
+ * Expression corpus generator.
+ *
+ * Writes randomly generated arithmetic expressions, one per line, to stdout.
+ * The same seed always produces the same corpus so failing inputs found by
+ * the stress test can be reproduced.
+ *
+ * usage: generator [--seed N] [--count N] [--invalid PERCENT]
+ *                  [--max-depth N] [--max-length N]
+ *                  [--shape mixed|chain|nested] [--output FILE]
+ *
+ * The mixed shape varies nesting and chain length from line to line, the
+ * chain shape fills every line with one unbracketed chain of operands and
+ * the nested shape wraps a number in --max-depth brackets, as many as fit.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SUCCESS 0
+#define FAILURE 1
+/* longest line the calculator accepts excluding the newline */
+#define DEFAULT_MAX_LENGTH 1023
+
+/* command line options */
+static uint64_t option_seed = 1;
+static long long option_count = 1000;
+static int option_invalid_percent = 20;
+static int option_max_depth = 40;
+static size_t option_max_length = DEFAULT_MAX_LENGTH;
+static const char *option_output = NULL;
+enum shape {
+    shape_mixed,
+    shape_chain,
+    shape_nested
+};
+static enum shape option_shape = shape_mixed;
+
+/* xorshift64* state */
+static uint64_t rng_state;
+
+static uint64_t rng_next() {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+/* uniform-ish integer in [0, n) */
+#define rng_below(n) \
+    ((int)(rng_next() % (uint64_t)(n)))
+
+/* true with the given probability in percent */
+#define rng_chance(percent) \
+    (rng_below(100) < (percent))
+
+/* expression being generated, room for option_max_length and a newline */
+static char *expression;
+static size_t expression_length;
+/* set when the expression grew past option_max_length */
+static int expression_overflowed;
+/* limits for the expression being generated */
+static int line_max_depth;
+static int line_max_chain;
+
+static void emit_char(char c) {
+    if(expression_length >= option_max_length) {
+        expression_overflowed = 1;
+        return;
+    }
+    expression[expression_length++] = c;
+}
+
+/**
+ * whitespace the tokenizer skips, newline excluded.
+*/
+static void emit_whitespace() {
+    static const char whitespace[] = " \t\v\f\r";
+    if(rng_chance(25)) {
+        int n = 1 + rng_below(3);
+        for(int i = 0; i < n; i++) {
+            emit_char(rng_chance(80) ? ' ' : whitespace[rng_below(sizeof(whitespace)-1)]);
+        }
+    }
+}
+
+static void emit_number() {
+    int digits;
+    int kind = rng_below(100);
+    if(kind < 80) {
+        /* small values keep most results in range */
+        digits = 1 + rng_below(2);
+    } else if(kind < 96) {
+        digits = 3 + rng_below(8);
+    } else {
+        /* huge literals overflow strtol */
+        digits = 11 + rng_below(30);
+    }
+    emit_char('0' + (digits == 1 ? rng_below(10) : 1 + rng_below(9)));
+    for(int i = 1; i < digits; i++) {
+        emit_char('0' + rng_below(10));
+    }
+}
+
+static void emit_operator() {
+    static const char operators[] = "+-*/";
+    emit_char(operators[rng_below(4)]);
+}
+
+static void emit_expression(int depth);
+
+static void emit_unit(int depth) {
+    emit_whitespace();
+    if(depth < line_max_depth && rng_chance(depth == 0 ? 30 : 70)) {
+        emit_char('(');
+        emit_expression(depth+1);
+        emit_whitespace();
+        emit_char(')');
+    } else {
+        emit_number();
+    }
+}
+
+static void emit_expression(int depth) {
+    int operands = 1 + rng_below(line_max_chain);
+    emit_unit(depth);
+    for(int i = 1; i < operands && !expression_overflowed; i++) {
+        emit_whitespace();
+        emit_operator();
+        emit_unit(depth);
+    }
+}
+
+/**
+ * insert a character at a random position of the expression.
+*/
+static void insert_char(char c) {
+    if(expression_length >= option_max_length) {
+        return;
+    }
+    size_t at = rng_below(expression_length+1);
+    memmove(&expression[at+1], &expression[at], expression_length-at);
+    expression[at] = c;
+    expression_length++;
+}
+
+/**
+ * turn a valid expression into a (most likely) invalid one.
+*/
+static void mutate_expression() {
+    static const char invalid_characters[] = "abcxyz=!@#$%^&_.,;:'\"<>?[]{}|~`";
+    switch(rng_below(6)) {
+        case 0: {
+            insert_char(invalid_characters[rng_below(sizeof(invalid_characters)-1)]);
+            break;
+        }
+        case 1: {
+            if(expression_length > 1) {
+                size_t at = rng_below(expression_length);
+                memmove(&expression[at], &expression[at+1], expression_length-at-1);
+                expression_length--;
+            }
+            break;
+        }
+        case 2: {
+            insert_char("+-*/"[rng_below(4)]);
+            break;
+        }
+        case 3: {
+            insert_char(rng_chance(50) ? '(' : ')');
+            break;
+        }
+        case 4: {
+            /* runtime error rather than a syntax error */
+            const char *zero = rng_chance(50) ? "/0" : "/(7-7)";
+            while(*zero) {
+                emit_char(*zero++);
+            }
+            break;
+        }
+        case 5: {
+            insert_char(')');
+            insert_char('(');
+            break;
+        }
+    }
+}
+
+/**
+ * operands joined by operators up to the maximum length.
+*/
+static void generate_chain() {
+    expression_length = 0;
+    expression_overflowed = 0;
+    emit_number();
+    while(!expression_overflowed) {
+        size_t complete = expression_length;
+        emit_whitespace();
+        emit_operator();
+        emit_whitespace();
+        emit_number();
+        if(expression_overflowed) {
+            /* drop the operand that did not fit */
+            expression_length = complete;
+        }
+    }
+}
+
+/**
+ * a number inside as many brackets as fit, every level closed either bare
+ * or followed by an operator and a non-zero operand so results stay valid.
+*/
+static void generate_nested() {
+    /* a level takes at most 4 characters, the number at most 40 */
+    size_t levels = option_max_length > 44 ? (option_max_length-40) / 4 : 1;
+    if(levels > (size_t)option_max_depth) {
+        levels = option_max_depth;
+    }
+    expression_length = 0;
+    expression_overflowed = 0;
+    for(size_t i = 0; i < levels; i++) {
+        emit_char('(');
+    }
+    emit_number();
+    for(size_t i = 0; i < levels; i++) {
+        emit_char(')');
+        if(rng_chance(50)) {
+            emit_operator();
+            emit_char('1' + rng_below(9));
+        }
+    }
+}
+
+static void generate_line() {
+    int depth = 1 + rng_below(option_max_depth);
+    int chain = rng_chance(5) ? 64 : 4;
+    if(rng_chance(1)) {
+        /* blank lines are skipped by the calculator */
+        expression_length = 0;
+        emit_whitespace();
+        return;
+    }
+    if(option_shape != shape_mixed) {
+        if(option_shape == shape_chain) {
+            generate_chain();
+        } else {
+            generate_nested();
+        }
+        if(rng_chance(option_invalid_percent)) {
+            mutate_expression();
+        }
+        return;
+    }
+    do {
+        expression_length = 0;
+        expression_overflowed = 0;
+        line_max_depth = depth;
+        line_max_chain = chain;
+        emit_expression(0);
+        emit_whitespace();
+        /* shrink until the expression fits in a line */
+        depth = depth/2;
+        chain = chain > 1 ? chain/2 : 1;
+    } while(expression_overflowed);
+    if(rng_chance(option_invalid_percent)) {
+        mutate_expression();
+    }
+}
+
+static int parse_arguments(int argc, char **argv) {
+    for(int i = 1; i < argc; i++) {
+        if(i+1 >= argc) {
+            fprintf(stderr, "generator: missing value for %s\n", argv[i]);
+            return FAILURE;
+        }
+        const char *value = argv[++i];
+        if(!strcmp(argv[i-1], "--seed")) {
+            option_seed = strtoull(value, 0, 10);
+        } else if(!strcmp(argv[i-1], "--count")) {
+            option_count = strtoll(value, 0, 10);
+        } else if(!strcmp(argv[i-1], "--invalid")) {
+            option_invalid_percent = atoi(value);
+        } else if(!strcmp(argv[i-1], "--max-depth")) {
+            option_max_depth = atoi(value);
+        } else if(!strcmp(argv[i-1], "--max-length")) {
+            option_max_length = strtoull(value, 0, 10);
+        } else if(!strcmp(argv[i-1], "--shape")) {
+            if(!strcmp(value, "mixed")) {
+                option_shape = shape_mixed;
+            } else if(!strcmp(value, "chain")) {
+                option_shape = shape_chain;
+            } else if(!strcmp(value, "nested")) {
+                option_shape = shape_nested;
+            } else {
+                fprintf(stderr, "generator: unknown shape %s\n", value);
+                return FAILURE;
+            }
+        } else if(!strcmp(argv[i-1], "--output")) {
+            option_output = value;
+        } else {
+            fprintf(stderr, "generator: unknown option %s\n", argv[i-1]);
+            return FAILURE;
+        }
+    }
+    if(option_max_depth < 1 || option_max_length < 1) {
+        fprintf(stderr, "generator: invalid limits\n");
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+int main(int argc, char **argv) {
+    static char output_buffer[1 << 16];
+    if(parse_arguments(argc, argv) != SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    expression = malloc(option_max_length+1);
+    if(expression == NULL) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+    /* xorshift must not start from 0 */
+    rng_state = option_seed * 0x9E3779B97F4A7C15ULL + 1;
+    if(option_output != NULL && freopen(option_output, "w", stdout) == NULL) {
+        perror("freopen");
+        return EXIT_FAILURE;
+    }
+    setvbuf(stdout, output_buffer, _IOFBF, sizeof(output_buffer));
+    for(long long i = 0; i < option_count; i++) {
+        generate_line();
+        expression[expression_length] = '\n';
+        fwrite(expression, 1, expression_length+1, stdout);
+    }
+    return fflush(stdout) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
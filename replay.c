@@ -0,0 +1,425 @@
+// Jacob Bumbuna <developer@devbumbuna.com>
+// 2022
+// no copyright
+
+/**
+ * Traffic replay.
+ *
+ * Sends the lines of a capture written by calculator --capture to every
+ * variant on stdin, at the pace they were recorded, --speed times faster,
+ * or as fast as the variant takes them with --speed max. A variant is
+ * written as NAME=COMMAND like for benchmark, and is given --line-buffered
+ * and --diagnostics=/dev/stdout so that every line, valid or not, answers
+ * with one line on stdout as soon as it is evaluated. A line's latency runs
+ * from when it was written to when its answer was read. Reports the
+ * throughput and latency percentiles of each variant. --dump writes the
+ * captured lines to a file instead.
+ *
+ * usage: replay --capture FILE [--speed N|max] [--json FILE] [--name NAME]
+ *               [--dump FILE] NAME=COMMAND...
+*/
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SUCCESS 0
+#define FAILURE 1
+#define MAX_VARIANTS 32
+#define MAX_ARGUMENTS 32
+
+/* as calculator.c writes it */
+#define CAPTURE_MAGIC "BODMASCP"
+#define CAPTURE_VERSION 1
+
+typedef struct capture_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t started;
+} capture_header_t;
+
+/* command line options */
+static const char *option_capture = NULL;
+/* 0 sends as fast as the variant reads */
+static double option_speed = 1;
+static const char *option_json = NULL;
+static const char *option_name = "replay";
+static const char *option_dump = NULL;
+
+/* a command being replayed to */
+typedef struct variant {
+    char *name;
+    char **argv;
+    double seconds;
+    /* latencies in seconds, sorted */
+    double *latencies;
+} variant_t;
+
+static variant_t variants[MAX_VARIANTS];
+static int variants_size;
+
+/* a captured line, time in microseconds from the first */
+typedef struct record {
+    long long time;
+    const char *line;
+    int size;
+} record_t;
+
+static char *capture_data;
+static record_t *records;
+static long long records_size;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * split NAME=COMMAND into a variant, the options for replies appended.
+*/
+static int add_variant(char *specification) {
+    char *command = strchr(specification, '=');
+    if(command == NULL || variants_size == MAX_VARIANTS) {
+        fprintf(stderr, "replay: bad variant %s\n", specification);
+        return FAILURE;
+    }
+    variant_t *v = &variants[variants_size++];
+    *command++ = 0;
+    v->name = specification;
+    v->argv = malloc(MAX_ARGUMENTS * sizeof(char *));
+    if(v->argv == NULL) {
+        perror("malloc");
+        return FAILURE;
+    }
+    int argc = 0;
+    for(char *arg = strtok(command, " "); arg != NULL; arg = strtok(NULL, " ")) {
+        if(argc == MAX_ARGUMENTS-3) {
+            fprintf(stderr, "replay: too many arguments for %s\n", v->name);
+            return FAILURE;
+        }
+        v->argv[argc++] = arg;
+    }
+    if(argc == 0) {
+        return FAILURE;
+    }
+    v->argv[argc++] = "--line-buffered";
+    v->argv[argc++] = "--diagnostics=/dev/stdout";
+    v->argv[argc] = NULL;
+    return SUCCESS;
+}
+
+static int parse_arguments(int argc, char **argv) {
+    /* options first, every one takes a value */
+    for(int i = 1; i < argc; i++) {
+        if(strncmp(argv[i], "--", 2)) {
+            continue;
+        }
+        if(i+1 >= argc) {
+            fprintf(stderr, "replay: missing value for %s\n", argv[i]);
+            return FAILURE;
+        }
+        const char *value = argv[++i];
+        if(!strcmp(argv[i-1], "--capture")) {
+            option_capture = value;
+        } else if(!strcmp(argv[i-1], "--speed")) {
+            option_speed = strcmp(value, "max") ? atof(value) : 0;
+            if(option_speed < 0 || (option_speed == 0 && strcmp(value, "max"))) {
+                fprintf(stderr, "replay: bad speed %s\n", value);
+                return FAILURE;
+            }
+        } else if(!strcmp(argv[i-1], "--json")) {
+            option_json = value;
+        } else if(!strcmp(argv[i-1], "--name")) {
+            option_name = value;
+        } else if(!strcmp(argv[i-1], "--dump")) {
+            option_dump = value;
+        } else {
+            fprintf(stderr, "replay: unknown option %s\n", argv[i-1]);
+            return FAILURE;
+        }
+    }
+    for(int i = 1; i < argc; i++) {
+        if(!strncmp(argv[i], "--", 2)) {
+            i++;
+        } else if(add_variant(argv[i]) != SUCCESS) {
+            return FAILURE;
+        }
+    }
+    if(option_capture == NULL || (variants_size == 0 && option_dump == NULL)) {
+        fprintf(stderr, "usage: replay --capture FILE [--speed N|max] [--json FILE] [--name NAME]"
+            " [--dump FILE] NAME=COMMAND...\n");
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+/**
+ * read a varint at *p, before end, SUCCESS if there was a whole one.
+*/
+static int read_varint(const unsigned char **p, const unsigned char *end, uint64_t *value) {
+    *value = 0;
+    for(int shift = 0; *p < end && shift < 64; shift += 7) {
+        unsigned char byte = *(*p)++;
+        *value |= (uint64_t)(byte & 0x7f) << shift;
+        if(!(byte & 0x80)) {
+            return SUCCESS;
+        }
+    }
+    return FAILURE;
+}
+
+/**
+ * read the capture file into records.
+*/
+static int load_capture() {
+    struct stat st;
+    int fd = open(option_capture, O_RDONLY);
+    if(fd == -1 || fstat(fd, &st) == -1) {
+        perror(option_capture);
+        return FAILURE;
+    }
+    capture_data = malloc(st.st_size + 1);
+    if(capture_data == NULL) {
+        perror("malloc");
+        return FAILURE;
+    }
+    off_t size = 0;
+    ssize_t n;
+    while(size < st.st_size && (n = read(fd, capture_data + size, st.st_size - size)) > 0) {
+        size += n;
+    }
+    close(fd);
+    capture_header_t header;
+    if(size < (off_t)sizeof(header)) {
+        fprintf(stderr, "replay: %s is not a capture\n", option_capture);
+        return FAILURE;
+    }
+    memcpy(&header, capture_data, sizeof(header));
+    if(memcmp(header.magic, CAPTURE_MAGIC, 8) != 0 || header.version != CAPTURE_VERSION ||
+        header.header_size != sizeof(header)) {
+        fprintf(stderr, "replay: %s is not a capture of this version\n", option_capture);
+        return FAILURE;
+    }
+    const unsigned char *p = (const unsigned char *)capture_data + sizeof(header);
+    const unsigned char *end = (const unsigned char *)capture_data + size;
+    long long capacity = 0;
+    long long time = 0;
+    while(p < end) {
+        uint64_t delta, length;
+        if(read_varint(&p, end, &delta) != SUCCESS || read_varint(&p, end, &length) != SUCCESS ||
+            length > (uint64_t)(end - p)) {
+            fprintf(stderr, "replay: %s is truncated after %lld lines\n", option_capture, records_size);
+            return FAILURE;
+        }
+        if(records_size == capacity) {
+            capacity = capacity ? capacity*2 : 1024;
+            record_t *grown = realloc(records, capacity * sizeof(record_t));
+            if(grown == NULL) {
+                perror("realloc");
+                return FAILURE;
+            }
+            records = grown;
+        }
+        time += delta;
+        records[records_size++] = (record_t){time, (const char *)p, length};
+        p += length;
+    }
+    return SUCCESS;
+}
+
+static int dump_capture() {
+    FILE *f = fopen(option_dump, "w");
+    if(f == NULL) {
+        perror(option_dump);
+        return FAILURE;
+    }
+    for(long long i = 0; i < records_size; i++) {
+        fwrite(records[i].line, 1, records[i].size, f);
+        fputc('\n', f);
+    }
+    return fclose(f) == 0 ? SUCCESS : FAILURE;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * replay the capture to a variant, SUCCESS if every line was answered.
+*/
+static int replay_variant(variant_t *v) {
+    int in[2], out[2];
+    double *sent_at = malloc(records_size * sizeof(double));
+    v->latencies = malloc(records_size * sizeof(double));
+    int null_fd = open("/dev/null", O_WRONLY|O_CLOEXEC);
+    if(sent_at == NULL || v->latencies == NULL || null_fd == -1 ||
+        pipe2(in, O_CLOEXEC) == -1 || pipe2(out, O_CLOEXEC) == -1) {
+        perror("replay");
+        return FAILURE;
+    }
+    pid_t pid = fork();
+    if(pid == 0) {
+        dup2(in[0], STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        execv(v->argv[0], v->argv);
+        _exit(127);
+    }
+    close(in[0]);
+    close(out[1]);
+    close(null_fd);
+    if(pid == -1) {
+        perror("fork");
+        return FAILURE;
+    }
+    fcntl(in[1], F_SETFL, O_NONBLOCK);
+    long long sent = 0;
+    long long answered = 0;
+    /* bytes of the next line written, its newline included */
+    int written = 0;
+    int eof = 0;
+    double start = now();
+    /* read to the end, the variant writes more when its input ends */
+    while(!eof) {
+        struct pollfd fds[2] = {{out[0], POLLIN, 0}, {in[1], 0, 0}};
+        struct timespec timeout, *wait = NULL;
+        if(sent < records_size) {
+            double due = option_speed ? start + records[sent].time / 1e6 / option_speed : 0;
+            double t = now();
+            if(due <= t) {
+                fds[1].events = POLLOUT;
+            } else {
+                timeout.tv_sec = (time_t)(due - t);
+                timeout.tv_nsec = (long)((due - t - timeout.tv_sec) * 1e9);
+                wait = &timeout;
+            }
+        }
+        if(ppoll(fds, in[1] == -1 ? 1 : 2, wait, NULL) == -1) {
+            perror("ppoll");
+            break;
+        }
+        if(fds[0].revents) {
+            char answers[1 << 16];
+            ssize_t n = read(out[0], answers, sizeof(answers));
+            double t = now();
+            eof = n <= 0;
+            for(char *p = answers; n > 0 && (p = memchr(p, '\n', answers+n-p)) != NULL; p++) {
+                /* the newline printed at exit answers nothing */
+                if(answered < sent) {
+                    v->latencies[answered] = t - sent_at[answered];
+                    answered++;
+                }
+            }
+        }
+        while(fds[1].revents && sent < records_size) {
+            record_t *r = &records[sent];
+            if(option_speed && start + r->time / 1e6 / option_speed > now()) {
+                break;
+            }
+            struct iovec iov[2] = {{(void *)(r->line + written), r->size - written}, {"\n", 1}};
+            /* once the line is out only its newline is left */
+            int first = written == r->size;
+            ssize_t n = writev(in[1], &iov[first], 2 - first);
+            if(n <= 0) {
+                break;
+            }
+            written += n;
+            if(written == r->size + 1) {
+                sent_at[sent++] = now();
+                written = 0;
+            }
+        }
+        if(sent == records_size && in[1] != -1) {
+            close(in[1]);
+            in[1] = -1;
+        }
+    }
+    v->seconds = now() - start;
+    if(in[1] != -1) {
+        close(in[1]);
+    }
+    close(out[0]);
+    free(sent_at);
+    int status;
+    if(waitpid(pid, &status, 0) == -1) {
+        perror("waitpid");
+        return FAILURE;
+    }
+    /* invalid lines make the calculator exit with 1 */
+    if(WIFSIGNALED(status) || WEXITSTATUS(status) > 1 || answered < records_size) {
+        fprintf(stderr, "replay: %s failed after %lld of %lld lines\n", v->name, answered, records_size);
+        return FAILURE;
+    }
+    qsort(v->latencies, records_size, sizeof(double), compare_doubles);
+    return SUCCESS;
+}
+
+/* latency in microseconds below which fraction of the lines were answered */
+static double percentile(variant_t *v, double fraction) {
+    long long i = (long long)(fraction * records_size);
+    return v->latencies[i < records_size ? i : records_size-1] * 1e6;
+}
+
+int main(int argc, char **argv) {
+    if(parse_arguments(argc, argv) != SUCCESS || load_capture() != SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    if(option_dump != NULL && dump_capture() != SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    if(variants_size == 0) {
+        return EXIT_SUCCESS;
+    }
+    if(records_size == 0) {
+        fprintf(stderr, "replay: %s holds no lines\n", option_capture);
+        return EXIT_FAILURE;
+    }
+    for(int i = 0; i < variants_size; i++) {
+        if(replay_variant(&variants[i]) != SUCCESS) {
+            return EXIT_FAILURE;
+        }
+    }
+    FILE *json = NULL;
+    if(option_json != NULL && (json = fopen(option_json, "a")) == NULL) {
+        perror("fopen");
+        return EXIT_FAILURE;
+    }
+    double recorded = records[records_size-1].time / 1e6;
+    printf("%s: %lld lines over %.3f s recorded, ", option_name, records_size, recorded);
+    if(option_speed) {
+        printf("replayed at %gx\n", option_speed);
+    } else {
+        printf("replayed at max speed\n");
+    }
+    printf("%-16s %10s %12s %10s %10s %10s %10s %10s\n", "variant", "seconds", "lines/s",
+        "p50 us", "p90 us", "p99 us", "p99.9 us", "max us");
+    for(int i = 0; i < variants_size; i++) {
+        variant_t *v = &variants[i];
+        double p50 = percentile(v, 0.5), p90 = percentile(v, 0.9), p99 = percentile(v, 0.99);
+        double p999 = percentile(v, 0.999), max = v->latencies[records_size-1] * 1e6;
+        printf("%-16s %10.3f %12.0f %10.1f %10.1f %10.1f %10.1f %10.1f\n", v->name, v->seconds,
+            records_size / v->seconds, p50, p90, p99, p999, max);
+        if(json != NULL) {
+            fprintf(json, "{\"benchmark\": \"%s\", \"variant\": \"%s\", \"lines\": %lld, \"speed\": %g,"
+                " \"seconds\": %.4f, \"lines_per_second\": %.0f, \"p50_us\": %.1f, \"p90_us\": %.1f,"
+                " \"p99_us\": %.1f, \"p999_us\": %.1f, \"max_us\": %.1f}\n",
+                option_name, v->name, records_size, option_speed, v->seconds, records_size / v->seconds,
+                p50, p90, p99, p999, max);
+        }
+    }
+    if(json != NULL) {
+        fclose(json);
+    }
+    return EXIT_SUCCESS;
+}
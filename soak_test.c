@@ -0,0 +1,168 @@
+// Jacob Bumbuna <developer@devbumbuna.com>
+// 2022
+// no copyright
+
+/**
+ * Steady-state memory soak test.
+ *
+ * Streams generated expressions through a pipe into `calculator --stats`
+ * and fails when the resident set size reported by the calculator grows by
+ * more than a small constant after warm-up.
+ *
+ * usage: soak_test --calculator PATH --generator PATH [--count N]
+ *                  [--seed N] [--max-growth KIB] [--json FILE] [--name NAME]
+*/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SUCCESS 0
+#define FAILURE 1
+
+/* command line options */
+static const char *option_calculator = NULL;
+static const char *option_generator = NULL;
+static long long option_count = 1000000;
+static unsigned long long option_seed = 1;
+static long option_max_growth = 256;
+static const char *option_json = NULL;
+static const char *option_name = "memory_soak";
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int parse_arguments(int argc, char **argv) {
+    for(int i = 1; i < argc; i++) {
+        if(i+1 >= argc) {
+            fprintf(stderr, "soak_test: missing value for %s\n", argv[i]);
+            return FAILURE;
+        }
+        const char *value = argv[++i];
+        if(!strcmp(argv[i-1], "--calculator")) {
+            option_calculator = value;
+        } else if(!strcmp(argv[i-1], "--generator")) {
+            option_generator = value;
+        } else if(!strcmp(argv[i-1], "--count")) {
+            option_count = strtoll(value, 0, 10);
+        } else if(!strcmp(argv[i-1], "--seed")) {
+            option_seed = strtoull(value, 0, 10);
+        } else if(!strcmp(argv[i-1], "--max-growth")) {
+            option_max_growth = strtol(value, 0, 10);
+        } else if(!strcmp(argv[i-1], "--json")) {
+            option_json = value;
+        } else if(!strcmp(argv[i-1], "--name")) {
+            option_name = value;
+        } else {
+            fprintf(stderr, "soak_test: unknown option %s\n", argv[i-1]);
+            return FAILURE;
+        }
+    }
+    if(option_calculator == NULL || option_generator == NULL) {
+        fprintf(stderr, "usage: soak_test --calculator PATH --generator PATH [--count N] [--seed N]"
+            " [--max-growth KIB] [--json FILE] [--name NAME]\n");
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+/**
+ * start argv with stdin, stdout and stderr replaced, -1 leaves them alone.
+ * all other descriptors are close-on-exec.
+*/
+static pid_t spawn(char **argv, int in, int out, int err) {
+    pid_t pid = fork();
+    if(pid == 0) {
+        if(in != -1) {
+            dup2(in, STDIN_FILENO);
+        }
+        if(out != -1) {
+            dup2(out, STDOUT_FILENO);
+        }
+        if(err != -1) {
+            dup2(err, STDERR_FILENO);
+        }
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    if(pid == -1) {
+        perror("fork");
+    }
+    return pid;
+}
+
+int main(int argc, char **argv) {
+    if(parse_arguments(argc, argv) != SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    char count[32], seed[32];
+    snprintf(count, sizeof(count), "%lld", option_count);
+    snprintf(seed, sizeof(seed), "%llu", option_seed);
+    char *generator_argv[] = {(char *)option_generator, "--seed", seed, "--count", count, NULL};
+    char *calculator_argv[] = {(char *)option_calculator, "--stats", NULL};
+    int corpus[2], diagnostics[2];
+    int null_fd = open("/dev/null", O_WRONLY|O_CLOEXEC);
+    if(null_fd == -1 || pipe2(corpus, O_CLOEXEC) == -1 || pipe2(diagnostics, O_CLOEXEC) == -1) {
+        perror("soak_test");
+        return EXIT_FAILURE;
+    }
+    double start = now();
+    pid_t generator = spawn(generator_argv, -1, corpus[1], -1);
+    pid_t calculator = spawn(calculator_argv, corpus[0], null_fd, diagnostics[1]);
+    if(generator == -1 || calculator == -1) {
+        return EXIT_FAILURE;
+    }
+    close(corpus[0]);
+    close(corpus[1]);
+    close(diagnostics[1]);
+    close(null_fd);
+    /* error diagnostics for invalid lines are drained, only stats are kept */
+    FILE *report = fdopen(diagnostics[0], "r");
+    char line[4096];
+    long long lines = -1;
+    long rss_warmup = -1, rss_max = -1, rss_final = -1;
+    while(fgets(line, sizeof(line), report) != NULL) {
+        sscanf(line, "lines %lld", &lines);
+        sscanf(line, "rss warm-up %ld", &rss_warmup);
+        sscanf(line, "rss max %ld", &rss_max);
+        sscanf(line, "rss final %ld", &rss_final);
+    }
+    fclose(report);
+    int generator_status, calculator_status;
+    waitpid(generator, &generator_status, 0);
+    waitpid(calculator, &calculator_status, 0);
+    double seconds = now() - start;
+    if(!WIFEXITED(generator_status) || WEXITSTATUS(generator_status) != 0 ||
+        !WIFEXITED(calculator_status) || lines == -1) {
+        fprintf(stderr, "soak_test: generator or calculator did not finish\n");
+        return EXIT_FAILURE;
+    }
+    long growth = rss_warmup == -1 ? -1 : rss_max - rss_warmup;
+    int passed = growth != -1 && growth <= option_max_growth;
+    printf("%s: %lld lines, rss warm-up %ld KiB, max %ld KiB, growth %ld KiB (limit %ld), %.0f lines/s\n",
+        option_name, lines, rss_warmup, rss_max, growth, option_max_growth, lines / seconds);
+    if(growth == -1) {
+        fprintf(stderr, "soak_test: not enough lines to get past warm-up\n");
+    }
+    if(option_json != NULL) {
+        FILE *json = fopen(option_json, "a");
+        if(json == NULL) {
+            perror("fopen");
+            return EXIT_FAILURE;
+        }
+        fprintf(json, "{\"benchmark\": \"%s\", \"seed\": %llu, \"lines\": %lld, \"rss_warmup_kib\": %ld,"
+            " \"rss_max_kib\": %ld, \"rss_final_kib\": %ld, \"rss_growth_kib\": %ld, \"seconds\": %.3f,"
+            " \"lines_per_second\": %.0f, \"passed\": %s}\n",
+            option_name, option_seed, lines, rss_warmup, rss_max, rss_final, growth, seconds,
+            lines / seconds, passed ? "true" : "false");
+        fclose(json);
+    }
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
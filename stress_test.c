@@ -0,0 +1,661 @@
+// Jacob Bumbuna <developer@devbumbuna.com>
+// 2022
+// no copyright
+
+/**
+ * Randomised stress test for the calculator.
+ *
+ * Expressions produced by the generator are fed to the calculator in batches.
+ * Every line is also evaluated by an independent reference evaluator
+ * (precedence climbing over the raw characters) and the calculator's stdout,
+ * its sequence of reported errors and the snippet printed for unexpected
+ * characters are compared with the reference.
+ *
+ * usage: stress_test --calculator PATH --generator PATH [--count N]
+ *                    [--seed N] [--batch N] [--time-limit SECONDS]
+ *                    [--json FILE] [--name NAME] [--calculator-args ARGS]
+ *
+ * ARGS are passed to the calculator before the input file, split on spaces.
+ * Exits with 77 (skipped) when the calculator does.
+*/
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SUCCESS 0
+#define FAILURE 1
+
+/* exit status of a calculator that can not run the requested options */
+#define EXIT_SKIPPED 77
+#define MAX_CALCULATOR_ARGUMENTS 16
+
+/* command line options */
+static const char *option_calculator = NULL;
+static const char *option_generator = NULL;
+static long long option_count = 100000;
+static unsigned long long option_seed = 1;
+static long long option_batch = 100000;
+static double option_time_limit = 0;
+static const char *option_json = NULL;
+static const char *option_name = "stress";
+static char *calculator_argv[MAX_CALCULATOR_ARGUMENTS+3];
+static int calculator_argc = 1;
+
+/* kind of error a line is expected to report */
+enum error_kind {
+    error_none,
+    error_unexpected_character,
+    error_syntax,
+    error_division_by_zero
+};
+
+static const char *error_kind_name[] = {
+    "none", "unexpected character", "syntax error", "division by zero"
+};
+
+/* growable byte buffer */
+typedef struct buffer {
+    char *data;
+    size_t size;
+    size_t capacity;
+} buffer_t;
+
+static void buffer_append(buffer_t *b, const char *data, size_t size) {
+    if(b->size + size + 1 > b->capacity) {
+        b->capacity = (b->size + size + 1) * 2;
+        b->data = realloc(b->data, b->capacity);
+        if(b->data == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    memcpy(&b->data[b->size], data, size);
+    b->size += size;
+    b->data[b->size] = 0;
+}
+
+#define buffer_append_string(b, s) \
+    buffer_append(b, s, strlen(s))
+
+/**
+ * Reference evaluator.
+ *
+ * Models the calculator's language: integers, + - * / and brackets where,
+ * as in BODMAS, division binds tighter than multiplication which binds
+ * tighter than subtraction which binds tighter than addition. All operators
+ * are left associative, literals saturate like strtol and are truncated to
+ * 32 bits and arithmetic wraps around. Nesting is only bounded by the
+ * memory budget, which the generated lines stay far below.
+*/
+
+/* reference parse tree node, stored in a flat array */
+typedef struct reference_node {
+    char operator; /* 0 for literals */
+    int32_t value;
+    int children[2];
+} reference_node_t;
+
+static reference_node_t *reference_nodes;
+static int reference_nodes_size;
+static int reference_nodes_capacity;
+
+/* input being parsed */
+static const char *reference_line;
+static int reference_line_size;
+static int reference_position;
+
+static int reference_new_node() {
+    if(reference_nodes_size == reference_nodes_capacity) {
+        reference_nodes_capacity = reference_nodes_capacity ? reference_nodes_capacity*2 : 256;
+        reference_nodes = realloc(reference_nodes, reference_nodes_capacity * sizeof(reference_node_t));
+        if(reference_nodes == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return reference_nodes_size++;
+}
+
+#define reference_is_space(c) \
+    ((c) == ' ' || (c) == '\t' || (c) == '\v' || (c) == '\f' || (c) == '\r')
+
+#define reference_is_digit(c) \
+    ((c) >= '0' && (c) <= '9')
+
+static void reference_skip_spaces() {
+    while(reference_position < reference_line_size && reference_is_space(reference_line[reference_position])) {
+        reference_position++;
+    }
+}
+
+/* next significant character or 0 at end of line */
+static char reference_peek() {
+    reference_skip_spaces();
+    return reference_position < reference_line_size ? reference_line[reference_position] : 0;
+}
+
+static int reference_precedence(char c) {
+    switch(c) {
+        case '+': return 1;
+        case '-': return 2;
+        case '*': return 3;
+        case '/': return 4;
+    }
+    return 0;
+}
+
+static int reference_parse(int min_precedence, int *node);
+
+static int reference_parse_primary(int *node) {
+    char c = reference_peek();
+    if(c == '(') {
+        reference_position++;
+        if(reference_parse(1, node) != SUCCESS || reference_peek() != ')') {
+            return FAILURE;
+        }
+        reference_position++;
+        return SUCCESS;
+    }
+    if(!reference_is_digit(c)) {
+        return FAILURE;
+    }
+    /* saturate like strtol then truncate to the width of an int */
+    unsigned long long value = 0;
+    while(reference_position < reference_line_size && reference_is_digit(reference_line[reference_position])) {
+        int digit = reference_line[reference_position++] - '0';
+        value = value > (unsigned long long)(INT64_MAX - digit) / 10 ? INT64_MAX : value * 10 + digit;
+    }
+    *node = reference_new_node();
+    reference_nodes[*node].operator = 0;
+    reference_nodes[*node].value = (int32_t)(uint32_t)value;
+    return SUCCESS;
+}
+
+static int reference_parse(int min_precedence, int *node) {
+    if(reference_parse_primary(node) != SUCCESS) {
+        return FAILURE;
+    }
+    for(;;) {
+        char c = reference_peek();
+        int precedence = reference_precedence(c);
+        if(precedence == 0 || precedence < min_precedence) {
+            return SUCCESS;
+        }
+        reference_position++;
+        int right;
+        if(reference_parse(precedence+1, &right) != SUCCESS) {
+            return FAILURE;
+        }
+        int parent = reference_new_node();
+        reference_nodes[parent].operator = c;
+        reference_nodes[parent].children[0] = *node;
+        reference_nodes[parent].children[1] = right;
+        *node = parent;
+    }
+}
+
+/**
+ * evaluate in post order like the calculator, so the first error is the
+ * one it reports.
+*/
+static int reference_evaluate(int node, int32_t *result) {
+    reference_node_t *n = &reference_nodes[node];
+    if(n->operator == 0) {
+        *result = n->value;
+        return error_none;
+    }
+    int32_t left = 0, right = 0;
+    int error = reference_evaluate(n->children[0], &left);
+    if(error == error_none) {
+        error = reference_evaluate(n->children[1], &right);
+    }
+    if(error != error_none) {
+        return error;
+    }
+    switch(n->operator) {
+        case '+': *result = (int32_t)((uint32_t)left + (uint32_t)right); break;
+        case '-': *result = (int32_t)((uint32_t)left - (uint32_t)right); break;
+        case '*': *result = (int32_t)((uint32_t)left * (uint32_t)right); break;
+        case '/': {
+            if(right == 0) {
+                return error_division_by_zero;
+            }
+            *result = right == -1 ? (int32_t)(0u - (uint32_t)left) : left / right;
+            break;
+        }
+    }
+    return error_none;
+}
+
+/**
+ * the snippet the tokenizer prints under "Unexpected character."
+*/
+static void reference_snippet(const char *line, int size, int i, buffer_t *out) {
+    /* size counts the terminating newline like the calculator's line buffer */
+    int snippet_start = i > 5 ? i-5 : 0;
+    int snippet_end = (i+5) < size-1 ? i+5 : size-1;
+    buffer_append_string(out, "\t");
+    buffer_append(out, &line[snippet_start], i-snippet_start);
+    buffer_append_string(out, "\033[1;31m");
+    buffer_append(out, &line[i], 1);
+    buffer_append_string(out, "\033[0m");
+    if(snippet_end > i+1) {
+        buffer_append(out, &line[i+1], snippet_end-i-1);
+    }
+    buffer_append_string(out, "\n\t");
+    for(int j = snippet_start; j <= snippet_end; j++) {
+        buffer_append_string(out, j == i ? "^" : "~");
+    }
+    buffer_append_string(out, "\n");
+}
+
+/**
+ * evaluate one line (without its newline).
+ * returns -1 for lines the calculator skips, otherwise an error_kind.
+*/
+static int reference_evaluate_line(const char *line, int size, int32_t *result, buffer_t *snippet) {
+    int blank = 1;
+    for(int i = 0; i < size; i++) {
+        char c = line[i];
+        if(!reference_is_space(c)) {
+            blank = 0;
+        }
+        if(!reference_is_space(c) && !reference_is_digit(c) && !reference_precedence(c) && c != '(' && c != ')') {
+            reference_snippet(line, size+1, i, snippet);
+            return error_unexpected_character;
+        }
+    }
+    if(blank) {
+        return -1;
+    }
+    int root;
+    reference_line = line;
+    reference_line_size = size;
+    reference_position = 0;
+    reference_nodes_size = 0;
+    if(reference_parse(1, &root) != SUCCESS || reference_peek() != 0) {
+        return error_syntax;
+    }
+    return reference_evaluate(root, result);
+}
+
+/* expectation for one corpus line */
+typedef struct expectation {
+    long long line_number;
+    int error;
+} expectation_t;
+
+/* state of the batch being built */
+static buffer_t batch_input;
+static buffer_t expected_stdout;
+static buffer_t expected_snippets;
+static expectation_t *batch_expectations;
+static long long batch_size;
+/* reported problems */
+static long long mismatches;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int add_line_to_batch(const char *line, size_t size, long long line_number) {
+    int32_t result = 0;
+    buffer_append(&batch_input, line, size);
+    buffer_append_string(&batch_input, "\n");
+    int error = reference_evaluate_line(line, size, &result, &expected_snippets);
+    if(error == -1) {
+        return SUCCESS;
+    }
+    if(error == error_none) {
+        char formatted[64];
+        int n = snprintf(formatted, sizeof(formatted), "\033[1;32m%d\033[0m.\n", result);
+        buffer_append(&expected_stdout, formatted, n);
+    }
+    batch_expectations[batch_size].line_number = line_number;
+    batch_expectations[batch_size].error = error;
+    batch_size++;
+    return SUCCESS;
+}
+
+static int read_file(const char *path, buffer_t *out) {
+    char chunk[1 << 16];
+    int fd = open(path, O_RDONLY);
+    if(fd == -1) {
+        perror("open");
+        return FAILURE;
+    }
+    out->size = 0;
+    ssize_t n;
+    while((n = read(fd, chunk, sizeof(chunk))) > 0) {
+        buffer_append(out, chunk, n);
+    }
+    close(fd);
+    if(out->data == NULL) {
+        buffer_append(out, "", 0);
+    }
+    return n == 0 ? SUCCESS : FAILURE;
+}
+
+static int write_file(const char *path, const buffer_t *in) {
+    FILE *f = fopen(path, "w");
+    if(f == NULL) {
+        perror("fopen");
+        return FAILURE;
+    }
+    int r = fwrite(in->data, 1, in->size, f) == in->size ? SUCCESS : FAILURE;
+    return fclose(f) == 0 ? r : FAILURE;
+}
+
+/**
+ * run the calculator on input_path with stdout and stderr redirected.
+ * returns the raw wait status or -1.
+*/
+static int run_calculator(const char *input_path, const char *stdout_path, const char *stderr_path) {
+    pid_t pid = fork();
+    if(pid == -1) {
+        perror("fork");
+        return -1;
+    }
+    if(pid == 0) {
+        int out = open(stdout_path, O_WRONLY|O_CREAT|O_TRUNC, 0600);
+        int err = open(stderr_path, O_WRONLY|O_CREAT|O_TRUNC, 0600);
+        if(out == -1 || err == -1) {
+            _exit(127);
+        }
+        dup2(out, STDOUT_FILENO);
+        dup2(err, STDERR_FILENO);
+        calculator_argv[0] = (char *)option_calculator;
+        calculator_argv[calculator_argc] = (char *)input_path;
+        calculator_argv[calculator_argc+1] = NULL;
+        execv(option_calculator, calculator_argv);
+        _exit(127);
+    }
+    int status;
+    if(waitpid(pid, &status, 0) == -1) {
+        perror("waitpid");
+        return -1;
+    }
+    return status;
+}
+
+/**
+ * report a mismatch on the expectation at index and keep the input around.
+*/
+static void report_mismatch(long long index, const char *what, const char *input_path) {
+    mismatches++;
+    if(index < batch_size) {
+        fprintf(stderr, "stress_test: %s on corpus line %lld (expected %s), input kept in %s\n",
+            what, batch_expectations[index].line_number,
+            error_kind_name[batch_expectations[index].error], input_path);
+    } else {
+        fprintf(stderr, "stress_test: %s after the last line, input kept in %s\n", what, input_path);
+    }
+}
+
+/**
+ * compare the calculator's stderr with the expected sequence of errors.
+*/
+static int check_errors(const buffer_t *actual, const char *input_path) {
+    const char *p = actual->data;
+    const char *end = actual->data + actual->size;
+    const char *snippet = expected_snippets.data ? expected_snippets.data : "";
+    long long index = 0;
+    while(p < end) {
+        const char *eol = memchr(p, '\n', end-p);
+        eol = eol ? eol+1 : end;
+        int kind;
+        if(!strncmp(p, "Unexpected character.", 21)) {
+            kind = error_unexpected_character;
+        } else if(memmem(p, eol-p, "SyntaxError", 11)) {
+            kind = error_syntax;
+        } else if(memmem(p, eol-p, "Division by Zero", 16)) {
+            kind = error_division_by_zero;
+        } else {
+            fprintf(stderr, "stress_test: unrecognised diagnostic: %.*s", (int)(eol-p), p);
+            mismatches++;
+            return FAILURE;
+        }
+        p = eol;
+        while(index < batch_size && batch_expectations[index].error == error_none) {
+            index++;
+        }
+        if(index == batch_size || batch_expectations[index].error != kind) {
+            report_mismatch(index, error_kind_name[kind], input_path);
+            return FAILURE;
+        }
+        if(kind == error_unexpected_character) {
+            /* the two snippet lines follow the message */
+            const char *snippet_end = p;
+            const char *expected_end = snippet;
+            for(int lines = 0; lines < 2; lines++) {
+                const char *nl = memchr(snippet_end, '\n', end-snippet_end);
+                snippet_end = nl ? nl+1 : end;
+                nl = strchr(expected_end, '\n');
+                expected_end = nl ? nl+1 : expected_end + strlen(expected_end);
+            }
+            size_t n = snippet_end - p;
+            if(n != (size_t)(expected_end - snippet) || memcmp(p, snippet, n)) {
+                report_mismatch(index, "wrong error snippet", input_path);
+                return FAILURE;
+            }
+            snippet = expected_end;
+            p = snippet_end;
+        }
+        index++;
+    }
+    while(index < batch_size && batch_expectations[index].error == error_none) {
+        index++;
+    }
+    if(index != batch_size) {
+        report_mismatch(index, "missing error", input_path);
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+/**
+ * compare the calculator's stdout with the expected results.
+*/
+static int check_results(const buffer_t *actual, const char *input_path) {
+    /* the calculator ends its output with an empty line */
+    buffer_append_string(&expected_stdout, "\n");
+    if(actual->size == expected_stdout.size && !memcmp(actual->data, expected_stdout.data, actual->size)) {
+        return SUCCESS;
+    }
+    /* find the first differing result to locate the line */
+    long long result = 0;
+    size_t i = 0;
+    while(i < actual->size && i < expected_stdout.size && actual->data[i] == expected_stdout.data[i]) {
+        if(actual->data[i++] == '\n') {
+            result++;
+        }
+    }
+    long long index = 0;
+    for(; index < batch_size; index++) {
+        if(batch_expectations[index].error == error_none && result-- == 0) {
+            break;
+        }
+    }
+    report_mismatch(index, "wrong result", input_path);
+    return FAILURE;
+}
+
+/**
+ * run the calculator over the current batch and check its output.
+*/
+static int run_batch(const char *directory, double *calculator_seconds) {
+    char input_path[512], stdout_path[512], stderr_path[512];
+    static buffer_t actual;
+    snprintf(input_path, sizeof(input_path), "%s/input", directory);
+    snprintf(stdout_path, sizeof(stdout_path), "%s/stdout", directory);
+    snprintf(stderr_path, sizeof(stderr_path), "%s/stderr", directory);
+    if(write_file(input_path, &batch_input) != SUCCESS) {
+        return FAILURE;
+    }
+    double start = now();
+    int status = run_calculator(input_path, stdout_path, stderr_path);
+    *calculator_seconds += now() - start;
+    if(status == -1) {
+        return FAILURE;
+    }
+    if(WIFSIGNALED(status)) {
+        fprintf(stderr, "stress_test: calculator killed by signal %d, input kept in %s\n", WTERMSIG(status), input_path);
+        mismatches++;
+        return FAILURE;
+    }
+    if(WEXITSTATUS(status) == EXIT_SKIPPED) {
+        return EXIT_SKIPPED;
+    }
+    int any_error = 0;
+    for(long long i = 0; i < batch_size; i++) {
+        any_error |= batch_expectations[i].error != error_none;
+    }
+    if(WEXITSTATUS(status) != (any_error ? 1 : 0)) {
+        fprintf(stderr, "stress_test: unexpected exit status %d, input kept in %s\n", WEXITSTATUS(status), input_path);
+        mismatches++;
+        return FAILURE;
+    }
+    if(read_file(stderr_path, &actual) != SUCCESS || check_errors(&actual, input_path) != SUCCESS) {
+        return FAILURE;
+    }
+    if(read_file(stdout_path, &actual) != SUCCESS || check_results(&actual, input_path) != SUCCESS) {
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+static int parse_arguments(int argc, char **argv) {
+    for(int i = 1; i < argc; i++) {
+        if(i+1 >= argc) {
+            fprintf(stderr, "stress_test: missing value for %s\n", argv[i]);
+            return FAILURE;
+        }
+        const char *value = argv[++i];
+        if(!strcmp(argv[i-1], "--calculator")) {
+            option_calculator = value;
+        } else if(!strcmp(argv[i-1], "--generator")) {
+            option_generator = value;
+        } else if(!strcmp(argv[i-1], "--count")) {
+            option_count = strtoll(value, 0, 10);
+        } else if(!strcmp(argv[i-1], "--seed")) {
+            option_seed = strtoull(value, 0, 10);
+        } else if(!strcmp(argv[i-1], "--batch")) {
+            option_batch = strtoll(value, 0, 10);
+        } else if(!strcmp(argv[i-1], "--time-limit")) {
+            option_time_limit = strtod(value, 0);
+        } else if(!strcmp(argv[i-1], "--json")) {
+            option_json = value;
+        } else if(!strcmp(argv[i-1], "--name")) {
+            option_name = value;
+        } else if(!strcmp(argv[i-1], "--calculator-args")) {
+            for(char *arg = strtok(argv[i], " "); arg != NULL; arg = strtok(NULL, " ")) {
+                if(calculator_argc > MAX_CALCULATOR_ARGUMENTS) {
+                    fprintf(stderr, "stress_test: too many calculator arguments\n");
+                    return FAILURE;
+                }
+                calculator_argv[calculator_argc++] = arg;
+            }
+        } else {
+            fprintf(stderr, "stress_test: unknown option %s\n", argv[i-1]);
+            return FAILURE;
+        }
+    }
+    if(option_calculator == NULL || option_generator == NULL || option_batch < 1) {
+        fprintf(stderr, "usage: stress_test --calculator PATH --generator PATH [--count N] [--seed N]"
+            " [--batch N] [--time-limit SECONDS] [--json FILE] [--name NAME] [--calculator-args ARGS]\n");
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+int main(int argc, char **argv) {
+    if(parse_arguments(argc, argv) != SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    char directory[] = "/tmp/calculator_stress_XXXXXX";
+    if(mkdtemp(directory) == NULL) {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+    char command[1024];
+    snprintf(command, sizeof(command), "'%s' --seed %llu --count %lld", option_generator, option_seed, option_count);
+    FILE *corpus = popen(command, "r");
+    if(corpus == NULL) {
+        perror("popen");
+        return EXIT_FAILURE;
+    }
+    batch_expectations = calloc(option_batch, sizeof(expectation_t));
+    char *line = NULL;
+    size_t line_capacity = 0;
+    ssize_t line_size;
+    long long lines = 0;
+    long long line_number = 0;
+    double start = now();
+    double calculator_seconds = 0;
+    int r = SUCCESS;
+    int out_of_time = 0;
+    do {
+        batch_input.size = expected_stdout.size = expected_snippets.size = 0;
+        batch_size = 0;
+        long long batch_lines = 0;
+        while(batch_lines < option_batch && (line_size = getline(&line, &line_capacity, corpus)) > 0) {
+            line_number++;
+            batch_lines++;
+            if(line[line_size-1] == '\n') {
+                line_size--;
+            }
+            if(add_line_to_batch(line, line_size, line_number) != SUCCESS) {
+                r = FAILURE;
+                break;
+            }
+        }
+        if(r != SUCCESS || batch_lines == 0) {
+            break;
+        }
+        r = run_batch(directory, &calculator_seconds);
+        if(r == EXIT_SKIPPED) {
+            break;
+        }
+        lines += batch_lines;
+        out_of_time = option_time_limit > 0 && now() - start >= option_time_limit;
+    } while(r == SUCCESS && !out_of_time);
+    free(line);
+    /* stop the generator early when the time limit hit */
+    pclose(corpus);
+    if(r == SUCCESS || r == EXIT_SKIPPED) {
+        char path[512];
+        const char *names[] = {"input", "stdout", "stderr"};
+        for(int i = 0; i < 3; i++) {
+            snprintf(path, sizeof(path), "%s/%s", directory, names[i]);
+            unlink(path);
+        }
+        rmdir(directory);
+    }
+    if(r == EXIT_SKIPPED) {
+        printf("%s: skipped, the calculator can not run with these options\n", option_name);
+        return EXIT_SKIPPED;
+    }
+    double throughput = calculator_seconds > 0 ? lines / calculator_seconds : 0;
+    printf("%s: %lld expressions, %lld mismatches, %.0f expressions/s%s\n", option_name, lines, mismatches,
+        throughput, out_of_time ? " (time limit reached)" : "");
+    if(option_json != NULL) {
+        FILE *json = fopen(option_json, "a");
+        if(json == NULL) {
+            perror("fopen");
+            return EXIT_FAILURE;
+        }
+        fprintf(json, "{\"benchmark\": \"%s\", \"seed\": %llu, \"expressions\": %lld, \"mismatches\": %lld,"
+            " \"seconds\": %.3f, \"expressions_per_second\": %.0f}\n",
+            option_name, option_seed, lines, mismatches, calculator_seconds, throughput);
+        fclose(json);
+    }
+    return r == SUCCESS && mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}